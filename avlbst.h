@@ -6,34 +6,218 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <vector>
+#include <future>
+#include <thread>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include "bst.h"
+#include "frozen_avlbst.h"
 
 struct KeyError { };
 
+/**
+* Augmentation policies for AVLTree.
+*
+* A policy keeps some summary of each subtree in the node at its root. It
+* provides Data<Key, Value>, which every AVLNode inherits (so the summary
+* lives in the node itself), and update(node), which recomputes the
+* node's summary from its own item and its children. The tree calls
+* update() bottom up wherever a subtree changes: along the path of an
+* insert or remove and for both nodes of every rotation. enabled lets the
+* tree skip that walk entirely when there is nothing to keep up to date.
+*/
+
+/**
+* The default: no summary, no extra bytes per node (the empty Data base
+* is optimized away) and no extra work.
+*/
+struct NoAugment
+{
+    static const bool enabled = false;
+
+    template<typename Key, typename Value>
+    class Data
+    {
+    };
+
+    template<typename NodeT>
+    static void update(NodeT* node)
+    {
+    }
+};
+
+/**
+* Keeps the number of nodes in every subtree, which is what select(),
+* rank() and count_range() on AVLTree need.
+*/
+struct OrderStatistics
+{
+    static const bool enabled = true;
+
+    template<typename Key, typename Value>
+    class Data
+    {
+    public:
+        Data() : size_(1) { }
+        std::size_t getSize() const { return size_; }
+        void setSize(std::size_t size) { size_ = size; }
+    private:
+        std::size_t size_;
+    };
+
+    // size of a possibly empty subtree
+    template<typename NodeT>
+    static std::size_t size(const NodeT* node)
+    {
+        return node == nullptr ? 0 : node->getSize();
+    }
+
+    template<typename NodeT>
+    static void update(NodeT* node)
+    {
+        node->setSize(size(node->getLeft()) + size(node->getRight()) + 1);
+    }
+};
+
+/**
+* Keeps the combination of all values in every subtree under an
+* associative Monoid, which is what AVLTree::aggregate() needs. Monoid
+* provides a Result type, identity() and combine(a, b); values are
+* converted to Result. combine need not be commutative: it is always
+* applied in key order. Base is another policy to keep alongside, e.g.
+* Aggregate<SumOf<long>, OrderStatistics>.
+*/
+template<typename Monoid, typename Base = NoAugment>
+struct Aggregate : public Base
+{
+    static const bool enabled = true;
+    typedef typename Monoid::Result Result;
+
+    template<typename Key, typename Value>
+    class Data : public Base::template Data<Key, Value>
+    {
+    public:
+        Data() : aggregate_(Monoid::identity()) { }
+        const Result& getAggregate() const { return aggregate_; }
+        void setAggregate(const Result& aggregate) { aggregate_ = aggregate; }
+    private:
+        Result aggregate_;
+    };
+
+    static Result identity()
+    {
+        return Monoid::identity();
+    }
+
+    // aggregate of a possibly empty subtree
+    template<typename NodeT>
+    static Result aggregate(const NodeT* node)
+    {
+        return node == nullptr ? Monoid::identity() : node->getAggregate();
+    }
+
+    static Result combine(const Result& a, const Result& b)
+    {
+        return Monoid::combine(a, b);
+    }
+
+    template<typename NodeT>
+    static void update(NodeT* node)
+    {
+        Base::update(node);
+        node->setAggregate(combine(combine(aggregate(node->getLeft()), Result(node->getValue())),
+                                   aggregate(node->getRight())));
+    }
+};
+
+/**
+* Monoids for Aggregate: the sum, smallest and largest value.
+*/
+template<typename T>
+struct SumOf
+{
+    typedef T Result;
+    static T identity() { return T(); }
+    static T combine(const T& a, const T& b) { return a + b; }
+};
+
+template<typename T>
+struct MinOf
+{
+    typedef T Result;
+    static T identity() { return std::numeric_limits<T>::max(); }
+    static T combine(const T& a, const T& b) { return b < a ? b : a; }
+};
+
+template<typename T>
+struct MaxOf
+{
+    typedef T Result;
+    static T identity() { return std::numeric_limits<T>::lowest(); }
+    static T combine(const T& a, const T& b) { return a < b ? b : a; }
+};
+
+template <typename Key, typename Value, typename Augment>
+class AVLNode;
+
+/**
+* Wraps another policy and also links every node to its in-order
+* neighbours, so that stepping an iterator is a single load instead of a
+* walk up the parent chain; long scans then run at linked list speed. It
+* costs two pointers per node. Rotations do not change the order of the
+* nodes, so the links are only touched when nodes come and go, or when
+* trees are split and joined.
+*/
+template<typename Base = NoAugment>
+struct Threaded : public Base
+{
+    template<typename Key, typename Value>
+    class Data : public Base::template Data<Key, Value>
+    {
+    public:
+        typedef AVLNode<Key, Value, Threaded<Base> > NodeType;
+
+        Data() : prev_(nullptr), next_(nullptr) { }
+        NodeType* getPrev() const { return prev_; }
+        NodeType* getNext() const { return next_; }
+        void setPrev(NodeType* prev) { prev_ = prev; }
+        void setNext(NodeType* next) { next_ = next; }
+    private:
+        NodeType* prev_;
+        NodeType* next_;
+    };
+};
+
 /**
 * A special kind of node for an AVL tree, which adds the balance as a data member, plus
-* other additional helper functions. You do NOT need to implement any functionality or
-* add additional data members or helper functions.
+* other additional helper functions. The Augment policy (see above) can add more per
+* subtree data through its Data base class.
 */
-template <typename Key, typename Value>
-class AVLNode : public Node<Key, Value>
+template <typename Key, typename Value, typename Augment = NoAugment>
+class AVLNode : public Node<Key, Value>, public Augment::template Data<Key, Value>
 {
 public:
     // Constructor/destructor.
-    AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
-    virtual ~AVLNode();
+    template<typename K, typename V>
+    AVLNode(K&& key, V&& value, AVLNode<Key, Value, Augment>* parent);
+    template<typename... KeyArgs, typename... ValueArgs>
+    AVLNode(std::piecewise_construct_t, std::tuple<KeyArgs...> keyArgs, std::tuple<ValueArgs...> valueArgs,
+            AVLNode<Key, Value, Augment>* parent);
+    ~AVLNode();
 
     // Getter/setter for the node's height.
     int8_t getBalance () const;
     void setBalance (int8_t balance);
     void updateBalance(int8_t diff);
 
-    // Getters for parent, left, and right. These need to be redefined since they
+    // Getters for parent, left, and right. These hide the Node versions since they
     // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
     // for more information.
-    virtual AVLNode<Key, Value>* getParent() const override;
-    virtual AVLNode<Key, Value>* getLeft() const override;
-    virtual AVLNode<Key, Value>* getRight() const override;
+    AVLNode<Key, Value, Augment>* getParent() const;
+    AVLNode<Key, Value, Augment>* getLeft() const;
+    AVLNode<Key, Value, Augment>* getRight() const;
 
 protected:
     int8_t balance_;    // effectively a signed char
@@ -49,9 +233,22 @@ protected:
 * An explicit constructor to initialize the elements by calling the base class constructor and setting
 * the color to red since every new node will be red when it is first inserted.
 */
-template<class Key, class Value>
-AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
-    Node<Key, Value>(key, value, parent), balance_(0)
+template<class Key, class Value, class Augment>
+template<typename K, typename V>
+AVLNode<Key, Value, Augment>::AVLNode(K&& key, V&& value, AVLNode<Key, Value, Augment> *parent) :
+    Node<Key, Value>(std::forward<K>(key), std::forward<V>(value), parent), balance_(0)
+{
+
+}
+
+/**
+* Builds the item in place, see the piecewise Node constructor.
+*/
+template<class Key, class Value, class Augment>
+template<typename... KeyArgs, typename... ValueArgs>
+AVLNode<Key, Value, Augment>::AVLNode(std::piecewise_construct_t, std::tuple<KeyArgs...> keyArgs,
+                                      std::tuple<ValueArgs...> valueArgs, AVLNode<Key, Value, Augment>* parent) :
+    Node<Key, Value>(std::piecewise_construct, std::move(keyArgs), std::move(valueArgs), parent), balance_(0)
 {
 
 }
@@ -59,8 +256,8 @@ AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Va
 /**
 * A destructor which does nothing.
 */
-template<class Key, class Value>
-AVLNode<Key, Value>::~AVLNode()
+template<class Key, class Value, class Augment>
+AVLNode<Key, Value, Augment>::~AVLNode()
 {
 
 }
@@ -68,8 +265,8 @@ AVLNode<Key, Value>::~AVLNode()
 /**
 * A getter for the balance of a AVLNode.
 */
-template<class Key, class Value>
-int8_t AVLNode<Key, Value>::getBalance() const
+template<class Key, class Value, class Augment>
+int8_t AVLNode<Key, Value, Augment>::getBalance() const
 {
     return balance_;
 }
@@ -77,8 +274,8 @@ int8_t AVLNode<Key, Value>::getBalance() const
 /**
 * A setter for the balance of a AVLNode.
 */
-template<class Key, class Value>
-void AVLNode<Key, Value>::setBalance(int8_t balance)
+template<class Key, class Value, class Augment>
+void AVLNode<Key, Value, Augment>::setBalance(int8_t balance)
 {
     balance_ = balance;
 }
@@ -86,38 +283,39 @@ void AVLNode<Key, Value>::setBalance(int8_t balance)
 /**
 * Adds diff to the balance of a AVLNode.
 */
-template<class Key, class Value>
-void AVLNode<Key, Value>::updateBalance(int8_t diff)
+template<class Key, class Value, class Augment>
+void AVLNode<Key, Value, Augment>::updateBalance(int8_t diff)
 {
     balance_ += diff;
 }
 
 /**
-* An overridden function for getting the parent since a static_cast is necessary to make sure
-* that our node is a AVLNode.
+* Hides Node::getParent since a static_cast is necessary to make sure
+* that our node is a AVLNode. The tree is instantiated with AVLNode as its node
+* type, so this is resolved at compile time.
 */
-template<class Key, class Value>
-AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
+template<class Key, class Value, class Augment>
+AVLNode<Key, Value, Augment> *AVLNode<Key, Value, Augment>::getParent() const
 {
-    return static_cast<AVLNode<Key, Value>*>(this->parent_);
+    return static_cast<AVLNode<Key, Value, Augment>*>(this->parent_);
 }
 
 /**
-* Overridden for the same reasons as above.
+* Hidden for the same reasons as above.
 */
-template<class Key, class Value>
-AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
+template<class Key, class Value, class Augment>
+AVLNode<Key, Value, Augment> *AVLNode<Key, Value, Augment>::getLeft() const
 {
-    return static_cast<AVLNode<Key, Value>*>(this->left_);
+    return static_cast<AVLNode<Key, Value, Augment>*>(this->left_);
 }
 
 /**
-* Overridden for the same reasons as above.
+* Hidden for the same reasons as above.
 */
-template<class Key, class Value>
-AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
+template<class Key, class Value, class Augment>
+AVLNode<Key, Value, Augment> *AVLNode<Key, Value, Augment>::getRight() const
 {
-    return static_cast<AVLNode<Key, Value>*>(this->right_);
+    return static_cast<AVLNode<Key, Value, Augment>*>(this->right_);
 }
 
 
@@ -128,29 +326,233 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+template <class Key, class Value, class Augment = NoAugment, class Compare = std::less<Key> >
+class AVLTree : public BinarySearchTree<Key, Value, AVLNode<Key, Value, Augment>, Compare>
 {
 public:
-    virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
+    typedef typename BinarySearchTree<Key, Value, AVLNode<Key, Value, Augment>, Compare>::iterator iterator;
+    typedef typename BinarySearchTree<Key, Value, AVLNode<Key, Value, Augment>, Compare>::const_iterator const_iterator;
+    typedef typename BinarySearchTree<Key, Value, AVLNode<Key, Value, Augment>, Compare>::reverse_iterator reverse_iterator;
+    typedef typename BinarySearchTree<Key, Value, AVLNode<Key, Value, Augment>, Compare>::const_reverse_iterator const_reverse_iterator;
+
+    AVLTree();
+    template<typename ForwardIt>
+    AVLTree(ForwardIt first, ForwardIt last);
+    template<typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
     virtual void remove(const Key& key);  // TODO
+
+    // Order statistics, only available with the OrderStatistics policy
+    iterator select(std::size_t k) const;
+    std::size_t rank(const Key& key) const;
+    std::size_t count_range(const Key& lo, const Key& hi) const;
+
+    // Range aggregates, only available with an Aggregate policy
+    template<typename A = Augment>
+    typename A::Result aggregate(const Key& lo, const Key& hi) const;
+    void setValue(const Key& key, const Value& value);
+
+    std::size_t erase_range(const Key& lo, const Key& hi);
+
+    FrozenAVLTree<Key, Value, Compare> freeze() const;
+
+    AVLTree split(const Key& key);
+    static AVLTree join(AVLTree& left, AVLTree& right);
+
+    void union_with(AVLTree& other);
+    void intersect_with(const AVLTree& other);
+    void difference_with(const AVLTree& other);
+
+    template<typename ForwardIt>
+    std::vector<bool> insert_batch(ForwardIt first, ForwardIt last);
+    template<typename ForwardIt>
+    std::vector<bool> erase_batch(ForwardIt first, ForwardIt last);
 protected:
-    virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
+    void updatePath(AVLNode<Key, Value, Augment>* node);
+    virtual void nodeSwap( AVLNode<Key, Value, Augment>* n1, AVLNode<Key, Value, Augment>* n2);
+    template<typename ForwardIt>
+    AVLNode<Key, Value, Augment>* buildBalanced(ForwardIt& it, ForwardIt last, std::size_t n, AVLNode<Key, Value, Augment>* parent, int& height);
+    virtual void afterInsert(AVLNode<Key, Value, Augment>* node);
+    virtual void afterAssign(AVLNode<Key, Value, Augment>* node);
 
     // Add helper functions here
-    virtual void insertFix(AVLNode<Key,Value>* node1, AVLNode<Key,Value>* node2); //added by Huizhen TODO
-    virtual void removeFix(AVLNode<Key, Value>* node, int change); //added by Huizhen TODO
-    virtual void rightRotate(AVLNode<Key,Value>* node);//added by Huizhen TODO
-    virtual void leftRotate(AVLNode<Key,Value>* node);//added by Huizhen TODO
-    virtual bool isleftChild(AVLNode<Key,Value>* node);
+    virtual void insertFix(AVLNode<Key, Value, Augment>* node1, AVLNode<Key, Value, Augment>* node2); //added by Huizhen TODO
+    virtual void removeFix(AVLNode<Key, Value, Augment>* node, int change); //added by Huizhen TODO
+    virtual void rightRotate(AVLNode<Key, Value, Augment>* node);//added by Huizhen TODO
+    virtual void leftRotate(AVLNode<Key, Value, Augment>* node);//added by Huizhen TODO
+    virtual bool isleftChild(AVLNode<Key, Value, Augment>* node);
     //zig zig and zig zag case 
-    bool isZigzig(AVLNode<Key, Value>* g, AVLNode<Key, Value>* p, AVLNode<Key, Value>* n); 
-    bool isZigzag(AVLNode<Key, Value>* g, AVLNode<Key, Value>* p, AVLNode<Key, Value>* n);
+    bool isZigzig(AVLNode<Key, Value, Augment>* g, AVLNode<Key, Value, Augment>* p, AVLNode<Key, Value, Augment>* n); 
+    bool isZigzag(AVLNode<Key, Value, Augment>* g, AVLNode<Key, Value, Augment>* p, AVLNode<Key, Value, Augment>* n);
+
+    // Join and split on detached subtrees. Heights are passed alongside the
+    // roots so that balances can be set directly instead of retraced.
+    static int subtreeHeight(AVLNode<Key, Value, Augment>* node);
+    static AVLNode<Key, Value, Augment>* makeNode(AVLNode<Key, Value, Augment>* l, int hl, AVLNode<Key, Value, Augment>* k,
+                                                  AVLNode<Key, Value, Augment>* r, int hr, int& h);
+    static AVLNode<Key, Value, Augment>* joinRight(AVLNode<Key, Value, Augment>* l, int hl, AVLNode<Key, Value, Augment>* k,
+                                                   AVLNode<Key, Value, Augment>* r, int hr, int& h);
+    static AVLNode<Key, Value, Augment>* joinLeft(AVLNode<Key, Value, Augment>* l, int hl, AVLNode<Key, Value, Augment>* k,
+                                                  AVLNode<Key, Value, Augment>* r, int hr, int& h);
+    static AVLNode<Key, Value, Augment>* joinNode(AVLNode<Key, Value, Augment>* l, int hl, AVLNode<Key, Value, Augment>* k,
+                                                  AVLNode<Key, Value, Augment>* r, int hr, int& h);
+    static AVLNode<Key, Value, Augment>* joinTrees(AVLNode<Key, Value, Augment>* l, int hl,
+                                                   AVLNode<Key, Value, Augment>* r, int hr, int& h);
+    static AVLNode<Key, Value, Augment>* splitLast(AVLNode<Key, Value, Augment>* t, int ht,
+                                                   AVLNode<Key, Value, Augment>*& last, int& h);
+    static void splitAt(AVLNode<Key, Value, Augment>* t, int ht, const Key& key,
+                        AVLNode<Key, Value, Augment>*& l, int& hl, AVLNode<Key, Value, Augment>*& r, int& hr);
+    static void splitFind(AVLNode<Key, Value, Augment>* t, int ht, const Key& key,
+                          AVLNode<Key, Value, Augment>*& l, int& hl, AVLNode<Key, Value, Augment>*& found,
+                          AVLNode<Key, Value, Augment>*& r, int& hr);
+
+    // Set operations on detached subtrees. Nodes that drop out are collected
+    // in discarded and freed by the caller once every thread is done, since
+    // the pool is not thread safe. forks is how many threads the call may
+    // still spread over.
+    static AVLNode<Key, Value, Augment>* unionNodes(AVLNode<Key, Value, Augment>* t1, int h1,
+                                                    AVLNode<Key, Value, Augment>* t2, int h2, int& h,
+                                                    std::vector<AVLNode<Key, Value, Augment>*>& discarded, unsigned forks);
+    static AVLNode<Key, Value, Augment>* intersectNodes(AVLNode<Key, Value, Augment>* t1, int h1,
+                                                        const AVLNode<Key, Value, Augment>* t2, int h2, int& h,
+                                                        std::vector<AVLNode<Key, Value, Augment>*>& discarded, unsigned forks);
+    static AVLNode<Key, Value, Augment>* differenceNodes(AVLNode<Key, Value, Augment>* t1, int h1,
+                                                         const AVLNode<Key, Value, Augment>* t2, int h2, int& h,
+                                                         std::vector<AVLNode<Key, Value, Augment>*>& discarded, unsigned forks);
+    static unsigned forkBudget();
+    void freeDiscarded(const std::vector<AVLNode<Key, Value, Augment>*>& discarded);
+
+    // both subtrees of a set operation must be at least this high (about a
+    // thousand nodes or more) before their halves are worth another thread
+    static const int kParallelCutoffHeight = 14;
+
+    // Number of nodes under node if the augmentation keeps subtree sizes,
+    // unknownSize otherwise. Call as knownSize<Augment>(node, 0).
+    template<typename A>
+    static auto knownSize(AVLNode<Key, Value, Augment>* node, int) -> decltype(A::size(node));
+    template<typename A>
+    static std::size_t knownSize(AVLNode<Key, Value, Augment>* node, long);
+
+    // Batched updates. A batch is a sorted run of (item, position in the
+    // caller's range) entries with one entry per key, merged into a
+    // detached subtree top down.
+    template<typename ForwardIt, typename KeyOf>
+    static std::vector<std::pair<ForwardIt, std::size_t> > sortedBatch(ForwardIt first, ForwardIt last, KeyOf keyOf);
+    template<typename ForwardIt>
+    AVLNode<Key, Value, Augment>* insertSorted(AVLNode<Key, Value, Augment>* t, int ht, const std::pair<ForwardIt, std::size_t>* batch,
+                                               std::size_t m, std::vector<bool>& added, int& h);
+    template<typename ForwardIt>
+    AVLNode<Key, Value, Augment>* buildSorted(const std::pair<ForwardIt, std::size_t>* batch, std::size_t m,
+                                              std::vector<bool>& added, int& h);
+    template<typename ForwardIt>
+    AVLNode<Key, Value, Augment>* eraseSorted(AVLNode<Key, Value, Augment>* t, int ht, const std::pair<ForwardIt, std::size_t>* batch,
+                                              std::size_t m, std::vector<bool>& removed, int& h);
+    static void collectNodes(AVLNode<Key, Value, Augment>* node, std::vector<AVLNode<Key, Value, Augment>*>& nodes);
+    static AVLNode<Key, Value, Augment>* linkBalanced(AVLNode<Key, Value, Augment>* const* nodes, std::size_t n, int& h);
+
+    // a batch of at least 1/kRebuildFraction of the tree is merged in one
+    // O(n + m) pass over all nodes instead of top down
+    static const std::size_t kRebuildFraction = 4;
 };
 
+/**
+* Default constructor, creates an empty tree.
+*/
+template<class Key, class Value, class Augment, class Compare>
+AVLTree<Key, Value, Augment, Compare>::AVLTree()
+{
+
+}
+
+/**
+* Builds the tree from the key/value pairs in [first, last). See assign().
+*/
+template<class Key, class Value, class Augment, class Compare>
+template<typename ForwardIt>
+AVLTree<Key, Value, Augment, Compare>::AVLTree(ForwardIt first, ForwardIt last)
+{
+    assign(first, last);
+}
+
+/**
+* Replaces the contents of the tree with the key/value pairs in
+* [first, last). When the range is sorted by key (duplicates allowed, the
+* last one wins like repeated inserts would) the tree is built bottom up
+* in O(n) with no rotations. An unsorted range falls back to inserting
+* one pair at a time.
+*/
+template<class Key, class Value, class Augment, class Compare>
+template<typename ForwardIt>
+void AVLTree<Key, Value, Augment, Compare>::assign(ForwardIt first, ForwardIt last)
+{
+    this->clear();
+    //walk the range once to check the order and count the distinct keys
+    std::size_t distinct = 0;
+    bool sorted = true;
+    ForwardIt prev = first;
+    for(ForwardIt it = first; it != last; ++it){
+      if(it == first || KeyOrder<Compare>::less(prev->first, it->first)){
+        distinct++;
+      }
+      else if(KeyOrder<Compare>::less(it->first, prev->first)){
+        sorted = false;
+        break;
+      }
+      prev = it;
+    }
+    if(!sorted){
+      for(ForwardIt it = first; it != last; ++it){
+        this->insert(*it);
+      }
+      return;
+    }
+    this->reserve(distinct);
+    int height = 0;
+    this->root_ = buildBalanced(first, last, distinct, nullptr, height);
+    this->rethread();
+}
+
+/**
+* Builds a perfectly balanced subtree out of the next n distinct keys
+* starting at it (duplicates up to last are skipped), and advances it past them. Nodes are allocated in key
+* order, height is set to the height of the new subtree.
+*/
+template<class Key, class Value, class Augment, class Compare>
+template<typename ForwardIt>
+AVLNode<Key, Value, Augment>* AVLTree<Key, Value, Augment, Compare>::buildBalanced(ForwardIt& it, ForwardIt last, std::size_t n, AVLNode<Key, Value, Augment>* parent, int& height)
+{
+    if(n == 0){
+      height = 0;
+      return nullptr;
+    }
+    //the right side gets the extra node, so balances are only ever 0 or +1
+    std::size_t nleft = (n - 1) / 2;
+    int lheight = 0;
+    int rheight = 0;
+    AVLNode<Key, Value, Augment>* left = buildBalanced(it, last, nleft, nullptr, lheight);
+    //skip over duplicates, keeping the last one
+    ForwardIt cur = it;
+    ++it;
+    while(it != last && !KeyOrder<Compare>::less(cur->first, it->first)){
+      cur = it;
+      ++it;
+    }
+    AVLNode<Key, Value, Augment>* node = this->allocateNode(cur->first, cur->second, parent);
+    node->setLeft(left);
+    if(left != nullptr){
+      left->setParent(node);
+    }
+    AVLNode<Key, Value, Augment>* right = buildBalanced(it, last, n - 1 - nleft, node, rheight);
+    node->setRight(right);
+    node->setBalance(static_cast<int8_t>(rheight - lheight));
+    Augment::update(node);
+    height = std::max(lheight, rheight) + 1;
+    return node;
+}
+
 //if it is the left child helper function 
-template<class Key, class Value>
-bool AVLTree<Key,Value>::isleftChild(AVLNode<Key,Value>* node){
+template<class Key, class Value, class Augment, class Compare>
+bool AVLTree<Key, Value, Augment, Compare>::isleftChild(AVLNode<Key, Value, Augment>* node){
   if(node->getParent()!=nullptr){
     return node == node->getParent()->getLeft();
   }
@@ -160,12 +562,12 @@ bool AVLTree<Key,Value>::isleftChild(AVLNode<Key,Value>* node){
 }
 
 //helper function1 : right rotate 
-template<class Key, class Value>
-void AVLTree<Key,Value>::rightRotate(AVLNode<Key,Value>* x)
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::rightRotate(AVLNode<Key, Value, Augment>* x)
 {
     //only need to delare three because those are the only three that will change in a rotation 
-    AVLNode<Key,Value>* a = x->getLeft();
-    AVLNode<Key,Value>* c = a->getRight();
+    AVLNode<Key, Value, Augment>* a = x->getLeft();
+    AVLNode<Key, Value, Augment>* c = a->getRight();
     //when node is not the root
     if(x == this->root_){
       this->root_ = a;
@@ -179,7 +581,7 @@ void AVLTree<Key,Value>::rightRotate(AVLNode<Key,Value>* x)
     }
     //when it is the root of the entire tree, just rotate 
     else{
-      AVLNode<Key,Value>* p = x->getParent();
+      AVLNode<Key, Value, Augment>* p = x->getParent();
       //when the rotating node is the left sub tree of the parent 
       a->setParent(p);
       a->setRight(x);
@@ -196,17 +598,20 @@ void AVLTree<Key,Value>::rightRotate(AVLNode<Key,Value>* x)
       }
       x->setLeft(c);
     }
+    //x is now below a, so it has to be updated first
+    Augment::update(x);
+    Augment::update(a);
 }
 
 
 
 //helper function:2 leftrotate 
-template<class Key, class Value>
-void AVLTree<Key,Value>::leftRotate(AVLNode<Key,Value>* x)
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::leftRotate(AVLNode<Key, Value, Augment>* x)
 {
   //only need three node because those are the three that are actually changing 
-  AVLNode<Key,Value>* y = x->getRight();
-  AVLNode<Key,Value>* b = y->getLeft();
+  AVLNode<Key, Value, Augment>* y = x->getRight();
+  AVLNode<Key, Value, Augment>* b = y->getLeft();
   //when the node, which is the one that needs to be rotated is not the root of the 
   if(x==this->root_){
     this->root_ = y;
@@ -220,7 +625,7 @@ void AVLTree<Key,Value>::leftRotate(AVLNode<Key,Value>* x)
   }
   //when it is the root of the tree, then it is easier, simply just rotate 
   else{
-    AVLNode<Key,Value>* p = x->getParent();
+    AVLNode<Key, Value, Augment>* p = x->getParent();
     //depends on the node x is a right subtree or a left one 
     //set parent for y as left or right child 
     y->setParent(p);
@@ -235,25 +640,29 @@ void AVLTree<Key,Value>::leftRotate(AVLNode<Key,Value>* x)
     //when done putting y in the position, set x, and b in the right position 
     x->setParent(y);
     //check if b is a nullptr because sometimes b doesn't exist 
+    x->setRight(b);
     if(b!=nullptr){
-      x->setRight(b);
+      b->setParent(x);
     }
   }
+  //x is now below y, so it has to be updated first
+  Augment::update(x);
+  Augment::update(y);
 }
 //zig zig case 
-template<class Key, class Value>
-bool AVLTree<Key, Value>::isZigzig(AVLNode<Key, Value>* g, AVLNode<Key, Value>* p, AVLNode<Key, Value>* n){
+template<class Key, class Value, class Augment, class Compare>
+bool AVLTree<Key, Value, Augment, Compare>::isZigzig(AVLNode<Key, Value, Augment>* g, AVLNode<Key, Value, Augment>* p, AVLNode<Key, Value, Augment>* n){
     return this->isleftChild(p) == this->isleftChild(n);
 }
 //zig zag case
-template<class Key, class Value>
-bool AVLTree<Key, Value>::isZigzag(AVLNode<Key, Value>* g, AVLNode<Key, Value>* p, AVLNode<Key, Value>* n){
+template<class Key, class Value, class Augment, class Compare>
+bool AVLTree<Key, Value, Augment, Compare>::isZigzag(AVLNode<Key, Value, Augment>* g, AVLNode<Key, Value, Augment>* p, AVLNode<Key, Value, Augment>* n){
     return this->isleftChild(p) != this->isleftChild(n);
 }
 
 //helper function3: insert-fix 
-template<class Key, class Value>
-void AVLTree<Key,Value>::insertFix(AVLNode<Key,Value>* p, AVLNode<Key,Value>* n)
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::insertFix(AVLNode<Key, Value, Augment>* p, AVLNode<Key, Value, Augment>* n)
 {
   //according to the pdf, if p = nullptr, simply return 
   if(this->empty()){
@@ -263,7 +672,7 @@ void AVLTree<Key,Value>::insertFix(AVLNode<Key,Value>* p, AVLNode<Key,Value>* n)
   if(p==nullptr || p->getParent()==nullptr){
     return;
   }
-  AVLNode<Key, Value>* g = static_cast<AVLNode<Key,Value>*>(p->getParent()); 
+  AVLNode<Key, Value, Augment>* g = p->getParent(); 
   //assume p is. left child of g 
   if(p == g->getLeft())
   {
@@ -364,15 +773,15 @@ void AVLTree<Key,Value>::insertFix(AVLNode<Key,Value>* p, AVLNode<Key,Value>* n)
 
 
 //helper function 4: REMOVEFIX
-template<class Key, class Value>
-void AVLTree<Key,Value>::removeFix (AVLNode<Key, Value>* n, int diff)
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::removeFix (AVLNode<Key, Value, Augment>* n, int diff)
 {
   if(n==nullptr){
     return;
   }
   int ndiff = -1;
   //p = parent(n) and if p is not NULL let ndiff (nextdiff) = +1 if n is a left child and -1 otherwise
-  AVLNode<Key,Value>* p = n->getParent();
+  AVLNode<Key, Value, Augment>* p = n->getParent();
   if(p!=nullptr){
     if(p->getLeft()==n){
       ndiff = 1;
@@ -386,7 +795,7 @@ void AVLTree<Key,Value>::removeFix (AVLNode<Key, Value>* n, int diff)
     //case 1: b(n) + diff = -2, perform the mirroring 
     if(n->getBalance()+diff == -2){
       //Let c = left(n), the taller of the children
-      AVLNode<Key,Value>* c = n->getLeft();
+      AVLNode<Key, Value, Augment>* c = n->getLeft();
       //case 1a: Case 1a: b(c) == -1 -> rotateRight(n), b(n) = b(c) = 0, removeFix(p, ndiff)
       if(c->getBalance()==-1){
         rightRotate(n);
@@ -403,7 +812,7 @@ void AVLTree<Key,Value>::removeFix (AVLNode<Key, Value>* n, int diff)
       //case 1c: Case 1c: b(c) == +1
       //Let g = right(c) rotateLeft(c) then rotateRight(n)
       else if(c->getBalance()==1){
-        AVLNode<Key,Value>*g = c->getRight();
+        AVLNode<Key, Value, Augment>*g = c->getRight();
         c->setRight(g);
         g->setParent(c);
         leftRotate(c);
@@ -441,7 +850,7 @@ void AVLTree<Key,Value>::removeFix (AVLNode<Key, Value>* n, int diff)
   else if(diff == 1){
     if(n->getBalance()+diff == 2){
       //Let c = left(n), the taller of the children
-      AVLNode<Key,Value>* c = n->getRight();
+      AVLNode<Key, Value, Augment>* c = n->getRight();
       //case 1a: Case 1a: b(c) == -1 -> rotateRight(n), b(n) = b(c) = 0, removeFix(p, ndiff)
       if(c->getBalance()==1){
         leftRotate(n);
@@ -458,7 +867,7 @@ void AVLTree<Key,Value>::removeFix (AVLNode<Key, Value>* n, int diff)
       //case 1c: Case 1c: b(c) == +1
       //Let g = right(c) rotateLeft(c) then rotateRight(n)
       else if(c->getBalance()==-1){
-        AVLNode<Key,Value>*g = c->getLeft();
+        AVLNode<Key, Value, Augment>*g = c->getLeft();
         c->setLeft(g);
         g->setParent(c);
         rightRotate(c);
@@ -474,7 +883,7 @@ void AVLTree<Key,Value>::removeFix (AVLNode<Key, Value>* n, int diff)
           c->setBalance(0);
           g->setBalance(0);
         }
-        else if(g->getBalance()==-1){
+        else if(g->getBalance()==1){
           n->setBalance(-1);
           c->setBalance(0);
           g->setBalance(0);
@@ -496,78 +905,34 @@ void AVLTree<Key,Value>::removeFix (AVLNode<Key, Value>* n, int diff)
 
 
 /*
- * Recall: If key is already in the tree, you should 
- * overwrite the current value with the updated value.
+ * Inserting is done by BinarySearchTree (one descent, a node is only
+ * allocated when the key is new); this is called once the new leaf n has
+ * been linked in and restores the balance on the way up.
  */
-// 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
-{
-    //if it is an empty tree, when set the insert node as the root, b(n)=0, done!
-    AVLNode<Key,Value> *newnode = new AVLNode<Key,Value>(new_item.first,new_item.second,nullptr);
-    AVLNode<Key,Value> *current = static_cast<AVLNode<Key,Value>*>(this->root_);
-    bool b = true;
-    if(this->empty()){
-      this->root_ = newnode;
-      newnode->setBalance(0);
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::afterInsert (AVLNode<Key, Value, Augment>* n)
+{
+    //every subtree on the way up gained n, the rotations below keep this right
+    updatePath(n);
+    //if it is the root, b(n)=0, done!
+    AVLNode<Key, Value, Augment>* p = n->getParent();
+    if(p==nullptr){
       return;
     }
+    //p already had a child on the other side, so its height did not change
+    if(p->getBalance()==-1 || p->getBalance()==1){
+      p->setBalance(0);
+    }
+    //p was a leaf, it grew on n's side
     else{
-    //walk the tree and check balance 
-      while(b){
-        if(current->getKey() > new_item.first){
-        //case 1: if there is no left sub tree, then the newnode become the left child of the root node
-        //and don't forget to set the parent of the new node as the root 
-          if(current->getLeft()==nullptr){
-            current->setLeft(newnode);
-            newnode->setParent(current);
-            b = false;
-            newnode->setBalance(0);
-            AVLNode<Key,Value>* p = newnode->getParent();
-            if(p!=nullptr){
-              if(p->getBalance()==-1 || p->getBalance()==1){
-                p->setBalance(0);
-              }
-              else if(p->getBalance()==0){
-                p->setBalance(-1);
-                insertFix(p,newnode);
-              }
-            }
-          }
-          //let the root be the left child of the root, keep looping, keep comparing until there is no left node anymore
-          else{
-            current = current->getLeft();
-          }
-        }
-        else if(current->getKey() < new_item.first){
-          if(current->getRight()==nullptr){
-            current->setRight(newnode);
-            newnode->setParent(current);
-            //when loop stop
-            b = false;
-            newnode->setBalance(0);
-            AVLNode<Key,Value>* p = newnode->getParent();
-            if(p!=nullptr){
-              if(p->getBalance()==-1 || p->getBalance()==1){
-                p->setBalance(0);
-              }
-              else if(p->getBalance()==0){
-                p->setBalance(1);
-                insertFix(p,newnode);
-              }
-            }
-          } 
-          else{
-            current = current->getRight();
-          }
-        }
-        if(current->getKey() == new_item.first){
-          current->setValue(new_item.second);
-          delete newnode;
-          return;
-        }
+      if(isleftChild(n)){
+        p->setBalance(-1);
       }
-  }
+      else{
+        p->setBalance(1);
+      }
+      insertFix(p,n);
+    }
 }
 
 
@@ -576,137 +941,1120 @@ void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
  * should swap with the predecessor and then remove.
  */
 
-template<class Key, class Value>
-void AVLTree<Key, Value>:: remove(const Key& key)
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>:: remove(const Key& key)
 {
   //step 1: find node n, to remove by walking the tree, similar to bst 
-  AVLNode<Key, Value>* n = static_cast<AVLNode<Key,Value>*>(this->find(key).current_);
-  AVLNode<Key,Value>* p = n->getParent();
-  int diff = 0;
-  //bool b = true;
+  AVLNode<Key, Value, Augment>* n = this->internalFind(key);
   if(n == nullptr){
     return;
   }
-  //when n is not a nullptr
+  //step 2:if n has two children, swap position with the in order
+  //predecessor, after that n has at most one (left) child
+  if(n->getLeft()!=nullptr && n->getRight()!=nullptr){
+    AVLNode<Key, Value, Augment>* pred = this->predecessor(n);
+    nodeSwap(n,pred);
+  }
+  //step 3: promote n's only child (if any) into its place
+  AVLNode<Key, Value, Augment>* child = n->getLeft();
+  if(child==nullptr){
+    child = n->getRight();
+  }
+  AVLNode<Key, Value, Augment>* p = n->getParent();
+  //diff is how the balance of p changes: +1 when its left side shrinks
+  int diff = 0;
+  if(p==nullptr){
+    this->root_ = child;
+  }
+  else if(isleftChild(n)){
+    p->setLeft(child);
+    diff = 1;
+  }
   else{
-    diff = 0;
-    if(this->isleftChild(n)){
-      diff = 1;
+    p->setRight(child);
+    diff = -1;
+  }
+  if(child!=nullptr){
+    child->setParent(p);
+  }
+  this->freeNode(n);
+  //step 4: patch the tree back up
+  updatePath(p);
+  removeFix(p, diff);
+}
+
+
+/**
+* A value changed in place, so every summary above it may be stale.
+*/
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::afterAssign(AVLNode<Key, Value, Augment>* node)
+{
+    updatePath(node);
+}
+
+/**
+* Recomputes the augmentation of node and all of its ancestors. Does
+* nothing for trees without an augmentation.
+*/
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::updatePath(AVLNode<Key, Value, Augment>* node)
+{
+    if(!Augment::enabled){
+      return;
     }
-    else{
-      diff = -1;
+    while(node != nullptr){
+      Augment::update(node);
+      node = node->getParent();
     }
-  }
-  //declare a successor for the future use: 
-  //step 2:if n has two children, if so swap position with 
-  //in order successor and perform the next step 
-  //2 children case 
-  if(n->getLeft()!=nullptr && n->getRight()!=nullptr){
-    AVLNode<Key,Value>* pred = static_cast<AVLNode<Key,Value>*>(this->predecessor(n));
-    nodeSwap(n,pred);
-    //n->setParent(p);
-    p = n->getParent();
-    if(p!=nullptr){
-      diff = 0;
-      if(isleftChild(n)){
-        diff = 1;
+}
+
+/**
+* Returns an iterator to the k-th smallest item (counting from 0), or end()
+* if the tree has k items or fewer. O(log n).
+*/
+template<class Key, class Value, class Augment, class Compare>
+typename AVLTree<Key, Value, Augment, Compare>::iterator
+AVLTree<Key, Value, Augment, Compare>::select(std::size_t k) const
+{
+    AVLNode<Key, Value, Augment>* now = this->root_;
+    while(now != nullptr){
+      std::size_t leftSize = Augment::size(now->getLeft());
+      if(k < leftSize){
+        now = now->getLeft();
+      }
+      else if(k == leftSize){
+        break;
       }
       else{
-        diff = -1;
+        k -= leftSize + 1;
+        now = now->getRight();
       }
     }
-    //if n has a left child 
-    if(n->getLeft()!=nullptr){
-      if(isleftChild(n)){
-        p->setLeft(n->getLeft());
+    return this->makeIterator(now);
+}
+
+/**
+* Returns the number of keys in the tree that are smaller than key. O(log n).
+*/
+template<class Key, class Value, class Augment, class Compare>
+std::size_t AVLTree<Key, Value, Augment, Compare>::rank(const Key& key) const
+{
+    std::size_t smaller = 0;
+    AVLNode<Key, Value, Augment>* now = this->root_;
+    while(now != nullptr){
+      if(KeyOrder<Compare>::less(now->getKey(), key)){
+        smaller += Augment::size(now->getLeft()) + 1;
+        now = now->getRight();
       }
       else{
-        p->setRight(n->getLeft());
+        now = now->getLeft();
       }
-      n->getLeft()->setParent(p);
-      //delete n and update pointer 
-      delete n;
-      //call removefix to patch the tree 
-      removeFix(p, diff);
+    }
+    return smaller;
+}
+
+/**
+* Returns the number of keys k with lo <= k < hi. O(log n).
+*/
+template<class Key, class Value, class Augment, class Compare>
+std::size_t AVLTree<Key, Value, Augment, Compare>::count_range(const Key& lo, const Key& hi) const
+{
+    if(!KeyOrder<Compare>::less(lo, hi)){
+      return 0;
+    }
+    return rank(hi) - rank(lo);
+}
+
+/**
+* A read-only copy of the tree laid out for fast lookups (see
+* FrozenAVLTree). O(n); later changes to this tree do not show up in it.
+*/
+template<class Key, class Value, class Augment, class Compare>
+FrozenAVLTree<Key, Value, Compare> AVLTree<Key, Value, Augment, Compare>::freeze() const
+{
+    return FrozenAVLTree<Key, Value, Compare>(this->begin(), this->end());
+}
+
+/**
+* Combines the values of every key k with lo <= k < hi, in key order, and
+* returns the identity if there are none. One descent to the node where
+* the range splits, then one path down each side of it, using the
+* subtree aggregates of everything in between: O(log n).
+*/
+template<class Key, class Value, class Augment, class Compare>
+template<typename A>
+typename A::Result AVLTree<Key, Value, Augment, Compare>::aggregate(const Key& lo, const Key& hi) const
+{
+    typename A::Result left = A::identity();
+    typename A::Result right = A::identity();
+    AVLNode<Key, Value, Augment>* top = this->root_;
+    if(!KeyOrder<Compare>::less(lo, hi)){
+      return left;
+    }
+    //find the highest node inside the range
+    while(top != nullptr){
+      if(KeyOrder<Compare>::less(top->getKey(), lo)){
+        top = top->getRight();
+      }
+      else if(!KeyOrder<Compare>::less(top->getKey(), hi)){
+        top = top->getLeft();
+      }
+      else{
+        break;
+      }
+    }
+    if(top == nullptr){
+      return left;
+    }
+    //left of top everything is < hi; collect what is >= lo, right to left
+    for(AVLNode<Key, Value, Augment>* now = top->getLeft(); now != nullptr; ){
+      if(KeyOrder<Compare>::less(now->getKey(), lo)){
+        now = now->getRight();
+      }
+      else{
+        left = A::combine(A::combine(typename A::Result(now->getValue()), A::aggregate(now->getRight())), left);
+        now = now->getLeft();
+      }
+    }
+    //right of top everything is >= lo; collect what is < hi, left to right
+    for(AVLNode<Key, Value, Augment>* now = top->getRight(); now != nullptr; ){
+      if(KeyOrder<Compare>::less(now->getKey(), hi)){
+        right = A::combine(right, A::combine(A::aggregate(now->getLeft()), typename A::Result(now->getValue())));
+        now = now->getRight();
+      }
+      else{
+        now = now->getLeft();
+      }
+    }
+    return A::combine(A::combine(left, typename A::Result(top->getValue())), right);
+}
+
+/**
+* Replaces the value under key, or throws std::out_of_range if the key is
+* not there, and brings the augmentation of its ancestors up to date.
+* Values written through iterators, operator[] or at() are not seen by
+* the augmentation; with an Aggregate policy, change values through
+* setValue(), insert() or upsert().
+*/
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::setValue(const Key& key, const Value& value)
+{
+    AVLNode<Key, Value, Augment>* node = this->internalFind(key);
+    if(node == nullptr){
+      throw std::out_of_range("Invalid key");
+    }
+    node->setValue(value);
+    updatePath(node);
+}
+
+/**
+* Removes every key k with lo <= k < hi and returns how many were removed.
+* The range is cut out with two splits and the outer parts are joined
+* back together, so the tree is rebalanced once, in O(log n), rather than
+* once per key. Freeing the k detached nodes is a plain O(k) walk.
+*/
+template<class Key, class Value, class Augment, class Compare>
+std::size_t AVLTree<Key, Value, Augment, Compare>::erase_range(const Key& lo, const Key& hi)
+{
+    if(!KeyOrder<Compare>::less(lo, hi) || this->empty()){
+      return 0;
+    }
+    AVLNode<Key, Value, Augment>* left = nullptr;
+    AVLNode<Key, Value, Augment>* rest = nullptr;
+    AVLNode<Key, Value, Augment>* middle = nullptr;
+    AVLNode<Key, Value, Augment>* right = nullptr;
+    int hleft = 0, hrest = 0, hmiddle = 0, hright = 0, h = 0;
+    splitAt(this->root_, subtreeHeight(this->root_), lo, left, hleft, rest, hrest);
+    splitAt(rest, hrest, hi, middle, hmiddle, right, hright);
+    this->root_ = joinTrees(left, hleft, right, hright, h);
+    return this->freeSubtree(middle);
+}
+
+/**
+* Moves every key >= key into a new tree, which is returned; this tree
+* keeps the keys < key. O(log n). Both trees share one node pool
+* afterwards. Their sizes stay O(1) with the OrderStatistics policy;
+* otherwise each is recounted the first time size() is called.
+*/
+template<class Key, class Value, class Augment, class Compare>
+AVLTree<Key, Value, Augment, Compare> AVLTree<Key, Value, Augment, Compare>::split(const Key& key)
+{
+    AVLTree<Key, Value, Augment, Compare> right;
+    this->sharePoolWith(right);
+    AVLNode<Key, Value, Augment>* l = nullptr;
+    AVLNode<Key, Value, Augment>* r = nullptr;
+    int hl = 0, hr = 0;
+    splitAt(this->root_, subtreeHeight(this->root_), key, l, hl, r, hr);
+    this->root_ = l;
+    right.root_ = r;
+    //the largest node, if cached, went with the upper half
+    if(r != nullptr){
+      right.rightmost_ = this->rightmost_;
+      this->rightmost_ = nullptr;
+    }
+    if constexpr(HasThreads<AVLNode<Key, Value, Augment> >::value){
+      //cut the thread between the two halves
+      AVLNode<Key, Value, Augment>* first = right.getSmallestNode();
+      if(first != nullptr && first->getPrev() != nullptr){
+        first->getPrev()->setNext(nullptr);
+        first->setPrev(nullptr);
+      }
+    }
+    if(r == nullptr){
+      right.size_ = 0;
+    }
+    else if(l == nullptr){
+      right.size_ = this->size_;
+      this->size_ = 0;
+    }
+    else{
+      this->size_ = knownSize<Augment>(l, 0);
+      right.size_ = knownSize<Augment>(r, 0);
+    }
+    return right;
+}
+
+/**
+* Concatenates two trees, where every key of left must be smaller than
+* every key of right (throws std::invalid_argument otherwise). Returns the
+* joined tree and leaves left and right empty. O(log n): the two roots are
+* joined around the largest node of left, and the nodes stay where they
+* are, with left's and right's pools merged into one.
+*/
+template<class Key, class Value, class Augment, class Compare>
+AVLTree<Key, Value, Augment, Compare> AVLTree<Key, Value, Augment, Compare>::join(AVLTree& left, AVLTree& right)
+{
+    if(!left.empty() && !right.empty()){
+      AVLNode<Key, Value, Augment>* maxLeft = left.root_;
+      while(maxLeft->getRight() != nullptr){
+        maxLeft = maxLeft->getRight();
+      }
+      AVLNode<Key, Value, Augment>* minRight = right.getSmallestNode();
+      if(!KeyOrder<Compare>::less(maxLeft->getKey(), minRight->getKey())){
+        throw std::invalid_argument("join: key ranges overlap");
+      }
+      if constexpr(HasThreads<AVLNode<Key, Value, Augment> >::value){
+        maxLeft->setNext(minRight);
+        minRight->setPrev(maxLeft);
+      }
+    }
+    AVLTree<Key, Value, Augment, Compare> joined;
+    joined.sharePoolWith(left);
+    joined.sharePoolWith(right);
+    int h = 0;
+    joined.root_ = joinTrees(left.root_, subtreeHeight(left.root_), right.root_, subtreeHeight(right.root_), h);
+    if(left.size_ != joined.unknownSize && right.size_ != joined.unknownSize){
+      joined.size_ = left.size_ + right.size_;
+    }
+    else{
+      joined.size_ = knownSize<Augment>(joined.root_, 0);
+    }
+    left.root_ = nullptr;
+    left.size_ = 0;
+    left.rightmost_ = nullptr;
+    left.resetPool();
+    right.root_ = nullptr;
+    right.size_ = 0;
+    right.rightmost_ = nullptr;
+    right.resetPool();
+    return joined;
+}
+
+/**
+* Merges other into this tree; keys found in both take other's value, as
+* insert() would. other is left empty. Its nodes are moved over rather than
+* copied, so the work is O(m log(n/m + 1)) for trees of sizes m <= n, and
+* independent halves run on separate threads.
+*/
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::union_with(AVLTree& other)
+{
+    if(&other == this || other.empty()){
+      return;
+    }
+    this->sharePoolWith(other);
+    std::size_t total = this->unknownSize;
+    if(this->size_ != this->unknownSize && other.size_ != this->unknownSize){
+      total = this->size_ + other.size_;
+    }
+    std::vector<AVLNode<Key, Value, Augment>*> discarded;
+    int h = 0;
+    this->root_ = unionNodes(this->root_, subtreeHeight(this->root_), other.root_, subtreeHeight(other.root_),
+                             h, discarded, forkBudget());
+    this->root_->setParent(nullptr);
+    other.root_ = nullptr;
+    other.size_ = 0;
+    other.rightmost_ = nullptr;
+    other.resetPool();
+    this->size_ = total;
+    this->rightmost_ = nullptr;
+    freeDiscarded(discarded);
+    //the two threads interleave, so they are rebuilt in one pass
+    this->rethread();
+}
+
+/**
+* Keeps only the keys that are also in other, with this tree's values.
+* other is not modified. O(m log(n/m + 1)), run in parallel like
+* union_with().
+*/
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::intersect_with(const AVLTree& other)
+{
+    if(&other == this){
       return;
     }
-    //when n->getLeft is a nullptr, so no left child, this case we can just delete and call removefix 
+    std::vector<AVLNode<Key, Value, Augment>*> discarded;
+    int h = 0;
+    this->root_ = intersectNodes(this->root_, subtreeHeight(this->root_), other.root_, subtreeHeight(other.root_),
+                                 h, discarded, forkBudget());
+    if(this->root_ != nullptr){
+      this->root_->setParent(nullptr);
+    }
+    freeDiscarded(discarded);
+}
+
+/**
+* Removes every key that is also in other. other is not modified.
+* O(m log(n/m + 1)), run in parallel like union_with().
+*/
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::difference_with(const AVLTree& other)
+{
+    if(&other == this){
+      this->clear();
+      return;
+    }
+    std::vector<AVLNode<Key, Value, Augment>*> discarded;
+    int h = 0;
+    this->root_ = differenceNodes(this->root_, subtreeHeight(this->root_), other.root_, subtreeHeight(other.root_),
+                                  h, discarded, forkBudget());
+    if(this->root_ != nullptr){
+      this->root_->setParent(nullptr);
+    }
+    freeDiscarded(discarded);
+}
+
+/**
+* Union of two detached subtrees: t2's root splits t1, the halves are
+* merged recursively (the left one on another thread if both are big
+* enough), and t2's root joins them back together. The t1 node with the
+* same key, if any, is discarded.
+*/
+template<class Key, class Value, class Augment, class Compare>
+AVLNode<Key, Value, Augment>* AVLTree<Key, Value, Augment, Compare>::unionNodes(AVLNode<Key, Value, Augment>* t1, int h1,
+                                                                       AVLNode<Key, Value, Augment>* t2, int h2, int& h,
+                                                                       std::vector<AVLNode<Key, Value, Augment>*>& discarded, unsigned forks)
+{
+    if(t1 == nullptr){
+      h = h2;
+      return t2;
+    }
+    if(t2 == nullptr){
+      h = h1;
+      return t1;
+    }
+    AVLNode<Key, Value, Augment>* a = t2->getLeft();
+    AVLNode<Key, Value, Augment>* c = t2->getRight();
+    int ha = t2->getBalance() > 0 ? h2 - 2 : h2 - 1;
+    int hc = t2->getBalance() < 0 ? h2 - 2 : h2 - 1;
+    AVLNode<Key, Value, Augment>* l1 = nullptr;
+    AVLNode<Key, Value, Augment>* found = nullptr;
+    AVLNode<Key, Value, Augment>* r1 = nullptr;
+    int hl1 = 0, hr1 = 0;
+    splitFind(t1, h1, t2->getKey(), l1, hl1, found, r1, hr1);
+    if(found != nullptr){
+      discarded.push_back(found);
+    }
+    AVLNode<Key, Value, Augment>* l = nullptr;
+    AVLNode<Key, Value, Augment>* r = nullptr;
+    int hl = 0, hr = 0;
+    if(forks > 1 && std::min(h1, h2) >= kParallelCutoffHeight){
+      std::vector<AVLNode<Key, Value, Augment>*> leftDiscarded;
+      std::future<AVLNode<Key, Value, Augment>*> left =
+        std::async(std::launch::async, &AVLTree::unionNodes, l1, hl1, a, ha, std::ref(hl), std::ref(leftDiscarded), forks / 2);
+      r = unionNodes(r1, hr1, c, hc, hr, discarded, forks - forks / 2);
+      l = left.get();
+      discarded.insert(discarded.end(), leftDiscarded.begin(), leftDiscarded.end());
+    }
     else{
-      //same logic 
-      if(isleftChild(n)){
-        p->setLeft(nullptr);
-        delete n;
-        removeFix(p, diff);
-        return;
+      l = unionNodes(l1, hl1, a, ha, hl, discarded, 1);
+      r = unionNodes(r1, hr1, c, hc, hr, discarded, 1);
+    }
+    return joinNode(l, hl, t2, r, hr, h);
+}
+
+/**
+* Intersection of a detached subtree t1 with a subtree t2 that is only
+* read. Parts of t1 that fall next to an empty part of t2 are discarded
+* whole.
+*/
+template<class Key, class Value, class Augment, class Compare>
+AVLNode<Key, Value, Augment>* AVLTree<Key, Value, Augment, Compare>::intersectNodes(AVLNode<Key, Value, Augment>* t1, int h1,
+                                                                           const AVLNode<Key, Value, Augment>* t2, int h2, int& h,
+                                                                           std::vector<AVLNode<Key, Value, Augment>*>& discarded, unsigned forks)
+{
+    if(t1 == nullptr){
+      h = 0;
+      return nullptr;
+    }
+    if(t2 == nullptr){
+      discarded.push_back(t1);
+      h = 0;
+      return nullptr;
+    }
+    const AVLNode<Key, Value, Augment>* a = t2->getLeft();
+    const AVLNode<Key, Value, Augment>* c = t2->getRight();
+    int ha = t2->getBalance() > 0 ? h2 - 2 : h2 - 1;
+    int hc = t2->getBalance() < 0 ? h2 - 2 : h2 - 1;
+    AVLNode<Key, Value, Augment>* l1 = nullptr;
+    AVLNode<Key, Value, Augment>* found = nullptr;
+    AVLNode<Key, Value, Augment>* r1 = nullptr;
+    int hl1 = 0, hr1 = 0;
+    splitFind(t1, h1, t2->getKey(), l1, hl1, found, r1, hr1);
+    AVLNode<Key, Value, Augment>* l = nullptr;
+    AVLNode<Key, Value, Augment>* r = nullptr;
+    int hl = 0, hr = 0;
+    if(forks > 1 && std::min(h1, h2) >= kParallelCutoffHeight){
+      std::vector<AVLNode<Key, Value, Augment>*> leftDiscarded;
+      std::future<AVLNode<Key, Value, Augment>*> left =
+        std::async(std::launch::async, &AVLTree::intersectNodes, l1, hl1, a, ha, std::ref(hl), std::ref(leftDiscarded), forks / 2);
+      r = intersectNodes(r1, hr1, c, hc, hr, discarded, forks - forks / 2);
+      l = left.get();
+      discarded.insert(discarded.end(), leftDiscarded.begin(), leftDiscarded.end());
+    }
+    else{
+      l = intersectNodes(l1, hl1, a, ha, hl, discarded, 1);
+      r = intersectNodes(r1, hr1, c, hc, hr, discarded, 1);
+    }
+    if(found != nullptr){
+      return joinNode(l, hl, found, r, hr, h);
+    }
+    return joinTrees(l, hl, r, hr, h);
+}
+
+/**
+* Difference of a detached subtree t1 and a subtree t2 that is only read.
+*/
+template<class Key, class Value, class Augment, class Compare>
+AVLNode<Key, Value, Augment>* AVLTree<Key, Value, Augment, Compare>::differenceNodes(AVLNode<Key, Value, Augment>* t1, int h1,
+                                                                            const AVLNode<Key, Value, Augment>* t2, int h2, int& h,
+                                                                            std::vector<AVLNode<Key, Value, Augment>*>& discarded, unsigned forks)
+{
+    if(t1 == nullptr){
+      h = 0;
+      return nullptr;
+    }
+    if(t2 == nullptr){
+      h = h1;
+      return t1;
+    }
+    const AVLNode<Key, Value, Augment>* a = t2->getLeft();
+    const AVLNode<Key, Value, Augment>* c = t2->getRight();
+    int ha = t2->getBalance() > 0 ? h2 - 2 : h2 - 1;
+    int hc = t2->getBalance() < 0 ? h2 - 2 : h2 - 1;
+    AVLNode<Key, Value, Augment>* l1 = nullptr;
+    AVLNode<Key, Value, Augment>* found = nullptr;
+    AVLNode<Key, Value, Augment>* r1 = nullptr;
+    int hl1 = 0, hr1 = 0;
+    splitFind(t1, h1, t2->getKey(), l1, hl1, found, r1, hr1);
+    if(found != nullptr){
+      discarded.push_back(found);
+    }
+    AVLNode<Key, Value, Augment>* l = nullptr;
+    AVLNode<Key, Value, Augment>* r = nullptr;
+    int hl = 0, hr = 0;
+    if(forks > 1 && std::min(h1, h2) >= kParallelCutoffHeight){
+      std::vector<AVLNode<Key, Value, Augment>*> leftDiscarded;
+      std::future<AVLNode<Key, Value, Augment>*> left =
+        std::async(std::launch::async, &AVLTree::differenceNodes, l1, hl1, a, ha, std::ref(hl), std::ref(leftDiscarded), forks / 2);
+      r = differenceNodes(r1, hr1, c, hc, hr, discarded, forks - forks / 2);
+      l = left.get();
+      discarded.insert(discarded.end(), leftDiscarded.begin(), leftDiscarded.end());
+    }
+    else{
+      l = differenceNodes(l1, hl1, a, ha, hl, discarded, 1);
+      r = differenceNodes(r1, hr1, c, hc, hr, discarded, 1);
+    }
+    return joinTrees(l, hl, r, hr, h);
+}
+
+/**
+* Inserts every key/value pair in [first, last), overwriting the values of
+* keys already in the tree like insert() does, and returns one flag per
+* pair: true if that pair added a new key. When a key comes up more than
+* once, its first pair reports whether it was new and its last pair
+* supplies the value.
+*
+* The batch is sorted once and merged into the tree top down: every tree
+* node on the way splits the batch with a binary search, so a descent
+* prefix is walked once for all the keys below it, and each subtree that
+* changed is rebalanced once, by a join, on the way back up. That is
+* O(m log(n/m + 1)) for m keys into a tree of n. A batch of a quarter of
+* the tree or more is instead merged with the tree's nodes in one
+* O(n + m) pass and the nodes are relinked into a balanced shape.
+*/
+template<class Key, class Value, class Augment, class Compare>
+template<typename ForwardIt>
+std::vector<bool> AVLTree<Key, Value, Augment, Compare>::insert_batch(ForwardIt first, ForwardIt last)
+{
+    typedef std::pair<ForwardIt, std::size_t> Entry;
+    std::vector<bool> added(std::distance(first, last), false);
+    std::vector<Entry> batch = sortedBatch(first, last, [](ForwardIt it) -> const Key& { return it->first; });
+    if(batch.empty()){
+      return added;
+    }
+    std::size_t n = this->size_;
+    int h = 0;
+    //new nodes are not linked one by one, so the largest is found again later
+    this->rightmost_ = nullptr;
+    if(n == this->unknownSize || batch.size() < n / kRebuildFraction){
+      this->root_ = insertSorted(this->root_, subtreeHeight(this->root_), batch.data(), batch.size(), added, h);
+      this->root_->setParent(nullptr);
+      if constexpr(HasThreads<AVLNode<Key, Value, Augment> >::value){
+        //in key order, so every new node's left neighbour is threaded already
+        for(std::size_t j = 0; j < batch.size(); j++){
+          if(added[batch[j].second]){
+            this->threadNode(this->internalFind(batch[j].first->first));
+          }
+        }
+      }
+      return added;
+    }
+    std::vector<AVLNode<Key, Value, Augment>*> old;
+    old.reserve(n);
+    collectNodes(this->root_, old);
+    std::vector<AVLNode<Key, Value, Augment>*> merged;
+    merged.reserve(n + batch.size());
+    std::size_t i = 0;
+    for(std::size_t j = 0; j < batch.size(); j++){
+      const Key& key = batch[j].first->first;
+      while(i < old.size() && KeyOrder<Compare>::less(old[i]->getKey(), key)){
+        merged.push_back(old[i++]);
+      }
+      if(i < old.size() && !KeyOrder<Compare>::less(key, old[i]->getKey())){
+        old[i]->getValue() = batch[j].first->second;
+        merged.push_back(old[i++]);
       }
       else{
-        p->setRight(nullptr);
-        delete n; 
-        removeFix(p, diff);
-        return;
+        merged.push_back(this->allocateNode(key, batch[j].first->second, nullptr));
+        added[batch[j].second] = true;
       }
     }
-  }
-  //if it has one left child 
-  else if(n->getRight()==nullptr){
-    p = n->getParent();
-    if(n->getParent()!=nullptr){
-      //check if it is left or right child and then change the child by promoting right child 
-      if(isleftChild(n)){
-        n->getParent()->setLeft(n->getLeft());
-        diff = 1;
+    merged.insert(merged.end(), old.begin() + i, old.end());
+    this->root_ = linkBalanced(merged.data(), merged.size(), h);
+    this->rethread();
+    return added;
+}
+
+/**
+* Removes every key in [first, last) and returns one flag per key: true
+* if that key was in the tree (only the first of repeated keys reports
+* it). Works like insert_batch(): the sorted batch is pushed down the
+* tree, nodes that go are dropped where they are found and the remaining
+* pieces are joined back together, O(m log(n/m + 1)), with the same
+* O(n + m) pass for big batches.
+*/
+template<class Key, class Value, class Augment, class Compare>
+template<typename ForwardIt>
+std::vector<bool> AVLTree<Key, Value, Augment, Compare>::erase_batch(ForwardIt first, ForwardIt last)
+{
+    typedef std::pair<ForwardIt, std::size_t> Entry;
+    std::vector<bool> removed(std::distance(first, last), false);
+    std::vector<Entry> batch = sortedBatch(first, last, [](ForwardIt it) -> const Key& { return *it; });
+    if(batch.empty() || this->root_ == nullptr){
+      return removed;
+    }
+    std::size_t n = this->size_;
+    int h = 0;
+    if(n == this->unknownSize || batch.size() < n / kRebuildFraction){
+      this->root_ = eraseSorted(this->root_, subtreeHeight(this->root_), batch.data(), batch.size(), removed, h);
+      if(this->root_ != nullptr){
+        this->root_->setParent(nullptr);
+      }
+      return removed;
+    }
+    std::vector<AVLNode<Key, Value, Augment>*> old;
+    old.reserve(n);
+    collectNodes(this->root_, old);
+    std::vector<AVLNode<Key, Value, Augment>*> kept;
+    kept.reserve(n);
+    std::size_t j = 0;
+    for(std::size_t i = 0; i < old.size(); i++){
+      while(j < batch.size() && KeyOrder<Compare>::less(*batch[j].first, old[i]->getKey())){
+        j++;
+      }
+      if(j < batch.size() && !KeyOrder<Compare>::less(old[i]->getKey(), *batch[j].first)){
+        removed[batch[j].second] = true;
+        this->freeNode(old[i]);
+      }
+      else{
+        kept.push_back(old[i]);
+      }
+    }
+    this->root_ = linkBalanced(kept.data(), kept.size(), h);
+    return removed;
+}
+
+/**
+* Pairs every item in [first, last) with its position, sorts the pairs by
+* keyOf(item) and keeps one per key: the last item, which is the one a
+* loop of single updates would leave behind, at the position of the
+* first.
+*/
+template<class Key, class Value, class Augment, class Compare>
+template<typename ForwardIt, typename KeyOf>
+std::vector<std::pair<ForwardIt, std::size_t> > AVLTree<Key, Value, Augment, Compare>::sortedBatch(ForwardIt first, ForwardIt last, KeyOf keyOf)
+{
+    typedef std::pair<ForwardIt, std::size_t> Entry;
+    std::vector<Entry> batch;
+    std::size_t i = 0;
+    for(ForwardIt it = first; it != last; ++it, ++i){
+      batch.push_back(Entry(it, i));
+    }
+    std::stable_sort(batch.begin(), batch.end(), [&keyOf](const Entry& x, const Entry& y) {
+      return KeyOrder<Compare>::less(keyOf(x.first), keyOf(y.first));
+    });
+    std::size_t out = 0;
+    for(std::size_t j = 0; j < batch.size(); j++){
+      if(out > 0 && !KeyOrder<Compare>::less(keyOf(batch[out - 1].first), keyOf(batch[j].first))){
+        batch[out - 1].first = batch[j].first;
       }
       else{
-        n->getParent()->setRighgt(n->getLeft());
-        diff = -1;
-      }
-      //update parent 
-      n->getLeft()->setParent(n->getParent());
-      //delete node 
-      delete n;
-      //call removefix 
-      removeFix(p,diff);
+        batch[out++] = batch[j];
+      }
+    }
+    batch.resize(out);
+    return batch;
+}
+
+/**
+* Merges the m batch entries into the detached subtree t: t's key splits
+* the batch, each half goes into the matching child, and t joins the two
+* results back together. Subtrees no entry falls into are not touched.
+*/
+template<class Key, class Value, class Augment, class Compare>
+template<typename ForwardIt>
+AVLNode<Key, Value, Augment>* AVLTree<Key, Value, Augment, Compare>::insertSorted(AVLNode<Key, Value, Augment>* t, int ht, const std::pair<ForwardIt, std::size_t>* batch,
+                                                                         std::size_t m, std::vector<bool>& added, int& h)
+{
+    if(m == 0){
+      h = ht;
+      return t;
+    }
+    if(t == nullptr){
+      return buildSorted(batch, m, added, h);
+    }
+    AVLNode<Key, Value, Augment>* a = t->getLeft();
+    AVLNode<Key, Value, Augment>* c = t->getRight();
+    int ha = t->getBalance() > 0 ? ht - 2 : ht - 1;
+    int hc = t->getBalance() < 0 ? ht - 2 : ht - 1;
+    std::size_t nl = std::lower_bound(batch, batch + m, t->getKey(),
+                                      [](const std::pair<ForwardIt, std::size_t>& e, const Key& key) { return KeyOrder<Compare>::less(e.first->first, key); }) - batch;
+    std::size_t skip = 0;
+    if(nl < m && !KeyOrder<Compare>::less(t->getKey(), batch[nl].first->first)){
+      t->getValue() = batch[nl].first->second;
+      skip = 1;
+    }
+    int hl = 0, hr = 0;
+    AVLNode<Key, Value, Augment>* l = insertSorted(a, ha, batch, nl, added, hl);
+    AVLNode<Key, Value, Augment>* r = insertSorted(c, hc, batch + nl + skip, m - nl - skip, added, hr);
+    return joinNode(l, hl, t, r, hr, h);
+}
+
+/**
+* Builds a balanced subtree of new nodes out of m batch entries, allocated
+* in key order like buildBalanced() does.
+*/
+template<class Key, class Value, class Augment, class Compare>
+template<typename ForwardIt>
+AVLNode<Key, Value, Augment>* AVLTree<Key, Value, Augment, Compare>::buildSorted(const std::pair<ForwardIt, std::size_t>* batch, std::size_t m,
+                                                                        std::vector<bool>& added, int& h)
+{
+    if(m == 0){
+      h = 0;
+      return nullptr;
+    }
+    std::size_t nleft = (m - 1) / 2;
+    int hl = 0, hr = 0;
+    AVLNode<Key, Value, Augment>* l = buildSorted(batch, nleft, added, hl);
+    AVLNode<Key, Value, Augment>* node = this->allocateNode(batch[nleft].first->first, batch[nleft].first->second, nullptr);
+    added[batch[nleft].second] = true;
+    AVLNode<Key, Value, Augment>* r = buildSorted(batch + nleft + 1, m - nleft - 1, added, hr);
+    return makeNode(l, hl, node, r, hr, h);
+}
+
+/**
+* Removes the keys of m batch entries from the detached subtree t, the
+* same way insertSorted() adds them.
+*/
+template<class Key, class Value, class Augment, class Compare>
+template<typename ForwardIt>
+AVLNode<Key, Value, Augment>* AVLTree<Key, Value, Augment, Compare>::eraseSorted(AVLNode<Key, Value, Augment>* t, int ht, const std::pair<ForwardIt, std::size_t>* batch,
+                                                                        std::size_t m, std::vector<bool>& removed, int& h)
+{
+    if(t == nullptr || m == 0){
+      h = ht;
+      return t;
+    }
+    AVLNode<Key, Value, Augment>* a = t->getLeft();
+    AVLNode<Key, Value, Augment>* c = t->getRight();
+    int ha = t->getBalance() > 0 ? ht - 2 : ht - 1;
+    int hc = t->getBalance() < 0 ? ht - 2 : ht - 1;
+    std::size_t nl = std::lower_bound(batch, batch + m, t->getKey(),
+                                      [](const std::pair<ForwardIt, std::size_t>& e, const Key& key) { return KeyOrder<Compare>::less(*e.first, key); }) - batch;
+    bool hit = nl < m && !KeyOrder<Compare>::less(t->getKey(), *batch[nl].first);
+    std::size_t skip = hit ? 1 : 0;
+    int hl = 0, hr = 0;
+    AVLNode<Key, Value, Augment>* l = eraseSorted(a, ha, batch, nl, removed, hl);
+    AVLNode<Key, Value, Augment>* r = eraseSorted(c, hc, batch + nl + skip, m - nl - skip, removed, hr);
+    if(hit){
+      removed[batch[nl].second] = true;
+      this->freeNode(t);
+      return joinTrees(l, hl, r, hr, h);
+    }
+    return joinNode(l, hl, t, r, hr, h);
+}
+
+/**
+* Appends the nodes of a subtree to nodes in key order.
+*/
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::collectNodes(AVLNode<Key, Value, Augment>* node, std::vector<AVLNode<Key, Value, Augment>*>& nodes)
+{
+    if(node == nullptr){
       return;
     }
-    //if n is the root
-    else{
-      if(n->getParent()!=nullptr){
-        n->getParent()->setLeft(n->getRight());
+    collectNodes(node->getLeft(), nodes);
+    nodes.push_back(node);
+    collectNodes(node->getRight(), nodes);
+}
+
+/**
+* Relinks n nodes, sorted by key, into a perfectly balanced detached
+* subtree and returns its root; h receives its height. Nothing is
+* allocated or freed.
+*/
+template<class Key, class Value, class Augment, class Compare>
+AVLNode<Key, Value, Augment>* AVLTree<Key, Value, Augment, Compare>::linkBalanced(AVLNode<Key, Value, Augment>* const* nodes, std::size_t n, int& h)
+{
+    if(n == 0){
+      h = 0;
+      return nullptr;
+    }
+    std::size_t nleft = (n - 1) / 2;
+    int hl = 0, hr = 0;
+    AVLNode<Key, Value, Augment>* l = linkBalanced(nodes, nleft, hl);
+    AVLNode<Key, Value, Augment>* r = linkBalanced(nodes + nleft + 1, n - nleft - 1, hr);
+    return makeNode(l, hl, nodes[nleft], r, hr, h);
+}
+
+/**
+* How many threads one set operation may use: one per hardware thread.
+*/
+template<class Key, class Value, class Augment, class Compare>
+unsigned AVLTree<Key, Value, Augment, Compare>::forkBudget()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+/**
+* Frees the subtrees a set operation dropped, on the calling thread.
+*/
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::freeDiscarded(const std::vector<AVLNode<Key, Value, Augment>*>& discarded)
+{
+    for(std::size_t i = 0; i < discarded.size(); i++){
+      this->freeSubtree(discarded[i]);
+    }
+}
+
+template<class Key, class Value, class Augment, class Compare>
+template<typename A>
+auto AVLTree<Key, Value, Augment, Compare>::knownSize(AVLNode<Key, Value, Augment>* node, int) -> decltype(A::size(node))
+{
+    return A::size(node);
+}
+
+template<class Key, class Value, class Augment, class Compare>
+template<typename A>
+std::size_t AVLTree<Key, Value, Augment, Compare>::knownSize(AVLNode<Key, Value, Augment>* node, long)
+{
+    return BinarySearchTree<Key, Value, AVLNode<Key, Value, Augment>, Compare>::unknownSize;
+}
+
+/**
+* Height of a subtree, found by following the taller child down. O(log n).
+*/
+template<class Key, class Value, class Augment, class Compare>
+int AVLTree<Key, Value, Augment, Compare>::subtreeHeight(AVLNode<Key, Value, Augment>* node)
+{
+    int height = 0;
+    while(node != nullptr){
+      height++;
+      if(node->getBalance() < 0){
+        node = node->getLeft();
       }
       else{
-        n->getParent()->setParent(n->getParent());
+        node = node->getRight();
+      }
+    }
+    return height;
+}
+
+/**
+* Makes l and r (of heights hl and hr, at most one apart) the children of
+* k and returns k as a detached root; h receives its height.
+*/
+template<class Key, class Value, class Augment, class Compare>
+AVLNode<Key, Value, Augment>* AVLTree<Key, Value, Augment, Compare>::makeNode(AVLNode<Key, Value, Augment>* l, int hl, AVLNode<Key, Value, Augment>* k,
+                                                                     AVLNode<Key, Value, Augment>* r, int hr, int& h)
+{
+    k->setParent(nullptr);
+    k->setLeft(l);
+    k->setRight(r);
+    if(l != nullptr){
+      l->setParent(k);
+    }
+    if(r != nullptr){
+      r->setParent(k);
+    }
+    k->setBalance(static_cast<int8_t>(hr - hl));
+    Augment::update(k);
+    h = std::max(hl, hr) + 1;
+    return k;
+}
+
+/**
+* Joins l, k and r when l is more than one level taller than r: walks down
+* the right spine of l to a subtree of about r's height, hangs k there and
+* rotates on the way back up where needed.
+*/
+template<class Key, class Value, class Augment, class Compare>
+AVLNode<Key, Value, Augment>* AVLTree<Key, Value, Augment, Compare>::joinRight(AVLNode<Key, Value, Augment>* l, int hl, AVLNode<Key, Value, Augment>* k,
+                                                                      AVLNode<Key, Value, Augment>* r, int hr, int& h)
+{
+    AVLNode<Key, Value, Augment>* a = l->getLeft();
+    AVLNode<Key, Value, Augment>* c = l->getRight();
+    int ha = l->getBalance() > 0 ? hl - 2 : hl - 1;
+    int hc = l->getBalance() < 0 ? hl - 2 : hl - 1;
+    int ht = 0;
+    if(hc <= hr + 1){
+      AVLNode<Key, Value, Augment>* t = makeNode(c, hc, k, r, hr, ht);
+      if(ht <= ha + 1){
+        return makeNode(a, ha, l, t, ht, h);
+      }
+      //t is two taller than a, and its left child c is the tall one:
+      //rotate c up twice (right rotation at k, then left rotation at l)
+      AVLNode<Key, Value, Augment>* c1 = c->getLeft();
+      AVLNode<Key, Value, Augment>* c2 = c->getRight();
+      int hc1 = c->getBalance() > 0 ? hc - 2 : hc - 1;
+      int hc2 = c->getBalance() < 0 ? hc - 2 : hc - 1;
+      int hx = 0, hy = 0;
+      AVLNode<Key, Value, Augment>* x = makeNode(a, ha, l, c1, hc1, hx);
+      AVLNode<Key, Value, Augment>* y = makeNode(c2, hc2, k, r, hr, hy);
+      return makeNode(x, hx, c, y, hy, h);
+    }
+    AVLNode<Key, Value, Augment>* t = joinRight(c, hc, k, r, hr, ht);
+    if(ht <= ha + 1){
+      return makeNode(a, ha, l, t, ht, h);
+    }
+    //single left rotation at l
+    AVLNode<Key, Value, Augment>* t1 = t->getLeft();
+    AVLNode<Key, Value, Augment>* t2 = t->getRight();
+    int ht1 = t->getBalance() > 0 ? ht - 2 : ht - 1;
+    int ht2 = t->getBalance() < 0 ? ht - 2 : ht - 1;
+    int hx = 0;
+    AVLNode<Key, Value, Augment>* x = makeNode(a, ha, l, t1, ht1, hx);
+    return makeNode(x, hx, t, t2, ht2, h);
+}
+
+/**
+* Mirror image of joinRight, for when r is more than one level taller.
+*/
+template<class Key, class Value, class Augment, class Compare>
+AVLNode<Key, Value, Augment>* AVLTree<Key, Value, Augment, Compare>::joinLeft(AVLNode<Key, Value, Augment>* l, int hl, AVLNode<Key, Value, Augment>* k,
+                                                                     AVLNode<Key, Value, Augment>* r, int hr, int& h)
+{
+    AVLNode<Key, Value, Augment>* c = r->getLeft();
+    AVLNode<Key, Value, Augment>* a = r->getRight();
+    int hc = r->getBalance() > 0 ? hr - 2 : hr - 1;
+    int ha = r->getBalance() < 0 ? hr - 2 : hr - 1;
+    int ht = 0;
+    if(hc <= hl + 1){
+      AVLNode<Key, Value, Augment>* t = makeNode(l, hl, k, c, hc, ht);
+      if(ht <= ha + 1){
+        return makeNode(t, ht, r, a, ha, h);
+      }
+      AVLNode<Key, Value, Augment>* c1 = c->getLeft();
+      AVLNode<Key, Value, Augment>* c2 = c->getRight();
+      int hc1 = c->getBalance() > 0 ? hc - 2 : hc - 1;
+      int hc2 = c->getBalance() < 0 ? hc - 2 : hc - 1;
+      int hx = 0, hy = 0;
+      AVLNode<Key, Value, Augment>* x = makeNode(l, hl, k, c1, hc1, hx);
+      AVLNode<Key, Value, Augment>* y = makeNode(c2, hc2, r, a, ha, hy);
+      return makeNode(x, hx, c, y, hy, h);
+    }
+    AVLNode<Key, Value, Augment>* t = joinLeft(l, hl, k, c, hc, ht);
+    if(ht <= ha + 1){
+      return makeNode(t, ht, r, a, ha, h);
+    }
+    //single right rotation at r
+    AVLNode<Key, Value, Augment>* t1 = t->getLeft();
+    AVLNode<Key, Value, Augment>* t2 = t->getRight();
+    int ht1 = t->getBalance() > 0 ? ht - 2 : ht - 1;
+    int ht2 = t->getBalance() < 0 ? ht - 2 : ht - 1;
+    int hy = 0;
+    AVLNode<Key, Value, Augment>* y = makeNode(t2, ht2, r, a, ha, hy);
+    return makeNode(t1, ht1, t, y, hy, h);
+}
+
+/**
+* Joins two detached subtrees and a middle node, where every key in l is
+* smaller than k's and every key in r is bigger. O(|hl - hr| + 1).
+*/
+template<class Key, class Value, class Augment, class Compare>
+AVLNode<Key, Value, Augment>* AVLTree<Key, Value, Augment, Compare>::joinNode(AVLNode<Key, Value, Augment>* l, int hl, AVLNode<Key, Value, Augment>* k,
+                                                                     AVLNode<Key, Value, Augment>* r, int hr, int& h)
+{
+    if(hl > hr + 1){
+      return joinRight(l, hl, k, r, hr, h);
+    }
+    if(hr > hl + 1){
+      return joinLeft(l, hl, k, r, hr, h);
+    }
+    return makeNode(l, hl, k, r, hr, h);
+}
+
+/**
+* Joins two detached subtrees where every key in l is smaller than every
+* key in r, using the largest node of l as the middle node.
+*/
+template<class Key, class Value, class Augment, class Compare>
+AVLNode<Key, Value, Augment>* AVLTree<Key, Value, Augment, Compare>::joinTrees(AVLNode<Key, Value, Augment>* l, int hl,
+                                                                      AVLNode<Key, Value, Augment>* r, int hr, int& h)
+{
+    if(l == nullptr){
+      h = hr;
+      if(r != nullptr){
+        r->setParent(nullptr);
+      }
+      return r;
+    }
+    AVLNode<Key, Value, Augment>* last = nullptr;
+    int hrest = 0;
+    AVLNode<Key, Value, Augment>* rest = splitLast(l, hl, last, hrest);
+    return joinNode(rest, hrest, last, r, hr, h);
+}
+
+/**
+* Detaches the largest node of subtree t into last and returns the rest,
+* rebalanced, with its height in h.
+*/
+template<class Key, class Value, class Augment, class Compare>
+AVLNode<Key, Value, Augment>* AVLTree<Key, Value, Augment, Compare>::splitLast(AVLNode<Key, Value, Augment>* t, int ht,
+                                                                      AVLNode<Key, Value, Augment>*& last, int& h)
+{
+    AVLNode<Key, Value, Augment>* a = t->getLeft();
+    AVLNode<Key, Value, Augment>* c = t->getRight();
+    int ha = t->getBalance() > 0 ? ht - 2 : ht - 1;
+    int hc = t->getBalance() < 0 ? ht - 2 : ht - 1;
+    if(c == nullptr){
+      last = t;
+      h = ha;
+      if(a != nullptr){
+        a->setParent(nullptr);
       }
-      n->getRight()->setParent(n->getParent());
-      delete n; 
-      removeFix(p, diff);
+      return a;
+    }
+    int hrest = 0;
+    AVLNode<Key, Value, Augment>* rest = splitLast(c, hc, last, hrest);
+    return joinNode(a, ha, t, rest, hrest, h);
+}
+
+/**
+* Splits subtree t into l (keys < key) and r (keys >= key), both detached
+* and balanced. O(log n).
+*/
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::splitAt(AVLNode<Key, Value, Augment>* t, int ht, const Key& key,
+                                           AVLNode<Key, Value, Augment>*& l, int& hl, AVLNode<Key, Value, Augment>*& r, int& hr)
+{
+    if(t == nullptr){
+      l = nullptr;
+      r = nullptr;
+      hl = 0;
+      hr = 0;
       return;
     }
-  }
-  else if(n->getLeft()==nullptr){
-    if(n->getParent()!=nullptr){
-      n->getParent()->setLeft(nullptr);
-      delete n;
-      removeFix(p, diff);
+    AVLNode<Key, Value, Augment>* a = t->getLeft();
+    AVLNode<Key, Value, Augment>* c = t->getRight();
+    int ha = t->getBalance() > 0 ? ht - 2 : ht - 1;
+    int hc = t->getBalance() < 0 ? ht - 2 : ht - 1;
+    if(KeyOrder<Compare>::less(t->getKey(), key)){
+      //t and its left subtree go left, split the right subtree
+      AVLNode<Key, Value, Augment>* mid = nullptr;
+      int hmid = 0;
+      splitAt(c, hc, key, mid, hmid, r, hr);
+      l = joinNode(a, ha, t, mid, hmid, hl);
     }
     else{
-      n->getParent()->setRight(nullptr);
-      delete n; 
-      removeFix(p, diff);
+      AVLNode<Key, Value, Augment>* mid = nullptr;
+      int hmid = 0;
+      splitAt(a, ha, key, l, hl, mid, hmid);
+      r = joinNode(mid, hmid, t, c, hc, hr);
     }
-  }
-  //case when it has no left child or right child 
-  else{
-    this->root_ = nullptr; 
-    delete n; 
-    return;
-  }
 }
 
+/**
+* Like splitAt, but the node holding key (if there is one) is taken out
+* into found, with its children cleared, instead of going right.
+*/
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::splitFind(AVLNode<Key, Value, Augment>* t, int ht, const Key& key,
+                                             AVLNode<Key, Value, Augment>*& l, int& hl, AVLNode<Key, Value, Augment>*& found,
+                                             AVLNode<Key, Value, Augment>*& r, int& hr)
+{
+    if(t == nullptr){
+      l = nullptr;
+      r = nullptr;
+      found = nullptr;
+      hl = 0;
+      hr = 0;
+      return;
+    }
+    AVLNode<Key, Value, Augment>* a = t->getLeft();
+    AVLNode<Key, Value, Augment>* c = t->getRight();
+    int ha = t->getBalance() > 0 ? ht - 2 : ht - 1;
+    int hc = t->getBalance() < 0 ? ht - 2 : ht - 1;
+    AVLNode<Key, Value, Augment>* mid = nullptr;
+    int hmid = 0;
+    int cmp = KeyOrder<Compare>::compare(key, t->getKey());
+    if(cmp > 0){
+      splitFind(c, hc, key, mid, hmid, found, r, hr);
+      l = joinNode(a, ha, t, mid, hmid, hl);
+    }
+    else if(cmp < 0){
+      splitFind(a, ha, key, l, hl, found, mid, hmid);
+      r = joinNode(mid, hmid, t, c, hc, hr);
+    }
+    else{
+      l = a;
+      hl = ha;
+      r = c;
+      hr = hc;
+      found = t;
+      t->setLeft(nullptr);
+      t->setRight(nullptr);
+    }
+}
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+template<class Key, class Value, class Augment, class Compare>
+void AVLTree<Key, Value, Augment, Compare>::nodeSwap( AVLNode<Key, Value, Augment>* n1, AVLNode<Key, Value, Augment>* n2)
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    BinarySearchTree<Key, Value, AVLNode<Key, Value, Augment>, Compare>::nodeSwap(n1, n2);
     int8_t tempB = n1->getBalance();
     n1->setBalance(n2->getBalance());
     n2->setBalance(tempB);
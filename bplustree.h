@@ -0,0 +1,967 @@
+#ifndef BPLUSTREE_H
+#define BPLUSTREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <memory>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include "bst.h"
+#include "node_pool.h"
+
+/**
+* An ordered map with the same interface as BinarySearchTree, built as a
+* B+ tree instead of a binary one.
+*
+* Inner nodes hold up to Fanout - 1 separator keys and Fanout children;
+* leaves hold up to Fanout items with the keys in one array and the
+* values in another, and are linked both ways for scans. A lookup
+* therefore reads a few consecutive cache lines of keys per level
+* instead of one node per comparison: about log_16 n levels instead of
+* 1.44 log2 n, and no per-item pointers, so for int keys and values a
+* key costs roughly 12 bytes at random insertion order (and 9 for
+* ascending keys, see below) against 40 for an AVLNode.
+*
+* Splitting the last leaf because of a key past the end keeps the old
+* leaf full and starts a new one, and the same goes up the right edge,
+* so ascending ingest packs nodes densely instead of leaving them half
+* full. Other splits halve the node. Removal borrows from or merges with
+* a sibling once a node drops below half full.
+*
+* Since items are not stored as pairs, dereferencing an iterator yields
+* a pair of references (key, value): it->first and it->second work as
+* usual, binding a std::pair<const Key, Value>& to *it does not. Any
+* insert or remove invalidates iterators. Key and Value have to be
+* default constructible.
+*/
+template<class Key, class Value, class Compare = std::less<Key>, std::size_t Fanout = 32>
+class BPlusTree
+{
+    static_assert(Fanout >= 4 && Fanout <= 1024, "BPlusTree: Fanout out of range");
+
+public:
+    class iterator;
+
+    BPlusTree();
+    BPlusTree(BPlusTree&& other);
+    BPlusTree& operator=(BPlusTree&& other);
+    BPlusTree(const BPlusTree& other) = delete;
+    BPlusTree& operator=(const BPlusTree& other) = delete;
+    ~BPlusTree();
+
+    std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value& at(const Key& key);
+    Value const & at(const Key& key) const;
+
+    std::size_t size() const;
+    bool empty() const;
+    bool isBalanced() const;
+    int height() const;
+    std::size_t bytesUsed() const;
+
+    // a node has at least two children, so 64 levels cover any tree
+    static const int kMaxHeight = 64;
+
+private:
+    struct Node
+    {
+        Node() : count(0) { }
+        // items in a leaf, keys (one less than children) in an inner node
+        std::uint16_t count;
+    };
+
+    struct Leaf : public Node
+    {
+        Leaf() : prev(nullptr), next(nullptr) { }
+        Leaf* prev;
+        Leaf* next;
+        Key keys[Fanout];
+        Value values[Fanout];
+    };
+
+    struct Inner : public Node
+    {
+        // children[i] holds the keys k with keys[i - 1] <= k < keys[i]
+        Key keys[Fanout - 1];
+        Node* children[Fanout];
+    };
+
+    static const std::size_t kMinItems = Fanout / 2;
+    static const std::size_t kMinKeys = (Fanout - 1) / 2;
+
+public:
+    /**
+    * Walks the leaves in order. end() is a NULL leaf; it remembers the
+    * tree so that it can be stepped back from.
+    */
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key&, Value&> reference;
+
+        struct pointer
+        {
+            reference item;
+            const reference* operator->() const { return &item; }
+        };
+
+        iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator& operator--();
+
+    private:
+        friend class BPlusTree<Key, Value, Compare, Fanout>;
+        iterator(Leaf* leaf, std::size_t index, const BPlusTree* tree);
+        Leaf* leaf_;
+        std::size_t index_;
+        const BPlusTree* tree_;
+    };
+
+private:
+    template<typename V>
+    std::pair<iterator, bool> insertItem(const Key& key, V&& value, bool assign);
+    Leaf* findLeaf(const Key& key) const;
+    iterator leafPosition(Leaf* leaf, std::size_t index) const;
+    static std::size_t childIndex(const Inner* node, const Key& key);
+    static std::size_t lowerIndex(const Leaf* leaf, const Key& key);
+    static std::size_t upperIndex(const Leaf* leaf, const Key& key);
+    static void insertChild(Inner* node, std::size_t i, const Key& key, Node* child);
+    static void removeChild(Inner* node, std::size_t i);
+    void rebalanceLeaf(Leaf* leaf, Inner* parent, std::size_t i);
+    bool rebalanceInner(Inner* node, Inner* parent, std::size_t i);
+    void unlinkLeaf(Leaf* leaf);
+    Leaf* newLeaf();
+    Inner* newInner();
+    void deleteLeaf(Leaf* leaf);
+    void deleteInner(Inner* inner);
+    void deleteSubtree(Node* node, int level);
+    bool checkNode(const Node* node, int level, const Key* lo, const Key* hi) const;
+
+    Node* root_;
+    // levels, 1 when the root is a leaf, 0 when empty
+    int height_;
+    Leaf* head_;
+    Leaf* tail_;
+    std::size_t size_;
+    std::size_t leaves_;
+    std::size_t inners_;
+    std::unique_ptr<NodePool> leafPool_;
+    std::unique_ptr<NodePool> innerPool_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the BPlusTree class.
+  -----------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+BPlusTree<Key, Value, Compare, Fanout>::BPlusTree() :
+    root_(nullptr),
+    height_(0),
+    head_(nullptr),
+    tail_(nullptr),
+    size_(0),
+    leaves_(0),
+    inners_(0),
+    leafPool_(new NodePool(sizeof(Leaf), alignof(Leaf))),
+    innerPool_(new NodePool(sizeof(Inner), alignof(Inner)))
+{
+
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+BPlusTree<Key, Value, Compare, Fanout>::BPlusTree(BPlusTree&& other) :
+    root_(other.root_),
+    height_(other.height_),
+    head_(other.head_),
+    tail_(other.tail_),
+    size_(other.size_),
+    leaves_(other.leaves_),
+    inners_(other.inners_),
+    leafPool_(std::move(other.leafPool_)),
+    innerPool_(std::move(other.innerPool_))
+{
+    other.root_ = nullptr;
+    other.height_ = 0;
+    other.head_ = nullptr;
+    other.tail_ = nullptr;
+    other.size_ = 0;
+    other.leaves_ = 0;
+    other.inners_ = 0;
+    other.leafPool_.reset(new NodePool(sizeof(Leaf), alignof(Leaf)));
+    other.innerPool_.reset(new NodePool(sizeof(Inner), alignof(Inner)));
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+BPlusTree<Key, Value, Compare, Fanout>& BPlusTree<Key, Value, Compare, Fanout>::operator=(BPlusTree&& other)
+{
+    if(this != &other) {
+        std::swap(root_, other.root_);
+        std::swap(height_, other.height_);
+        std::swap(head_, other.head_);
+        std::swap(tail_, other.tail_);
+        std::swap(size_, other.size_);
+        std::swap(leaves_, other.leaves_);
+        std::swap(inners_, other.inners_);
+        std::swap(leafPool_, other.leafPool_);
+        std::swap(innerPool_, other.innerPool_);
+        other.clear();
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+BPlusTree<Key, Value, Compare, Fanout>::~BPlusTree()
+{
+    clear();
+}
+
+/**
+* Inserts the item, or overwrites the value if the key is already there.
+* Returns an iterator to the item and true if it is new.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+std::pair<typename BPlusTree<Key, Value, Compare, Fanout>::iterator, bool>
+BPlusTree<Key, Value, Compare, Fanout>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    return insertItem(keyValuePair.first, keyValuePair.second, true);
+}
+
+/**
+* Removes key if it is there. A leaf or inner node left less than half
+* full takes an entry from a sibling that can spare one, or else is
+* merged with it, which takes a separator out of the parent and may
+* repeat one level up. The root goes when it is left with one child.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+void BPlusTree<Key, Value, Compare, Fanout>::remove(const Key& key)
+{
+    if(root_ == nullptr) {
+        return;
+    }
+    Inner* path[kMaxHeight];
+    std::size_t slots[kMaxHeight];
+    int depth = 0;
+    Node* node = root_;
+    for(int level = height_; level > 1; level--) {
+        Inner* inner = static_cast<Inner*>(node);
+        std::size_t i = childIndex(inner, key);
+        path[depth] = inner;
+        slots[depth] = i;
+        depth++;
+        node = inner->children[i];
+    }
+    Leaf* leaf = static_cast<Leaf*>(node);
+    std::size_t pos = lowerIndex(leaf, key);
+    if(pos == leaf->count || KeyOrder<Compare>::less(key, leaf->keys[pos])) {
+        return;
+    }
+    std::move(leaf->keys + pos + 1, leaf->keys + leaf->count, leaf->keys + pos);
+    std::move(leaf->values + pos + 1, leaf->values + leaf->count, leaf->values + pos);
+    leaf->count--;
+    size_--;
+
+    if(depth == 0) {
+        if(leaf->count == 0) {
+            deleteLeaf(leaf);
+            root_ = nullptr;
+            height_ = 0;
+            head_ = nullptr;
+            tail_ = nullptr;
+        }
+        return;
+    }
+    if(leaf->count >= kMinItems) {
+        return;
+    }
+    depth--;
+    rebalanceLeaf(leaf, path[depth], slots[depth]);
+    //path[depth] may have lost a separator; fix inner nodes upward
+    while(depth > 0 && rebalanceInner(path[depth], path[depth - 1], slots[depth - 1])) {
+        depth--;
+    }
+    if(depth == 0 && root_ != nullptr && height_ > 1) {
+        Inner* root = static_cast<Inner*>(root_);
+        if(root->count == 0) {
+            root_ = root->children[0];
+            deleteInner(root);
+            height_--;
+        }
+    }
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+void BPlusTree<Key, Value, Compare, Fanout>::clear()
+{
+    deleteSubtree(root_, height_);
+    leafPool_->release();
+    innerPool_->release();
+    root_ = nullptr;
+    height_ = 0;
+    head_ = nullptr;
+    tail_ = nullptr;
+    size_ = 0;
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+typename BPlusTree<Key, Value, Compare, Fanout>::iterator BPlusTree<Key, Value, Compare, Fanout>::begin() const
+{
+    return iterator(head_, 0, this);
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+typename BPlusTree<Key, Value, Compare, Fanout>::iterator BPlusTree<Key, Value, Compare, Fanout>::end() const
+{
+    return iterator(nullptr, 0, this);
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+typename BPlusTree<Key, Value, Compare, Fanout>::iterator BPlusTree<Key, Value, Compare, Fanout>::find(const Key& key) const
+{
+    Leaf* leaf = findLeaf(key);
+    if(leaf == nullptr) {
+        return end();
+    }
+    std::size_t pos = lowerIndex(leaf, key);
+    if(pos == leaf->count || KeyOrder<Compare>::less(key, leaf->keys[pos])) {
+        return end();
+    }
+    return iterator(leaf, pos, this);
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+typename BPlusTree<Key, Value, Compare, Fanout>::iterator BPlusTree<Key, Value, Compare, Fanout>::lower_bound(const Key& key) const
+{
+    Leaf* leaf = findLeaf(key);
+    if(leaf == nullptr) {
+        return end();
+    }
+    return leafPosition(leaf, lowerIndex(leaf, key));
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+typename BPlusTree<Key, Value, Compare, Fanout>::iterator BPlusTree<Key, Value, Compare, Fanout>::upper_bound(const Key& key) const
+{
+    Leaf* leaf = findLeaf(key);
+    if(leaf == nullptr) {
+        return end();
+    }
+    return leafPosition(leaf, upperIndex(leaf, key));
+}
+
+/**
+* The value stored under key, default constructed first if key is new.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+Value& BPlusTree<Key, Value, Compare, Fanout>::operator[](const Key& key)
+{
+    return insertItem(key, Value(), false).first->second;
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+Value& BPlusTree<Key, Value, Compare, Fanout>::at(const Key& key)
+{
+    iterator it = find(key);
+    if(it == end()) {
+        throw std::out_of_range("Invalid key");
+    }
+    return it->second;
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+Value const & BPlusTree<Key, Value, Compare, Fanout>::at(const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) {
+        throw std::out_of_range("Invalid key");
+    }
+    return it->second;
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+std::size_t BPlusTree<Key, Value, Compare, Fanout>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+bool BPlusTree<Key, Value, Compare, Fanout>::empty() const
+{
+    return size_ == 0;
+}
+
+/**
+* Checks the structure: every leaf at the same depth, no empty node
+* below the root, keys in order within each node and between the
+* separators above it. A B+ tree is balanced by construction, so false
+* means something is broken.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+bool BPlusTree<Key, Value, Compare, Fanout>::isBalanced() const
+{
+    if(root_ == nullptr) {
+        return height_ == 0 && head_ == nullptr && tail_ == nullptr;
+    }
+    return checkNode(root_, height_, nullptr, nullptr);
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+int BPlusTree<Key, Value, Compare, Fanout>::height() const
+{
+    return height_;
+}
+
+/**
+* Bytes taken by the nodes currently in the tree.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+std::size_t BPlusTree<Key, Value, Compare, Fanout>::bytesUsed() const
+{
+    return leaves_ * sizeof(Leaf) + inners_ * sizeof(Inner);
+}
+
+/**
+* Descends to the leaf where key belongs and puts it there. A full leaf
+* is split and the separator of the new right half goes into the
+* parent, splitting that in turn when full, up to a new root if need be.
+* An existing key gets value only if assign is set.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+template<typename V>
+std::pair<typename BPlusTree<Key, Value, Compare, Fanout>::iterator, bool>
+BPlusTree<Key, Value, Compare, Fanout>::insertItem(const Key& key, V&& value, bool assign)
+{
+    if(root_ == nullptr) {
+        Leaf* leaf = newLeaf();
+        root_ = leaf;
+        height_ = 1;
+        head_ = leaf;
+        tail_ = leaf;
+    }
+    Inner* path[kMaxHeight];
+    std::size_t slots[kMaxHeight];
+    int depth = 0;
+    Node* node = root_;
+    for(int level = height_; level > 1; level--) {
+        Inner* inner = static_cast<Inner*>(node);
+        std::size_t i = childIndex(inner, key);
+        path[depth] = inner;
+        slots[depth] = i;
+        depth++;
+        node = inner->children[i];
+    }
+    Leaf* leaf = static_cast<Leaf*>(node);
+    std::size_t pos = lowerIndex(leaf, key);
+    if(pos < leaf->count && !KeyOrder<Compare>::less(key, leaf->keys[pos])) {
+        if(assign) {
+            leaf->values[pos] = std::forward<V>(value);
+        }
+        return std::make_pair(iterator(leaf, pos, this), false);
+    }
+    size_++;
+
+    Leaf* target = leaf;
+    Leaf* right = nullptr;
+    //past the end of the last leaf: leave it full and start a new one
+    bool rightEdge = leaf->next == nullptr && pos == leaf->count;
+    if(leaf->count == Fanout) {
+        right = newLeaf();
+        std::size_t from = rightEdge ? Fanout : Fanout / 2;
+        std::move(leaf->keys + from, leaf->keys + Fanout, right->keys);
+        std::move(leaf->values + from, leaf->values + Fanout, right->values);
+        right->count = static_cast<std::uint16_t>(Fanout - from);
+        leaf->count = static_cast<std::uint16_t>(from);
+        right->prev = leaf;
+        right->next = leaf->next;
+        if(leaf->next != nullptr) {
+            leaf->next->prev = right;
+        }
+        else {
+            tail_ = right;
+        }
+        leaf->next = right;
+        if(pos > from || from == Fanout) {
+            target = right;
+            pos -= from;
+        }
+    }
+    std::move_backward(target->keys + pos, target->keys + target->count, target->keys + target->count + 1);
+    std::move_backward(target->values + pos, target->values + target->count, target->values + target->count + 1);
+    target->keys[pos] = key;
+    target->values[pos] = std::forward<V>(value);
+    target->count++;
+    std::pair<iterator, bool> result(iterator(target, pos, this), true);
+    if(right == nullptr) {
+        return result;
+    }
+
+    //hand the new right node and its smallest key to the parent
+    Key separator = right->keys[0];
+    Node* child = right;
+    while(depth > 0) {
+        depth--;
+        Inner* parent = path[depth];
+        std::size_t i = slots[depth];
+        rightEdge = rightEdge && i == parent->count;
+        if(parent->count < Fanout - 1) {
+            insertChild(parent, i, separator, child);
+            return result;
+        }
+        //all Fanout keys and Fanout + 1 children in order, then cut
+        Key keys[Fanout];
+        Node* children[Fanout + 1];
+        std::move(parent->keys, parent->keys + i, keys);
+        keys[i] = separator;
+        std::move(parent->keys + i, parent->keys + Fanout - 1, keys + i + 1);
+        std::copy(parent->children, parent->children + i + 1, children);
+        children[i + 1] = child;
+        std::copy(parent->children + i + 1, parent->children + Fanout, children + i + 2);
+        std::size_t kept = rightEdge ? Fanout - 2 : Fanout / 2;
+        Inner* sibling = newInner();
+        std::move(keys, keys + kept, parent->keys);
+        std::copy(children, children + kept + 1, parent->children);
+        parent->count = static_cast<std::uint16_t>(kept);
+        std::move(keys + kept + 1, keys + Fanout, sibling->keys);
+        std::copy(children + kept + 1, children + Fanout + 1, sibling->children);
+        sibling->count = static_cast<std::uint16_t>(Fanout - kept - 1);
+        separator = std::move(keys[kept]);
+        child = sibling;
+    }
+    Inner* root = newInner();
+    root->keys[0] = separator;
+    root->children[0] = root_;
+    root->children[1] = child;
+    root->count = 1;
+    root_ = root;
+    height_++;
+    return result;
+}
+
+/**
+* The leaf key belongs in, or NULL for an empty tree.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+typename BPlusTree<Key, Value, Compare, Fanout>::Leaf* BPlusTree<Key, Value, Compare, Fanout>::findLeaf(const Key& key) const
+{
+    Node* node = root_;
+    for(int level = height_; level > 1; level--) {
+        Inner* inner = static_cast<Inner*>(node);
+        node = inner->children[childIndex(inner, key)];
+    }
+    return static_cast<Leaf*>(node);
+}
+
+/**
+* An iterator to leaf's item at index, moving on to the next leaf when
+* index is one past the last item.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+typename BPlusTree<Key, Value, Compare, Fanout>::iterator
+BPlusTree<Key, Value, Compare, Fanout>::leafPosition(Leaf* leaf, std::size_t index) const
+{
+    if(index == leaf->count) {
+        return iterator(leaf->next, 0, this);
+    }
+    return iterator(leaf, index, this);
+}
+
+/**
+* Which child of node key is under: the number of separators <= key.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+std::size_t BPlusTree<Key, Value, Compare, Fanout>::childIndex(const Inner* node, const Key& key)
+{
+    return std::upper_bound(node->keys, node->keys + node->count, key, [](const Key& a, const Key& b) {
+        return KeyOrder<Compare>::less(a, b);
+    }) - node->keys;
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+std::size_t BPlusTree<Key, Value, Compare, Fanout>::lowerIndex(const Leaf* leaf, const Key& key)
+{
+    return std::lower_bound(leaf->keys, leaf->keys + leaf->count, key, [](const Key& a, const Key& b) {
+        return KeyOrder<Compare>::less(a, b);
+    }) - leaf->keys;
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+std::size_t BPlusTree<Key, Value, Compare, Fanout>::upperIndex(const Leaf* leaf, const Key& key)
+{
+    return std::upper_bound(leaf->keys, leaf->keys + leaf->count, key, [](const Key& a, const Key& b) {
+        return KeyOrder<Compare>::less(a, b);
+    }) - leaf->keys;
+}
+
+/**
+* Puts key in front of node's i-th separator and child right after the
+* i-th child. node must have room.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+void BPlusTree<Key, Value, Compare, Fanout>::insertChild(Inner* node, std::size_t i, const Key& key, Node* child)
+{
+    std::move_backward(node->keys + i, node->keys + node->count, node->keys + node->count + 1);
+    std::copy_backward(node->children + i + 1, node->children + node->count + 1, node->children + node->count + 2);
+    node->keys[i] = key;
+    node->children[i + 1] = child;
+    node->count++;
+}
+
+/**
+* Takes node's i-th separator and the child right after it out.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+void BPlusTree<Key, Value, Compare, Fanout>::removeChild(Inner* node, std::size_t i)
+{
+    std::move(node->keys + i + 1, node->keys + node->count, node->keys + i);
+    std::copy(node->children + i + 2, node->children + node->count + 1, node->children + i + 1);
+    node->count--;
+}
+
+/**
+* leaf, child i of parent, fell below half full: move one item over from
+* a sibling that has more than half, or else merge with a sibling, which
+* takes one separator out of parent.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+void BPlusTree<Key, Value, Compare, Fanout>::rebalanceLeaf(Leaf* leaf, Inner* parent, std::size_t i)
+{
+    Leaf* left = i > 0 ? static_cast<Leaf*>(parent->children[i - 1]) : nullptr;
+    Leaf* right = i < parent->count ? static_cast<Leaf*>(parent->children[i + 1]) : nullptr;
+    if(left != nullptr && left->count > kMinItems) {
+        std::move_backward(leaf->keys, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+        std::move_backward(leaf->values, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+        leaf->keys[0] = std::move(left->keys[left->count - 1]);
+        leaf->values[0] = std::move(left->values[left->count - 1]);
+        leaf->count++;
+        left->count--;
+        parent->keys[i - 1] = leaf->keys[0];
+    }
+    else if(right != nullptr && right->count > kMinItems) {
+        leaf->keys[leaf->count] = std::move(right->keys[0]);
+        leaf->values[leaf->count] = std::move(right->values[0]);
+        leaf->count++;
+        std::move(right->keys + 1, right->keys + right->count, right->keys);
+        std::move(right->values + 1, right->values + right->count, right->values);
+        right->count--;
+        parent->keys[i] = right->keys[0];
+    }
+    else if(left != nullptr) {
+        std::move(leaf->keys, leaf->keys + leaf->count, left->keys + left->count);
+        std::move(leaf->values, leaf->values + leaf->count, left->values + left->count);
+        left->count += leaf->count;
+        unlinkLeaf(leaf);
+        deleteLeaf(leaf);
+        removeChild(parent, i - 1);
+    }
+    else if(right != nullptr) {
+        std::move(right->keys, right->keys + right->count, leaf->keys + leaf->count);
+        std::move(right->values, right->values + right->count, leaf->values + leaf->count);
+        leaf->count += right->count;
+        unlinkLeaf(right);
+        deleteLeaf(right);
+        removeChild(parent, i);
+    }
+}
+
+/**
+* The same for an inner node, child i of parent; items move through the
+* separator in parent. Returns true if parent lost a separator and may
+* need fixing in turn.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+bool BPlusTree<Key, Value, Compare, Fanout>::rebalanceInner(Inner* node, Inner* parent, std::size_t i)
+{
+    if(node->count >= kMinKeys) {
+        return false;
+    }
+    Inner* left = i > 0 ? static_cast<Inner*>(parent->children[i - 1]) : nullptr;
+    Inner* right = i < parent->count ? static_cast<Inner*>(parent->children[i + 1]) : nullptr;
+    if(left != nullptr && left->count > kMinKeys) {
+        std::move_backward(node->keys, node->keys + node->count, node->keys + node->count + 1);
+        std::copy_backward(node->children, node->children + node->count + 1, node->children + node->count + 2);
+        node->keys[0] = std::move(parent->keys[i - 1]);
+        node->children[0] = left->children[left->count];
+        node->count++;
+        parent->keys[i - 1] = std::move(left->keys[left->count - 1]);
+        left->count--;
+        return false;
+    }
+    if(right != nullptr && right->count > kMinKeys) {
+        node->keys[node->count] = std::move(parent->keys[i]);
+        node->children[node->count + 1] = right->children[0];
+        node->count++;
+        parent->keys[i] = std::move(right->keys[0]);
+        std::move(right->keys + 1, right->keys + right->count, right->keys);
+        std::copy(right->children + 1, right->children + right->count + 1, right->children);
+        right->count--;
+        return false;
+    }
+    if(left != nullptr) {
+        left->keys[left->count] = std::move(parent->keys[i - 1]);
+        std::move(node->keys, node->keys + node->count, left->keys + left->count + 1);
+        std::copy(node->children, node->children + node->count + 1, left->children + left->count + 1);
+        left->count += node->count + 1;
+        deleteInner(node);
+        removeChild(parent, i - 1);
+        return true;
+    }
+    if(right != nullptr) {
+        node->keys[node->count] = std::move(parent->keys[i]);
+        std::move(right->keys, right->keys + right->count, node->keys + node->count + 1);
+        std::copy(right->children, right->children + right->count + 1, node->children + node->count + 1);
+        node->count += right->count + 1;
+        deleteInner(right);
+        removeChild(parent, i);
+        return true;
+    }
+    return false;
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+void BPlusTree<Key, Value, Compare, Fanout>::unlinkLeaf(Leaf* leaf)
+{
+    if(leaf->prev != nullptr) {
+        leaf->prev->next = leaf->next;
+    }
+    else {
+        head_ = leaf->next;
+    }
+    if(leaf->next != nullptr) {
+        leaf->next->prev = leaf->prev;
+    }
+    else {
+        tail_ = leaf->prev;
+    }
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+typename BPlusTree<Key, Value, Compare, Fanout>::Leaf* BPlusTree<Key, Value, Compare, Fanout>::newLeaf()
+{
+    void* slot = leafPool_->allocate();
+    try {
+        Leaf* leaf = new (slot) Leaf();
+        leaves_++;
+        return leaf;
+    }
+    catch(...) {
+        leafPool_->deallocate(slot);
+        throw;
+    }
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+typename BPlusTree<Key, Value, Compare, Fanout>::Inner* BPlusTree<Key, Value, Compare, Fanout>::newInner()
+{
+    void* slot = innerPool_->allocate();
+    try {
+        Inner* inner = new (slot) Inner();
+        inners_++;
+        return inner;
+    }
+    catch(...) {
+        innerPool_->deallocate(slot);
+        throw;
+    }
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+void BPlusTree<Key, Value, Compare, Fanout>::deleteLeaf(Leaf* leaf)
+{
+    leaf->~Leaf();
+    leafPool_->deallocate(leaf);
+    leaves_--;
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+void BPlusTree<Key, Value, Compare, Fanout>::deleteInner(Inner* inner)
+{
+    inner->~Inner();
+    innerPool_->deallocate(inner);
+    inners_--;
+}
+
+/**
+* Runs the destructors of every node below node, which is level levels
+* high; clear() gives the memory back to the pools afterwards.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+void BPlusTree<Key, Value, Compare, Fanout>::deleteSubtree(Node* node, int level)
+{
+    if(node == nullptr) {
+        return;
+    }
+    if(level == 1) {
+        static_cast<Leaf*>(node)->~Leaf();
+        leaves_--;
+        return;
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    for(std::size_t i = 0; i <= inner->count; i++) {
+        deleteSubtree(inner->children[i], level - 1);
+    }
+    inner->~Inner();
+    inners_--;
+}
+
+/**
+* isBalanced() for one subtree whose keys must lie in [lo, hi) (NULL for
+* no bound).
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+bool BPlusTree<Key, Value, Compare, Fanout>::checkNode(const Node* node, int level, const Key* lo, const Key* hi) const
+{
+    if(node == nullptr || level < 1) {
+        return false;
+    }
+    std::size_t n = node->count;
+    if(level == 1) {
+        const Leaf* leaf = static_cast<const Leaf*>(node);
+        if(n == 0 || n > Fanout) {
+            return false;
+        }
+        for(std::size_t i = 0; i < n; i++) {
+            if((i > 0 && !KeyOrder<Compare>::less(leaf->keys[i - 1], leaf->keys[i]))
+               || (lo != nullptr && KeyOrder<Compare>::less(leaf->keys[i], *lo))
+               || (hi != nullptr && !KeyOrder<Compare>::less(leaf->keys[i], *hi))) {
+                return false;
+            }
+        }
+        return true;
+    }
+    const Inner* inner = static_cast<const Inner*>(node);
+    if(n == 0 || n > Fanout - 1) {
+        return false;
+    }
+    for(std::size_t i = 0; i <= n; i++) {
+        const Key* childLo = i == 0 ? lo : &inner->keys[i - 1];
+        const Key* childHi = i == n ? hi : &inner->keys[i];
+        if(childLo != nullptr && childHi != nullptr && !KeyOrder<Compare>::less(*childLo, *childHi)) {
+            return false;
+        }
+        if(!checkNode(inner->children[i], level - 1, childLo, childHi)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the BPlusTree class.
+  ---------------------------------------------
+*/
+
+/*
+  ---------------------------------------------------------
+  Begin implementations for the BPlusTree::iterator class.
+  ---------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+BPlusTree<Key, Value, Compare, Fanout>::iterator::iterator() :
+    leaf_(nullptr),
+    index_(0),
+    tree_(nullptr)
+{
+
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+BPlusTree<Key, Value, Compare, Fanout>::iterator::iterator(Leaf* leaf, std::size_t index, const BPlusTree* tree) :
+    leaf_(leaf),
+    index_(index),
+    tree_(tree)
+{
+
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+typename BPlusTree<Key, Value, Compare, Fanout>::iterator::reference
+BPlusTree<Key, Value, Compare, Fanout>::iterator::operator*() const
+{
+    return reference(leaf_->keys[index_], leaf_->values[index_]);
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+typename BPlusTree<Key, Value, Compare, Fanout>::iterator::pointer
+BPlusTree<Key, Value, Compare, Fanout>::iterator::operator->() const
+{
+    pointer p = { **this };
+    return p;
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+bool BPlusTree<Key, Value, Compare, Fanout>::iterator::operator==(const iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+bool BPlusTree<Key, Value, Compare, Fanout>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class Value, class Compare, std::size_t Fanout>
+typename BPlusTree<Key, Value, Compare, Fanout>::iterator&
+BPlusTree<Key, Value, Compare, Fanout>::iterator::operator++()
+{
+    if(++index_ == leaf_->count) {
+        leaf_ = leaf_->next;
+        index_ = 0;
+    }
+    return *this;
+}
+
+/**
+* Steps back; from end() to the largest item.
+*/
+template<class Key, class Value, class Compare, std::size_t Fanout>
+typename BPlusTree<Key, Value, Compare, Fanout>::iterator&
+BPlusTree<Key, Value, Compare, Fanout>::iterator::operator--()
+{
+    if(leaf_ == nullptr) {
+        leaf_ = tree_->tail_;
+        index_ = leaf_->count - 1;
+    }
+    else if(index_ == 0) {
+        leaf_ = leaf_->prev;
+        index_ = leaf_->count - 1;
+    }
+    else {
+        index_--;
+    }
+    return *this;
+}
+
+/*
+  -------------------------------------------------------
+  End implementations for the BPlusTree::iterator class.
+  -------------------------------------------------------
+*/
+
+#endif
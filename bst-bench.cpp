@@ -0,0 +1,840 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include "bst.h"
+#include "avlbst.h"
+#include "concurrent_avlbst.h"
+#include "compact_avlbst.h"
+#include "stack_avlbst.h"
+#include "interval_avlbst.h"
+#include "bplustree.h"
+
+using namespace std;
+
+/**
+* The node layout the trees used before Node was devirtualized: every link
+* is read through a virtual getter and each node carries a vtable pointer.
+* Kept here only as a baseline to measure against.
+*/
+struct VirtualNode
+{
+    VirtualNode(int key, int value) : key_(key), value_(value), parent_(nullptr), left_(nullptr), right_(nullptr) { }
+    virtual ~VirtualNode() { }
+    virtual VirtualNode* getParent() const { return parent_; }
+    virtual VirtualNode* getLeft() const { return left_; }
+    virtual VirtualNode* getRight() const { return right_; }
+    int getKey() const { return key_; }
+
+    int key_;
+    int value_;
+    VirtualNode* parent_;
+    VirtualNode* left_;
+    VirtualNode* right_;
+};
+
+struct VirtualAVLNode : public VirtualNode
+{
+    VirtualAVLNode(int key, int value) : VirtualNode(key, value), balance_(0) { }
+    virtual VirtualAVLNode* getParent() const override { return static_cast<VirtualAVLNode*>(parent_); }
+    virtual VirtualAVLNode* getLeft() const override { return static_cast<VirtualAVLNode*>(left_); }
+    virtual VirtualAVLNode* getRight() const override { return static_cast<VirtualAVLNode*>(right_); }
+
+    int8_t balance_;
+};
+
+// Gives the benchmark access to the root so the baseline can copy its shape.
+class BenchTree : public AVLTree<int, int>
+{
+public:
+    AVLNode<int, int>* root() const { return this->root_; }
+};
+
+// Copies the shape of an AVL subtree onto the baseline nodes. Each value is
+// the insertion index of its key, so nodes[value] was allocated in the same
+// order as the tree's own node and the two layouts are comparable.
+VirtualNode* copyShape(AVLNode<int, int>* n, VirtualNode* parent, vector<VirtualNode*>& nodes)
+{
+    if(n == nullptr) {
+        return nullptr;
+    }
+    VirtualNode* copy = nodes[n->getValue()];
+    copy->parent_ = parent;
+    copy->left_ = copyShape(n->getLeft(), copy, nodes);
+    copy->right_ = copyShape(n->getRight(), copy, nodes);
+    return copy;
+}
+
+// The same descent as BinarySearchTree::internalFind, but through the vtable.
+VirtualNode* virtualFind(VirtualNode* now, int key)
+{
+    while(now != nullptr) {
+        if(now->getKey() > key) {
+            now = now->getLeft();
+        }
+        else if(now->getKey() < key) {
+            now = now->getRight();
+        }
+        else {
+            return now;
+        }
+    }
+    return nullptr;
+}
+
+double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Measures find throughput of the pool allocated, statically dispatched tree
+// against the same shape built from virtual nodes.
+void benchFind(int n, int lookups)
+{
+    mt19937 gen(12345);
+    vector<int> keys(n);
+    for(int i = 0; i < n; i++) {
+        keys[i] = static_cast<int>(gen() >> 1);
+    }
+    vector<int> probes(lookups);
+    for(int i = 0; i < lookups; i++) {
+        probes[i] = keys[gen() % n];
+    }
+
+    BenchTree tree;
+    tree.reserve(n);
+    for(int i = 0; i < n; i++) {
+        tree.insert(make_pair(keys[i], i));
+    }
+    vector<VirtualNode*> nodes(n);
+    for(int i = 0; i < n; i++) {
+        nodes[i] = new VirtualAVLNode(keys[i], i);
+    }
+    VirtualNode* baseline = copyShape(tree.root(), nullptr, nodes);
+
+    cout << "Nodes: " << n << ", lookups: " << lookups << endl;
+    long long checksum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(int i = 0; i < lookups; i++) {
+        checksum += tree.find(probes[i])->second;
+    }
+    double staticTime = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < lookups; i++) {
+        checksum -= virtualFind(baseline, probes[i])->value_;
+    }
+    double virtualTime = secondsSince(start);
+
+    cout << "find, static dispatch:  " << lookups / staticTime / 1e6 << " M/s" << endl;
+    cout << "find, virtual dispatch: " << lookups / virtualTime / 1e6 << " M/s" << endl;
+    if(checksum != 0) {
+        cout << "checksum mismatch" << endl;
+    }
+
+    for(int i = 0; i < n; i++) {
+        delete nodes[i];
+    }
+}
+
+// Merges a delta of m keys into a base of n keys, once by inserting the
+// delta key by key and once with the join based union_with.
+void benchUnion(int n, int m)
+{
+    mt19937 gen(54321);
+    vector<pair<int, int> > base(n), delta(m);
+    for(int i = 0; i < n; i++) {
+        base[i] = make_pair(static_cast<int>(gen() >> 1), i);
+    }
+    for(int i = 0; i < m; i++) {
+        delta[i] = make_pair(static_cast<int>(gen() >> 1), -i);
+    }
+
+    cout << "Base: " << n << ", delta: " << m << endl;
+    AVLTree<int, int> byInsert, byUnion, deltaTree;
+    for(int i = 0; i < n; i++) {
+        byInsert.insert(base[i]);
+        byUnion.insert(base[i]);
+    }
+    for(int i = 0; i < m; i++) {
+        deltaTree.insert(delta[i]);
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(int i = 0; i < m; i++) {
+        byInsert.insert(delta[i]);
+    }
+    double insertTime = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    byUnion.union_with(deltaTree);
+    double unionTime = secondsSince(start);
+
+    cout << "merge, insert loop: " << insertTime * 1e3 << " ms" << endl;
+    cout << "merge, union_with:  " << unionTime * 1e3 << " ms ("
+         << thread::hardware_concurrency() << " hardware threads)" << endl;
+    if(byInsert.size() != byUnion.size()) {
+        cout << "size mismatch" << endl;
+    }
+}
+
+// Applies a sorted-once batch of m random inserts to a tree of n keys, once
+// with a loop of insert() and once with insert_batch().
+void benchBatch(int n, int m)
+{
+    mt19937 gen(98765);
+    vector<pair<int, int> > base(n), batch(m);
+    for(int i = 0; i < n; i++) {
+        base[i] = make_pair(static_cast<int>(gen() >> 1), i);
+    }
+    for(int i = 0; i < m; i++) {
+        batch[i] = make_pair(static_cast<int>(gen() >> 1), -i);
+    }
+
+    cout << "Tree: " << n << ", batch: " << m << endl;
+    AVLTree<int, int> byInsert, byBatch;
+    for(int i = 0; i < n; i++) {
+        byInsert.insert(base[i]);
+        byBatch.insert(base[i]);
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(int i = 0; i < m; i++) {
+        byInsert.insert(batch[i]);
+    }
+    double insertTime = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    byBatch.insert_batch(batch.begin(), batch.end());
+    double batchTime = secondsSince(start);
+
+    cout << "batch, insert loop:   " << insertTime * 1e3 << " ms" << endl;
+    cout << "batch, insert_batch:  " << batchTime * 1e3 << " ms" << endl;
+    if(byInsert.size() != byBatch.size()) {
+        cout << "size mismatch" << endl;
+    }
+}
+
+// Builds the same random tree with pointer nodes and with index linked
+// slots and compares build time, find throughput and node memory.
+void benchCompact(int n, int lookups)
+{
+    mt19937 gen(24680);
+    vector<int> keys(n);
+    for(int i = 0; i < n; i++) {
+        keys[i] = static_cast<int>(gen() >> 1);
+    }
+    vector<int> probes(lookups);
+    for(int i = 0; i < lookups; i++) {
+        probes[i] = keys[gen() % n];
+    }
+
+    cout << "Nodes: " << n << ", lookups: " << lookups << endl;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    AVLTree<int, int> pointers;
+    for(int i = 0; i < n; i++) {
+        pointers.insert(make_pair(keys[i], i));
+    }
+    double pointerBuild = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    CompactAVLTree<int, int> compact;
+    for(int i = 0; i < n; i++) {
+        compact.insert(make_pair(keys[i], i));
+    }
+    double compactBuild = secondsSince(start);
+
+    long long checksum = 0;
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < lookups; i++) {
+        checksum += pointers.find(probes[i])->second;
+    }
+    double pointerFind = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < lookups; i++) {
+        checksum -= compact.find(probes[i])->second;
+    }
+    double compactFind = secondsSince(start);
+
+    cout << "pointer nodes: build " << pointerBuild * 1e3 << " ms, find " << lookups / pointerFind / 1e6
+         << " M/s, " << sizeof(AVLNode<int, int>) * pointers.size() / 1024 << " KiB" << endl;
+    cout << "index slots:   build " << compactBuild * 1e3 << " ms, find " << lookups / compactFind / 1e6
+         << " M/s, " << CompactAVLTree<int, int>::slotSize() * compact.capacity() / 1024 << " KiB" << endl;
+    if(checksum != 0) {
+        cout << "checksum mismatch" << endl;
+    }
+}
+
+// Runs the same inserts, finds, full scan and removes against nodes with
+// and without parent pointers.
+void benchStack(int n, int lookups)
+{
+    mt19937 gen(13579);
+    vector<int> keys(n);
+    for(int i = 0; i < n; i++) {
+        keys[i] = static_cast<int>(gen() >> 1);
+    }
+    vector<int> probes(lookups);
+    for(int i = 0; i < lookups; i++) {
+        probes[i] = keys[gen() % n];
+    }
+
+    cout << "Nodes: " << n << ", lookups: " << lookups << endl;
+    AVLTree<int, int> parents;
+    StackAVLTree<int, int> stacked;
+    double parentTime[4], stackTime[4];
+    long long checksum = 0;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(int i = 0; i < n; i++) {
+        parents.insert(make_pair(keys[i], i));
+    }
+    parentTime[0] = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < n; i++) {
+        stacked.insert(make_pair(keys[i], i));
+    }
+    stackTime[0] = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < lookups; i++) {
+        checksum += parents.find(probes[i])->second;
+    }
+    parentTime[1] = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < lookups; i++) {
+        checksum -= stacked.find(probes[i])->second;
+    }
+    stackTime[1] = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for(AVLTree<int, int>::iterator it = parents.begin(); it != parents.end(); ++it) {
+        checksum += it->second;
+    }
+    parentTime[2] = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for(StackAVLTree<int, int>::iterator it = stacked.begin(); it != stacked.end(); ++it) {
+        checksum -= it->second;
+    }
+    stackTime[2] = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < n; i += 2) {
+        parents.remove(keys[i]);
+    }
+    parentTime[3] = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < n; i += 2) {
+        stacked.remove(keys[i]);
+    }
+    stackTime[3] = secondsSince(start);
+
+    cout << "parent pointers: insert " << parentTime[0] * 1e3 << " ms, find " << lookups / parentTime[1] / 1e6
+         << " M/s, scan " << parentTime[2] * 1e3 << " ms, remove " << parentTime[3] * 1e3 << " ms, "
+         << sizeof(AVLNode<int, int>) << " bytes/node" << endl;
+    cout << "path stack:      insert " << stackTime[0] * 1e3 << " ms, find " << lookups / stackTime[1] / 1e6
+         << " M/s, scan " << stackTime[2] * 1e3 << " ms, remove " << stackTime[3] * 1e3 << " ms, "
+         << StackAVLTree<int, int>::nodeSize() << " bytes/node" << endl;
+    if(checksum != 0 || parents.size() != stacked.size()) {
+        cout << "checksum mismatch" << endl;
+    }
+}
+
+// Full in-order scans of the same tree with and without threads.
+void benchThreaded(int n, int scans)
+{
+    mt19937 gen(11235);
+    AVLTree<int, int> plain;
+    AVLTree<int, int, Threaded<> > threaded;
+    for(int i = 0; i < n; i++) {
+        int key = static_cast<int>(gen() >> 1);
+        plain.insert(make_pair(key, i));
+        threaded.insert(make_pair(key, i));
+    }
+
+    cout << "Nodes: " << n << ", scans: " << scans << endl;
+    long long checksum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(int s = 0; s < scans; s++) {
+        for(AVLTree<int, int>::iterator it = plain.begin(); it != plain.end(); ++it) {
+            checksum += it->second;
+        }
+    }
+    double plainTime = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for(int s = 0; s < scans; s++) {
+        for(AVLTree<int, int, Threaded<> >::iterator it = threaded.begin(); it != threaded.end(); ++it) {
+            checksum -= it->second;
+        }
+    }
+    double threadedTime = secondsSince(start);
+
+    double items = static_cast<double>(n) * scans / 1e6;
+    cout << "scan, parent walk: " << items / plainTime << " M items/s" << endl;
+    cout << "scan, threads:     " << items / threadedTime << " M items/s ("
+         << sizeof(AVLNode<int, int, Threaded<> >) << " bytes/node)" << endl;
+    if(checksum != 0) {
+        cout << "checksum mismatch" << endl;
+    }
+}
+
+// Sums the values over random key ranges, once by walking the range and
+// once from the subtree sums of an Aggregate tree.
+void benchAggregate(int n, int queries)
+{
+    mt19937 gen(31415);
+    AVLTree<int, int, Aggregate<SumOf<long long> > > tree;
+    for(int i = 0; i < n; i++) {
+        tree.insert(make_pair(static_cast<int>(gen() % (4 * n)), i));
+    }
+    vector<pair<int, int> > ranges(queries);
+    for(int i = 0; i < queries; i++) {
+        int lo = static_cast<int>(gen() % (4 * n));
+        ranges[i] = make_pair(lo, lo + static_cast<int>(gen() % n));
+    }
+
+    cout << "Nodes: " << n << ", range queries: " << queries << endl;
+    long long checksum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(int i = 0; i < queries; i++) {
+        tree.for_each_in_range(ranges[i].first, ranges[i].second, [&checksum](const pair<const int, int>& item) {
+            checksum += item.second;
+        });
+    }
+    double scanTime = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < queries; i++) {
+        checksum -= tree.aggregate(ranges[i].first, ranges[i].second);
+    }
+    double aggregateTime = secondsSince(start);
+
+    cout << "range sum, scan:      " << scanTime * 1e6 / queries << " us/query" << endl;
+    cout << "range sum, aggregate: " << aggregateTime * 1e6 / queries << " us/query" << endl;
+    if(checksum != 0) {
+        cout << "checksum mismatch" << endl;
+    }
+}
+
+// The same workload on any map with the BinarySearchTree interface, so
+// that backends can be swapped by type: build, find, full scan, then
+// remove every other key. Fills in seconds per phase.
+template<typename Map>
+long long timeBackend(const vector<int>& keys, const vector<int>& probes, double seconds[4])
+{
+    long long checksum = 0;
+    Map map;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); i++) {
+        map.insert(make_pair(keys[i], static_cast<int>(i)));
+    }
+    seconds[0] = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < probes.size(); i++) {
+        checksum += map.find(probes[i])->second;
+    }
+    seconds[1] = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for(typename Map::iterator it = map.begin(); it != map.end(); ++it) {
+        checksum += it->second;
+    }
+    seconds[2] = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); i += 2) {
+        map.remove(keys[i]);
+    }
+    seconds[3] = secondsSince(start);
+    return checksum;
+}
+
+// AVLTree against the B+ tree engine on random keys, plus memory per key
+// and height for random and ascending insertion order.
+void benchBPlus(int n, int lookups)
+{
+    mt19937 gen(17320);
+    vector<int> keys(n);
+    for(int i = 0; i < n; i++) {
+        keys[i] = static_cast<int>(gen() >> 1);
+    }
+    vector<int> probes(lookups);
+    for(int i = 0; i < lookups; i++) {
+        probes[i] = keys[gen() % n];
+    }
+
+    cout << "Nodes: " << n << ", lookups: " << lookups << endl;
+    double avl[4], bplus[4];
+    long long checksum = timeBackend<AVLTree<int, int> >(keys, probes, avl);
+    checksum -= timeBackend<BPlusTree<int, int> >(keys, probes, bplus);
+
+    BPlusTree<int, int> shuffled, ascending;
+    for(int i = 0; i < n; i++) {
+        shuffled.insert(make_pair(keys[i], i));
+        ascending.insert(make_pair(i, i));
+    }
+
+    cout << "AVLTree:   build " << avl[0] * 1e3 << " ms, find " << lookups / avl[1] / 1e6 << " M/s, scan "
+         << avl[2] * 1e3 << " ms, remove half " << avl[3] * 1e3 << " ms, "
+         << sizeof(AVLNode<int, int>) << " B/key" << endl;
+    cout << "BPlusTree: build " << bplus[0] * 1e3 << " ms, find " << lookups / bplus[1] / 1e6 << " M/s, scan "
+         << bplus[2] * 1e3 << " ms, remove half " << bplus[3] * 1e3 << " ms, "
+         << static_cast<double>(shuffled.bytesUsed()) / shuffled.size() << " B/key, height "
+         << shuffled.height() << " (ascending: " << static_cast<double>(ascending.bytesUsed()) / ascending.size()
+         << " B/key)" << endl;
+    if(checksum != 0) {
+        cout << "checksum mismatch" << endl;
+    }
+}
+
+// Lookups in the pointer tree against its frozen Eytzinger copy. The
+// dependent loop feeds each result into the next probe, so it measures
+// latency rather than how many misses the core can overlap.
+void benchFrozen(int n, int lookups)
+{
+    mt19937 gen(14142);
+    AVLTree<int, int> tree;
+    vector<int> keys(n);
+    for(int i = 0; i < n; i++) {
+        keys[i] = static_cast<int>(gen() >> 1);
+        tree.insert(make_pair(keys[i], i));
+    }
+    vector<int> probes(lookups);
+    for(int i = 0; i < lookups; i++) {
+        probes[i] = keys[gen() % n];
+    }
+
+    cout << "Nodes: " << n << ", lookups: " << lookups << endl;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    FrozenAVLTree<int, int> frozen = tree.freeze();
+    double freezeTime = secondsSince(start);
+
+    long long checksum = 0;
+    double treeTime[2], frozenTime[2];
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < lookups; i++) {
+        checksum += tree.find(probes[i])->second;
+    }
+    treeTime[0] = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < lookups; i++) {
+        checksum -= frozen.find(probes[i])->second;
+    }
+    frozenTime[0] = secondsSince(start);
+
+    int carry = 0;
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < lookups; i++) {
+        carry = tree.find(keys[(probes[i] ^ carry) % n])->second & 1;
+        checksum += carry;
+    }
+    treeTime[1] = secondsSince(start);
+    carry = 0;
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < lookups; i++) {
+        carry = frozen.find(keys[(probes[i] ^ carry) % n])->second & 1;
+        checksum -= carry;
+    }
+    frozenTime[1] = secondsSince(start);
+
+    cout << "freeze:                 " << freezeTime * 1e3 << " ms" << endl;
+    cout << "find, AVLTree:          " << lookups / treeTime[0] / 1e6 << " M/s" << endl;
+    cout << "find, frozen:           " << lookups / frozenTime[0] / 1e6 << " M/s" << endl;
+    cout << "dependent find, AVLTree: " << treeTime[1] * 1e9 / lookups << " ns" << endl;
+    cout << "dependent find, frozen:  " << frozenTime[1] * 1e9 / lookups << " ns" << endl;
+    if(checksum != 0) {
+        cout << "checksum mismatch" << endl;
+    }
+}
+
+// Batched lookups: find_many() against a loop of find(), on random and
+// on sorted batches of keys.
+void benchFindMany(int n, int lookups, int batch)
+{
+    mt19937 gen(16180);
+    AVLTree<int, int> tree;
+    vector<int> keys(n);
+    for(int i = 0; i < n; i++) {
+        keys[i] = static_cast<int>(gen() >> 1);
+        tree.insert(make_pair(keys[i], i));
+    }
+    vector<int> probes(lookups);
+    for(int i = 0; i < lookups; i++) {
+        probes[i] = keys[gen() % n];
+    }
+    vector<int> sortedProbes(probes);
+    for(int i = 0; i + batch <= lookups; i += batch) {
+        sort(sortedProbes.begin() + i, sortedProbes.begin() + i + batch);
+    }
+
+    cout << "Nodes: " << n << ", lookups: " << lookups << " in batches of " << batch << endl;
+    vector<AVLTree<int, int>::iterator> found(batch);
+    long long checksum = 0;
+    double loopTime[2], manyTime[2];
+    const vector<int>* inputs[2] = { &probes, &sortedProbes };
+    for(int k = 0; k < 2; k++) {
+        const vector<int>& in = *inputs[k];
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(int i = 0; i + batch <= lookups; i += batch) {
+            for(int j = 0; j < batch; j++) {
+                found[j] = tree.find(in[i + j]);
+            }
+            checksum += found[batch - 1]->second;
+        }
+        loopTime[k] = secondsSince(start);
+        start = chrono::steady_clock::now();
+        for(int i = 0; i + batch <= lookups; i += batch) {
+            tree.find_many(in.begin() + i, in.begin() + i + batch, found.begin());
+            checksum -= found[batch - 1]->second;
+        }
+        manyTime[k] = secondsSince(start);
+    }
+
+    cout << "random, find loop:  " << lookups / loopTime[0] / 1e6 << " M/s" << endl;
+    cout << "random, find_many:  " << lookups / manyTime[0] / 1e6 << " M/s" << endl;
+    cout << "sorted, find loop:  " << lookups / loopTime[1] / 1e6 << " M/s" << endl;
+    cout << "sorted, find_many:  " << lookups / manyTime[1] / 1e6 << " M/s" << endl;
+    if(checksum != 0) {
+        cout << "checksum mismatch" << endl;
+    }
+}
+
+// Sequential ingest: ascending keys hit the cached rightmost node, and a
+// correct hint (here the previous insert, for descending keys) skips the
+// descent too.
+void benchAppend(int n)
+{
+    cout << "Sequential inserts: " << n << endl;
+    double ascendingTime, descendingTime, hintedTime;
+    long long checksum = 0;
+    {
+        AVLTree<long long, int> tree;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(int i = 0; i < n; i++) {
+            tree.insert(make_pair(1000000000LL + i, i));
+        }
+        ascendingTime = secondsSince(start);
+        checksum += tree.size();
+    }
+    {
+        AVLTree<long long, int> tree;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(int i = n; i > 0; i--) {
+            tree.insert(make_pair(1000000000LL + i, i));
+        }
+        descendingTime = secondsSince(start);
+        checksum -= tree.size();
+    }
+    {
+        AVLTree<long long, int> tree;
+        AVLTree<long long, int>::iterator hint = tree.end();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(int i = n; i > 0; i--) {
+            hint = tree.insert(hint, make_pair(1000000000LL + i, i));
+        }
+        hintedTime = secondsSince(start);
+        checksum += tree.size() - n;
+    }
+    cout << "ascending insert:        " << n / ascendingTime / 1e6 << " M/s" << endl;
+    cout << "descending insert:       " << n / descendingTime / 1e6 << " M/s" << endl;
+    cout << "descending, hinted:      " << n / hintedTime / 1e6 << " M/s" << endl;
+    if(checksum != 0) {
+        cout << "checksum mismatch" << endl;
+    }
+}
+
+// Overlap queries: the MaxEnd-pruned search against checking every interval.
+void benchInterval(int n, int queries)
+{
+    mt19937 gen(27182);
+    IntervalTree<int, int> tree;
+    for(int i = 0; i < n; i++) {
+        int start = static_cast<int>(gen() % (4 * n));
+        tree.insert(start, start + static_cast<int>(gen() % 64), i);
+    }
+    vector<pair<int, int> > ranges(queries);
+    for(int i = 0; i < queries; i++) {
+        int lo = static_cast<int>(gen() % (4 * n));
+        ranges[i] = make_pair(lo, lo + 1 + static_cast<int>(gen() % 64));
+    }
+
+    cout << "Intervals: " << n << ", overlap queries: " << queries << endl;
+    long long checksum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(int i = 0; i < queries; i++) {
+        for(IntervalTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it) {
+            if(it->first.start < ranges[i].second && ranges[i].first < it->first.end) {
+                checksum += it->second;
+            }
+        }
+    }
+    double scanTime = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < queries; i++) {
+        vector<IntervalTree<int, int>::iterator> found = tree.overlapping(ranges[i].first, ranges[i].second);
+        for(size_t j = 0; j < found.size(); j++) {
+            checksum -= found[j]->second;
+        }
+    }
+    double searchTime = secondsSince(start);
+
+    cout << "overlapping, scan:   " << scanTime * 1e6 / queries << " us/query" << endl;
+    cout << "overlapping, search: " << searchTime * 1e6 / queries << " us/query" << endl;
+    if(checksum != 0) {
+        cout << "checksum mismatch" << endl;
+    }
+}
+
+// One thread's share of a 90% find / 10% insert-or-remove workload: op
+// gets kind 0 (insert) or 1 (remove) for one draw in ten, else a find.
+template<typename Op>
+void mixedWorkload(int keyRange, int ops, unsigned seed, Op op)
+{
+    mt19937 gen(seed);
+    for(int i = 0; i < ops; i++) {
+        int key = static_cast<int>(gen() % keyRange);
+        op(gen() % 20, key);
+    }
+}
+
+template<typename Op>
+double timeThreads(unsigned threads, int keyRange, int ops, Op op)
+{
+    vector<thread> workers;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(unsigned t = 0; t < threads; t++) {
+        workers.push_back(thread(mixedWorkload<Op>, keyRange, ops, t + 1, op));
+    }
+    for(unsigned t = 0; t < threads; t++) {
+        workers[t].join();
+    }
+    return secondsSince(start);
+}
+
+// Whole-tree walks on a list-shaped tree (ascending keys into a plain BST)
+// and on an AVL tree of the same size. No walk recurses, so depth n is as
+// safe as depth log n.
+void benchDeepWalks(int n)
+{
+    cout << "Deep walks: " << n << endl;
+    BinarySearchTree<int, string> list;
+    AVLTree<int, string> avl;
+    for(int i = 0; i < n; i++) {
+        list.insert(make_pair(i, string()));
+        avl.insert(make_pair(i, string()));
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bool listBalanced = list.isBalanced();
+    double listCheckTime = secondsSince(start);
+    start = chrono::steady_clock::now();
+    bool avlBalanced = avl.isBalanced();
+    double avlCheckTime = secondsSince(start);
+    start = chrono::steady_clock::now();
+    list.clear();
+    double listClearTime = secondsSince(start);
+    start = chrono::steady_clock::now();
+    avl.clear();
+    double avlClearTime = secondsSince(start);
+    cout << "list isBalanced:   " << listCheckTime * 1e6 << " us" << endl;
+    cout << "AVL isBalanced:    " << avlCheckTime * 1e3 << " ms" << endl;
+    cout << "list clear:        " << listClearTime * 1e3 << " ms" << endl;
+    cout << "AVL clear:         " << avlClearTime * 1e3 << " ms" << endl;
+    if(listBalanced || !avlBalanced) {
+        cout << "balance mismatch" << endl;
+    }
+}
+
+// Throughput of the 90/10 workload on an AVLTree behind one mutex against
+// the optimistic ConcurrentAVLTree, for growing numbers of threads.
+void benchConcurrent(int keyRange, int ops)
+{
+    AVLTree<int, int> locked;
+    mutex lock;
+    ConcurrentAVLTree<int, int> concurrent;
+    for(int key = 0; key < keyRange; key += 2) {
+        locked.insert(make_pair(key, key));
+        concurrent.insert(make_pair(key, key));
+    }
+
+    cout << "Keys: " << keyRange << ", ops per thread: " << ops << " (90% find)" << endl;
+    unsigned maxThreads = max(thread::hardware_concurrency(), 1u);
+    for(unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        double lockedTime = timeThreads(threads, keyRange, ops, [&](unsigned kind, int key) {
+            lock_guard<mutex> guard(lock);
+            if(kind == 0) {
+                locked.insert(make_pair(key, key));
+            }
+            else if(kind == 1) {
+                locked.remove(key);
+            }
+            else {
+                locked.find(key);
+            }
+        });
+        double concurrentTime = timeThreads(threads, keyRange, ops, [&](unsigned kind, int key) {
+            int value;
+            if(kind == 0) {
+                concurrent.insert(make_pair(key, key));
+            }
+            else if(kind == 1) {
+                concurrent.remove(key);
+            }
+            else {
+                concurrent.find(key, value);
+            }
+        });
+        double total = static_cast<double>(threads) * ops / 1e6;
+        cout << threads << " threads, global mutex: " << total / lockedTime << " M/s, optimistic: "
+             << total / concurrentTime << " M/s" << endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int lookups = 1 << 22;
+    if(argc > 2) {
+        lookups = atoi(argv[2]);
+    }
+
+    cout << "sizeof(AVLNode<int,int>): " << sizeof(AVLNode<int, int>)
+         << ", with vptr: " << sizeof(VirtualAVLNode) << endl;
+
+    if(argc > 1) {
+        benchFind(atoi(argv[1]), lookups);
+    }
+    else {
+        // one tree that fits in cache, one that does not
+        benchFind(1 << 14, lookups);
+        benchFind(1 << 20, lookups);
+        benchUnion(1 << 20, 1 << 14);
+        benchUnion(1 << 20, 1 << 20);
+        benchBatch(1 << 20, 1 << 14);
+        benchBatch(1 << 20, 1 << 17);
+        benchBatch(1 << 20, 1 << 18);
+        benchCompact(1 << 14, lookups);
+        benchCompact(1 << 20, lookups);
+        benchStack(1 << 14, lookups);
+        benchStack(1 << 20, lookups);
+        benchThreaded(1 << 14, 256);
+        benchThreaded(1 << 20, 4);
+        benchAggregate(1 << 20, 1 << 8);
+        benchInterval(1 << 20, 1 << 6);
+        benchAppend(1 << 20);
+        benchFindMany(1 << 14, lookups, 256);
+        benchFindMany(1 << 22, lookups, 256);
+        benchFrozen(1 << 14, lookups);
+        benchFrozen(1 << 22, lookups);
+        benchBPlus(1 << 14, lookups);
+        benchBPlus(1 << 22, lookups);
+        benchDeepWalks(1 << 20);
+        benchConcurrent(1 << 20, 1 << 20);
+    }
+    return 0;
+}
@@ -1,7 +1,17 @@
 #include <iostream>
 #include <map>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <thread>
 #include "bst.h"
 #include "avlbst.h"
+#include "concurrent_avlbst.h"
+#include "persistent_avlbst.h"
+#include "compact_avlbst.h"
+#include "stack_avlbst.h"
+#include "interval_avlbst.h"
+#include "bplustree.h"
 
 using namespace std;
 
@@ -44,5 +54,367 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
+    // Node pool tests
+    AVLTree<int,int> pt;
+    pt.reserve(1000);
+    for(int i = 0; i < 1000; i++) {
+        pt.insert(std::make_pair(i, i * 2));
+    }
+    for(int i = 0; i < 1000; i += 2) {
+        pt.remove(i);
+    }
+    cout << "\nPool tree balanced: " << pt.isBalanced() << endl;
+    cout << "pt[999] = " << pt[999] << endl;
+    pt.clear();
+    cout << "Empty after clear: " << pt.empty() << endl;
+
+    // Upsert tests
+    AVLTree<char,int> counts;
+    const char* word = "mississippi";
+    for(const char* c = word; *c != '\0'; c++) {
+        counts[*c]++;
+    }
+    cout << "\nLetter counts:" << endl;
+    for(AVLTree<char,int>::iterator it = counts.begin(); it != counts.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "try_emplace existing inserted: " << counts.try_emplace('s', 100).second << endl;
+    cout << "insert_or_assign new inserted: " << counts.insert_or_assign('z', 26).second << endl;
+    counts.upsert('z', [](int& v) { v *= 2; });
+    cout << "z after upsert: " << counts.at('z') << endl;
+
+    // Bulk load tests
+    std::vector<std::pair<int,int> > sortedDump;
+    for(int i = 0; i < 100; i++) {
+        sortedDump.push_back(std::make_pair(i * 10, i));
+    }
+    AVLTree<int,int> loaded(sortedDump.begin(), sortedDump.end());
+    cout << "\nBulk loaded tree balanced: " << loaded.isBalanced() << endl;
+    cout << "loaded[500] = " << loaded.at(500) << endl;
+
+    // Order statistic tests
+    AVLTree<int,int,OrderStatistics> ranked(sortedDump.begin(), sortedDump.end());
+    ranked.remove(0);
+    cout << "\nSize: " << ranked.size() << endl;
+    cout << "Median key: " << ranked.select(ranked.size() / 2)->first << endl;
+    cout << "Rank of 250: " << ranked.rank(250) << endl;
+    cout << "Keys in [100, 200): " << ranked.count_range(100, 200) << endl;
+
+    // Range query tests
+    cout << "\nlower_bound(245): " << loaded.lower_bound(245)->first << endl;
+    cout << "upper_bound(250): " << loaded.upper_bound(250)->first << endl;
+    cout << "floor(245): " << loaded.floor(245)->first << endl;
+    cout << "Keys in [300, 350):";
+    loaded.for_each_in_range(300, 350, [](std::pair<const int,int>& item) {
+        cout << " " << item.first;
+    });
+    cout << endl;
+
+    // Range erase tests
+    cout << "\nErased from [200, 800): " << loaded.erase_range(200, 800) << endl;
+    cout << "Size after erase: " << loaded.size() << endl;
+    cout << "Balanced after erase: " << loaded.isBalanced() << endl;
+
+    // Split and join tests
+    AVLTree<int, int> upper = loaded.split(900);
+    cout << "\nSplit at 900: " << loaded.size() << " below, " << upper.size() << " above" << endl;
+    cout << "Smallest above: " << upper.begin()->first << endl;
+    try {
+        AVLTree<int, int>::join(upper, loaded);
+    }
+    catch(const std::invalid_argument&) {
+        cout << "Join of overlapping trees rejected" << endl;
+    }
+    AVLTree<int, int> rejoined = AVLTree<int, int>::join(loaded, upper);
+    cout << "Rejoined size: " << rejoined.size() << ", balanced: " << rejoined.isBalanced() << endl;
+
+    // Set operation tests
+    AVLTree<int, int> evens, threes;
+    for(int i = 0; i < 30; i += 2) {
+        evens.insert(make_pair(i, 2));
+    }
+    for(int i = 0; i < 30; i += 3) {
+        threes.insert(make_pair(i, 3));
+    }
+    AVLTree<int, int> common(evens.begin(), evens.end());
+    common.intersect_with(threes);
+    cout << "\nMultiples of 6:";
+    for(AVLTree<int, int>::iterator it = common.begin(); it != common.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+    evens.difference_with(common);
+    cout << "Evens without multiples of 6: " << evens.size() << endl;
+    evens.union_with(threes);
+    cout << "Union size: " << evens.size() << ", value at 6: " << evens[6]
+         << ", balanced: " << evens.isBalanced() << endl;
+
+    // Concurrent tree tests
+    ConcurrentAVLTree<int, int> shared;
+    vector<thread> writers;
+    for(int t = 0; t < 4; t++) {
+        writers.push_back(thread([&shared, t]() {
+            for(int i = t; i < 4000; i += 4) {
+                shared.insert(make_pair(i, i));
+            }
+            for(int i = t; i < 4000; i += 8) {
+                shared.remove(i);
+            }
+        }));
+    }
+    for(size_t t = 0; t < writers.size(); t++) {
+        writers[t].join();
+    }
+    int found = -1;
+    cout << "\nConcurrent size: " << shared.size() << ", balanced: " << shared.isBalanced() << endl;
+    cout << "Find 1004: " << shared.find(1004, found) << " -> " << found << ", find 1000: " << shared.contains(1000) << endl;
+    int inRange = 0;
+    shared.for_each_in_range(100, 200, [&inRange](const int&, const int&) { inRange++; });
+    cout << "Keys in [100, 200): " << inRange << endl;
+
+    // Persistent tree tests
+    PersistentAVLTree<int, int> versioned;
+    for(int i = 0; i < 100; i++) {
+        versioned.insert(make_pair(i, i));
+    }
+    PersistentAVLTree<int, int>::Snapshot before = versioned.snapshot();
+    for(int i = 0; i < 100; i += 2) {
+        versioned.remove(i);
+    }
+    versioned.insert(make_pair(1, -1));
+    long long snapshotSum = 0;
+    thread reader([&before, &snapshotSum]() {
+        for(PersistentAVLTree<int, int>::iterator it = before.begin(); it != before.end(); ++it) {
+            snapshotSum += it->second;
+        }
+    });
+    reader.join();
+    cout << "\nSnapshot size: " << before.size() << ", sum: " << snapshotSum
+         << ", value at 1: " << before.find(1)->second << endl;
+    cout << "Live size: " << versioned.size() << ", value at 1: " << versioned.find(1)->second
+         << ", balanced: " << versioned.isBalanced() << endl;
+
+    // Batch tests
+    AVLTree<int, int> batched;
+    vector<pair<int, int> > updates;
+    for(int i = 0; i < 20; i++) {
+        updates.push_back(make_pair(i % 15, i));
+    }
+    vector<bool> added = batched.insert_batch(updates.begin(), updates.end());
+    cout << "\nBatch insert: " << batched.size() << " keys, first new: " << added[0]
+         << ", repeat new: " << added[15] << ", value at 2: " << batched[2] << endl;
+    vector<int> doomed;
+    doomed.push_back(3);
+    doomed.push_back(99);
+    doomed.push_back(3);
+    vector<bool> erased = batched.erase_batch(doomed.begin(), doomed.end());
+    cout << "Batch erase: " << erased[0] << erased[1] << erased[2] << ", size: " << batched.size()
+         << ", balanced: " << batched.isBalanced() << endl;
+
+    // Move and emplace tests
+    AVLTree<string, string> names;
+    string bigValue(4096, 'x');
+    names.insert(make_pair(string("moved"), std::move(bigValue)));
+    names.emplace(std::piecewise_construct, std::forward_as_tuple("built"), std::forward_as_tuple(3, 'y'));
+    names.try_emplace(string("tried"), "z");
+    bool emplacedAgain = names.emplace("built", "ignored").second;
+    cout << "\nMoved value length: " << names["moved"].size() << ", built: " << names["built"] << ", emplaced again: " << emplacedAgain << endl;
+    names.insert({"braced", "ok"});
+    names.insert(names.end(), {"hinted", "ok"});
+    cout << "Braced insert: " << names["braced"] << ", hinted: " << names["hinted"] << endl;
+
+    // Comparator tests
+    AVLTree<string, int, NoAugment, StringCompare> paths;
+    paths.insert(make_pair(string("/usr/bin"), 1));
+    paths.insert(make_pair(string("/usr/lib"), 2));
+    paths.insert(make_pair(string("/etc"), 3));
+    string_view probe("/usr/lib/x86_64", 8);
+    cout << "\nFind by string_view: " << paths.find(probe)->second << ", first: " << paths.begin()->first
+         << ", ceiling /f: " << paths.ceiling(string_view("/f"))->first << endl;
+    AVLTree<int, int, NoAugment, std::greater<int> > descending;
+    for(int i = 0; i < 5; i++) {
+        descending.insert(make_pair(i, i));
+    }
+    cout << "Descending:";
+    for(AVLTree<int, int, NoAugment, std::greater<int> >::iterator it = descending.begin(); it != descending.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+    AVLTree<int, int, OrderStatistics, std::greater<int> > countdown;
+    for(int i = 0; i < 10; i++) {
+        countdown.insert(make_pair(i, i));
+    }
+    size_t countdownCount = countdown.count_range(7, 3);
+    size_t countdownBackwards = countdown.count_range(3, 7);
+    size_t countdownErased = countdown.erase_range(7, 3);
+    cout << "Descending count_range(7, 3): " << countdownCount << ", (3, 7): " << countdownBackwards
+         << ", erase_range(7, 3): " << countdownErased << ", left: " << countdown.size() << endl;
+
+    // Compact tree tests
+    CompactAVLTree<int, string> compact;
+    for(int i = 0; i < 100; i++) {
+        compact.insert(make_pair(i, to_string(i)));
+    }
+    for(int i = 0; i < 100; i += 3) {
+        compact.remove(i);
+    }
+    compact[1000] = "last";
+    cout << "\nCompact tree size: " << compact.size() << ", balanced: " << compact.isBalanced()
+         << ", find 50: " << compact.find(50)->second << ", lower_bound 51: " << compact.lower_bound(51)->first
+         << ", bytes per int slot: " << CompactAVLTree<int, int>::slotSize() << endl;
+
+    // Stack tree tests
+    StackAVLTree<int, int> stacked;
+    for(int i = 0; i < 64; i++) {
+        stacked.insert(make_pair(i, i * i));
+    }
+    for(int i = 0; i < 64; i += 2) {
+        stacked.remove(i);
+    }
+    cout << "\nStack tree size: " << stacked.size() << ", balanced: " << stacked.isBalanced() << ", from 57:";
+    for(StackAVLTree<int, int>::iterator it = stacked.lower_bound(56); it != stacked.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+    pair<StackAVLTree<int, int>::iterator, bool> stackedAt = stacked.insert(make_pair(58, -1));
+    stacked[100] += 7;
+    cout << "Stack insert 58 new: " << stackedAt.second << ", value: " << stackedAt.first->second
+         << ", next: " << (++stackedAt.first)->first << ", [100]: " << stacked[100] << endl;
+
+    // Threaded tree tests
+    AVLTree<int, int, Threaded<OrderStatistics> > threaded;
+    for(int i = 0; i < 40; i++) {
+        threaded.insert(make_pair((i * 7) % 40, i));
+    }
+    threaded.erase_range(10, 30);
+    AVLTree<int, int, Threaded<OrderStatistics> > above = threaded.split(35);
+    cout << "\nThreaded tree:";
+    for(AVLTree<int, int, Threaded<OrderStatistics> >::iterator it = threaded.begin(); it != threaded.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << " | split off " << above.size() << ", rank of 31: " << threaded.rank(31) << endl;
+
+    // Reverse iteration tests
+    AVLTree<int, string> log;
+    for(int i = 1; i <= 10; i++) {
+        log.insert(make_pair(i * 100, "entry " + to_string(i)));
+    }
+    cout << "\nLatest three:";
+    int shown = 0;
+    for(AVLTree<int, string>::const_reverse_iterator it = log.crbegin(); it != log.crend() && shown < 3; ++it, ++shown) {
+        cout << " " << it->first;
+    }
+    AVLTree<int, string>::iterator last = log.end();
+    --last;
+    AVLTree<int, string>::iterator previous = log.lower_bound(550);
+    --previous;
+    cout << ", --end(): " << last->second << ", before 550: " << previous->first << endl;
+
+    // Aggregate tests
+    AVLTree<int, int, Aggregate<SumOf<int>, OrderStatistics> > sums;
+    AVLTree<int, int, Aggregate<MaxOf<int> > > maxima;
+    for(int i = 0; i < 20; i++) {
+        sums.insert(make_pair(i, i));
+        maxima.insert(make_pair(i, (i * 7) % 20));
+    }
+    sums.setValue(5, 100);
+    sums.upsert(6, [](int& v) { v += 10; });
+    sums.remove(7);
+    cout << "\nSum of [4, 9): " << sums.aggregate(4, 9) << ", over " << sums.count_range(4, 9)
+         << " keys, max of [0, 5): " << maxima.aggregate(0, 5) << endl;
+
+    // Interval tree tests
+    IntervalTree<int, string> bookings;
+    bookings.insert(9, 12, "standup");
+    bookings.insert(10, 11, "review");
+    bookings.insert(13, 17, "workshop");
+    bookings.insert(15, 16, "call");
+    bookings.insert(11, 12, "lunch");
+    cout << "\nBusy at 11:";
+    vector<IntervalTree<int, string>::iterator> busy = bookings.stabbing(11);
+    for(size_t i = 0; i < busy.size(); i++) {
+        cout << " " << busy[i]->second;
+    }
+    bookings.remove(13, 17);
+    cout << ", overlapping [12, 16):";
+    vector<IntervalTree<int, string>::iterator> clash = bookings.overlapping(12, 16);
+    for(size_t i = 0; i < clash.size(); i++) {
+        cout << " " << clash[i]->first;
+    }
+    cout << ", morning:";
+    bookings.for_each_overlapping(0, 12, [](const pair<const Interval<int>, string>& booking) {
+        cout << " " << booking.second;
+    });
+    cout << endl;
+
+    // Hinted insert tests
+    AVLTree<int, int> ticks;
+    for(int i = 0; i < 100; i++) {
+        ticks.insert(make_pair(i * 10, i));
+    }
+    AVLTree<int, int>::iterator hint = ticks.find(500);
+    for(int i = 9; i > 0; i--) {
+        hint = ticks.insert(hint, make_pair(490 + i, -i));
+    }
+    ticks.insert(ticks.begin(), make_pair(995, 0));
+    ticks.remove(990);
+    ticks.insert(make_pair(2000, 1));
+    cout << "\nHinted: " << ticks.size() << " keys, after 490: " << (++ticks.find(490))->first
+         << ", last: " << ticks.rbegin()->first << ", balanced: " << ticks.isBalanced() << endl;
+
+    // Batched lookup tests
+    vector<int> wanted;
+    for(int i = 0; i < 40; i++) {
+        wanted.push_back(i * 25);
+    }
+    vector<AVLTree<int, int>::iterator> hits(wanted.size());
+    ticks.find_many(wanted.begin(), wanted.end(), hits.begin());
+    int hitCount = 0;
+    for(size_t i = 0; i < hits.size(); i++) {
+        if(hits[i] != ticks.end() && hits[i]->first == wanted[i]) {
+            hitCount++;
+        }
+    }
+    cout << "\nfind_many: " << hitCount << " of " << wanted.size() << " found" << endl;
+
+    // Frozen tree tests
+    FrozenAVLTree<int, int> frozen = ticks.freeze();
+    ticks.insert(make_pair(3000, 0));
+    int frozenSum = 0;
+    frozen.for_each_in_range(490, 500, [&frozenSum](const pair<const int&, const int&>& item) {
+        frozenSum += item.second;
+    });
+    FrozenAVLTree<int, int>::iterator past = frozen.upper_bound(990);
+    cout << "\nFrozen: " << frozen.size() << " keys (tree now " << ticks.size() << "), at(500): " << frozen.at(500)
+         << ", sum of [490, 500): " << frozenSum << ", after 990: " << past->first
+         << ", has 3000: " << (frozen.find(3000) != frozen.end()) << endl;
+
+    // B+ tree tests
+    typedef BPlusTree<int, string, std::less<int>, 4> Pages;
+    Pages pages;
+    for(int i = 0; i < 50; i++) {
+        pages.insert(make_pair(i, "page " + to_string(i)));
+    }
+    for(int i = 0; i < 50; i += 3) {
+        pages.remove(i);
+    }
+    pages[100] = "appendix";
+    cout << "\nB+ tree: " << pages.size() << " keys, height " << pages.height() << ", balanced: "
+         << pages.isBalanced() << ", at(10): " << pages.at(10) << ", from 44:";
+    for(Pages::iterator it = pages.lower_bound(44); it != pages.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+
+    // Deep tree tests
+    BinarySearchTree<int, string> chain;
+    for(int i = 0; i < 200000; i++) {
+        chain.insert(make_pair(i, to_string(i)));
+    }
+    bool chainBalanced = chain.isBalanced();
+    chain.clear();
+    cout << "\nDeep chain: balanced " << chainBalanced << ", empty after clear " << chain.empty()
+         << ", AVL balanced " << ticks.isBalanced() << endl;
+
     return 0;
 }
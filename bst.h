@@ -5,20 +5,36 @@
 #include <exception>
 #include <cstdlib>
 #include <utility>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <tuple>
+#include <functional>
+#include <string_view>
+#include <iterator>
+#include <cstddef>
+#include <climits>
+#include "node_pool.h"
 
 /**
  * A templated class for a Node in a search tree.
- * The getters for parent/left/right are virtual so
- * that they can be overridden for future kinds of
- * search trees, such as Red Black trees, Splay trees,
- * and AVL trees.
+ * Nothing here is virtual: derived node types (such as
+ * AVLNode) hide the getters for parent/left/right with
+ * versions that return their own type, and the tree is
+ * told the concrete node type through a template
+ * parameter, so every step of a descent is a plain load
+ * and nodes carry no vtable pointer.
  */
 template <typename Key, typename Value>
 class Node
 {
 public:
-    Node(const Key& key, const Value& value, Node<Key, Value>* parent);
-    virtual ~Node();
+    template<typename K, typename V>
+    Node(K&& key, V&& value, Node<Key, Value>* parent);
+    template<typename... KeyArgs, typename... ValueArgs>
+    Node(std::piecewise_construct_t, std::tuple<KeyArgs...> keyArgs, std::tuple<ValueArgs...> valueArgs,
+         Node<Key, Value>* parent);
+    ~Node();
 
     const std::pair<const Key, Value>& getItem() const;
     std::pair<const Key, Value>& getItem();
@@ -26,14 +42,15 @@ public:
     const Value& getValue() const;
     Value& getValue();
 
-    virtual Node<Key, Value>* getParent() const;
-    virtual Node<Key, Value>* getLeft() const;
-    virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getParent() const;
+    Node<Key, Value>* getLeft() const;
+    Node<Key, Value>* getRight() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
+    void setValue(Value&& value);
 
 protected:
     std::pair<const Key, Value> item_;
@@ -49,11 +66,29 @@ protected:
 */
 
 /**
-* Explicit constructor for a node.
+* Explicit constructor for a node. key and value are forwarded into the
+* item, so rvalues are moved in rather than copied.
 */
 template<typename Key, typename Value>
-Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* parent) :
-    item_(key, value),
+template<typename K, typename V>
+Node<Key, Value>::Node(K&& key, V&& value, Node<Key, Value>* parent) :
+    item_(std::forward<K>(key), std::forward<V>(value)),
+    parent_(parent),
+    left_(NULL),
+    right_(NULL)
+{
+
+}
+
+/**
+* Builds the key and the value in place from the arguments in keyArgs and
+* valueArgs, like std::pair's piecewise constructor.
+*/
+template<typename Key, typename Value>
+template<typename... KeyArgs, typename... ValueArgs>
+Node<Key, Value>::Node(std::piecewise_construct_t, std::tuple<KeyArgs...> keyArgs, std::tuple<ValueArgs...> valueArgs,
+                       Node<Key, Value>* parent) :
+    item_(std::piecewise_construct, std::move(keyArgs), std::move(valueArgs)),
     parent_(parent),
     left_(NULL),
     right_(NULL)
@@ -118,7 +153,7 @@ Value& Node<Key, Value>::getValue()
 }
 
 /**
-* An implementation of the virtual function for retreiving the parent.
+* A getter for the parent.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
@@ -127,7 +162,7 @@ Node<Key, Value>* Node<Key, Value>::getParent() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the left child.
+* A getter for the left child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const
@@ -136,7 +171,7 @@ Node<Key, Value>* Node<Key, Value>::getLeft() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the right child.
+* A getter for the right child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getRight() const
@@ -180,37 +215,130 @@ void Node<Key, Value>::setValue(const Value& value)
     item_.second = value;
 }
 
+/**
+* Moves value into the node.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setValue(Value&& value)
+{
+    item_.second = std::move(value);
+}
+
 /*
   ---------------------------------------
   End implementations for the Node class.
   ---------------------------------------
 */
 
+/**
+* How the trees order their keys. Compare is either a less-than predicate
+* returning bool (std::less<Key> by default), or a three-way comparator
+* returning a negative, zero or positive number, in which case a single
+* call per level tells a descent which way to go. A fresh Compare is
+* default constructed for each comparison, so it must be stateless.
+*/
+template<typename Compare>
+struct KeyOrder
+{
+    template<typename A, typename B>
+    static int compare(const A& a, const B& b)
+    {
+        if constexpr(std::is_same<decltype(Compare()(a, b)), bool>::value) {
+            return Compare()(a, b) ? -1 : (Compare()(b, a) ? 1 : 0);
+        }
+        else {
+            auto c = Compare()(a, b);
+            return (c > 0) - (c < 0);
+        }
+    }
+
+    template<typename A, typename B>
+    static bool less(const A& a, const B& b)
+    {
+        if constexpr(std::is_same<decltype(Compare()(a, b)), bool>::value) {
+            return Compare()(a, b);
+        }
+        else {
+            return Compare()(a, b) < 0;
+        }
+    }
+};
+
+/**
+* True for node types that keep in-order threads, i.e. links to the
+* previous and next node by key (see Threaded in avlbst.h). The tree then
+* steps through them instead of walking the parent chain and keeps them
+* up to date wherever nodes come and go.
+*/
+template<typename NodeT, typename = void>
+struct HasThreads : std::false_type
+{
+};
+
+template<typename NodeT>
+struct HasThreads<NodeT, std::void_t<decltype(std::declval<NodeT&>().getNext())> > : std::true_type
+{
+};
+
+/**
+* Three-way comparator for string keys: one pass over the characters per
+* level. It is transparent, so lookups take a std::string_view (or
+* anything that converts to one) without building a std::string.
+*/
+struct StringCompare
+{
+    typedef void is_transparent;
+
+    int operator()(std::string_view a, std::string_view b) const
+    {
+        return a.compare(b);
+    }
+};
+
 /**
 * A templated unbalanced binary search tree.
+* NodeT is the concrete node type stored in the tree. It must derive from
+* Node<Key, Value> and provide getParent/getLeft/getRight returning NodeT*.
+* Compare orders the keys, see KeyOrder. When it has an is_transparent
+* member type, the lookups below also accept any key type it can compare
+* with Key.
 */
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename NodeT = Node<Key, Value>, typename Compare = std::less<Key> >
 class BinarySearchTree
 {
 public:
     BinarySearchTree(); //TODO
+    BinarySearchTree(BinarySearchTree&& other);
+    BinarySearchTree& operator=(BinarySearchTree&& other);
+    // nodes belong to exactly one tree, so trees are moved, never copied
+    BinarySearchTree(const BinarySearchTree& other) = delete;
+    BinarySearchTree& operator=(const BinarySearchTree& other) = delete;
     virtual ~BinarySearchTree(); //TODO
-    virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
     void clear(); //TODO
+    void reserve(std::size_t n);
     bool isBalanced() const; //TODO
     void print() const;
     bool empty() const;
+    std::size_t size() const;
 
-    template<typename PPKey, typename PPValue>
-    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    template<typename PPKey, typename PPValue, typename PPNode, typename PPCompare>
+    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue, PPNode, PPCompare> & tree);
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
+    * It is bidirectional: end() can be stepped back to the largest item,
+    * which is why the iterator also remembers its tree.
     */
     class iterator  // TODO
     {
     public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
         iterator();
 
         std::pair<const Key,Value>& operator*() const;
@@ -220,44 +348,176 @@ public:
         bool operator!=(const iterator& rhs) const;
 
         iterator& operator++();
+        iterator& operator--();
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
-        Node<Key, Value> *current_;
+        friend class BinarySearchTree<Key, Value, NodeT, Compare>;
+        iterator(NodeT* ptr, const BinarySearchTree* tree);
+        NodeT* current_;
+        const BinarySearchTree* tree_;
     };
 
+    /**
+    * The same walk with read-only access to the items. An iterator
+    * converts to a const_iterator, not the other way round.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator& operator--();
+
+    private:
+        friend class BinarySearchTree<Key, Value, NodeT, Compare>;
+        iterator it_;
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
 public:
     iterator begin() const;
     iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
     iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    iterator floor(const Key& key) const;
+    iterator ceiling(const Key& key) const;
+    // heterogeneous versions, only there for a transparent Compare
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator lower_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator upper_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    std::pair<iterator, iterator> equal_range(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator floor(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator ceiling(const K& key) const;
+    template<typename F>
+    void for_each_in_range(const Key& lo, const Key& hi, F fn) const;
+    template<typename ForwardIt, typename OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const;
+    virtual std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair); //TODO
+    std::pair<iterator, bool> insert(std::pair<const Key, Value>&& keyValuePair);
+    template<typename P, typename = typename std::enable_if<std::is_constructible<std::pair<const Key, Value>, P&&>::value>::type>
+    std::pair<iterator, bool> insert(P&& keyValuePair);
+    iterator insert(const_iterator hint, const std::pair<const Key, Value>& keyValuePair);
+    template<typename P, typename = typename std::enable_if<std::is_constructible<std::pair<const Key, Value>, P&&>::value>::type>
+    iterator insert(const_iterator hint, P&& keyValuePair);
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(const Key& key, M&& obj);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(Key&& key, M&& obj);
+    template<typename F>
+    std::pair<iterator, bool> upsert(const Key& key, F fn);
     Value& operator[](const Key& key);
+    Value& operator[](Key&& key);
     Value const & operator[](const Key& key) const;
+    Value& at(const Key& key);
+    Value const & at(const Key& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    Value& at(const K& key);
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    Value const & at(const K& key) const;
 
 protected:
     // Mandatory helper functions
-    Node<Key, Value>* internalFind(const Key& k) const; // TODO
-    Node<Key, Value> *getSmallestNode() const;  // TODO
-    static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
+    template<typename K>
+    NodeT* internalFind(const K& k) const; // TODO
+    iterator makeIterator(NodeT* node) const;
+    template<typename K>
+    NodeT* internalLowerBound(const K& key) const;
+    template<typename K>
+    NodeT* internalUpperBound(const K& key) const;
+    template<typename K>
+    NodeT* internalFloor(const K& key) const;
+    NodeT* internalFindSlot(const Key& k, NodeT*& parent, bool& goLeft) const;
+    NodeT* internalFindSlot(const Key& k, NodeT* hint, NodeT*& parent, bool& goLeft) const;
+    NodeT* rightmostNode() const;
+    static void prefetchNode(const NodeT* node);
+    void linkNode(NodeT* node, NodeT* parent, bool goLeft);
+    virtual void afterInsert(NodeT* node);
+    virtual void afterAssign(NodeT* node);
+    NodeT* getSmallestNode() const;  // TODO
+    NodeT* getLargestNode() const;
+    static NodeT* predecessor(NodeT* current); // TODO
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
 
     // Provided helper functions
-    virtual void printRoot (Node<Key, Value> *r) const;
-    virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
+    virtual void printRoot (NodeT* r) const;
+    virtual void nodeSwap( NodeT* n1, NodeT* n2) ;
 
     // Add helper functions here
-    static Node<Key, Value>* successor(Node<Key, Value>* current);
-    int Heightcount (Node<Key, Value>* root, bool& b) const; // added by Huizhen to count the Height
-   // bool HeightBalanced (Node<Key, Value>* root) const; // added by HUizhen to check if it is balanced 
-    void HelptoClear (Node<Key, Value>* current); // helper functioin for clear function 
-    void removeHelp(Node<Key,Value>* current);
-    bool isleftchild(Node<Key,Value>* curr);
-    bool isrightchild(Node<Key,Value>* curr);
-    int numofchild(Node<Key,Value>* curr);
+    static NodeT* successor(NodeT* current);
+    template<typename F>
+    static bool postOrder(NodeT* root, F visit, int maxDepth = INT_MAX);
+    void HelptoClear (NodeT* current); // helper functioin for clear function 
+    template<typename... Args>
+    NodeT* allocateNode(Args&&... args);
+    void freeNode(NodeT* node);
+    std::size_t freeSubtree(NodeT* current);
+    // in-order threads, no-ops unless HasThreads<NodeT>
+    static void linkThreads(NodeT* node, NodeT* prev, NodeT* next);
+    static void unlinkThreads(NodeT* node);
+    static void threadNode(NodeT* node);
+    void rethread();
+    static void threadSubtree(NodeT* node, NodeT*& last);
+    NodePool& pool();
+    void sharePoolWith(BinarySearchTree& other);
+    void resetPool();
+    void removeHelp(NodeT* current);
+    bool isleftchild(NodeT* curr);
+    bool isrightchild(NodeT* curr);
+    int numofchild(NodeT* curr);
 protected:
-    Node<Key, Value>* root_;
+    NodeT* root_;
     // You should not need other data members
+    // number of nodes, or unknownSize after whole subtrees were moved in or
+    // out without anyone counting them (size() recounts lazily)
+    mutable std::size_t size_;
+    // the largest node, so that appends skip the descent; NULL when the
+    // tree is empty or after whole subtrees were moved (found again lazily)
+    mutable NodeT* rightmost_;
+    std::shared_ptr<NodePool> pool_;
+    static const std::size_t unknownSize = static_cast<std::size_t>(-1);
+    // descents find_many() runs side by side, enough to cover a memory
+    // miss with the work of the others
+    static const std::size_t kFindGroup = 16;
+    // no height-balanced tree of up to 2^64 nodes is deeper than this
+    // (the sparsest one of height h has fib(h + 2) - 1 nodes)
+    static const int kMaxBalancedDepth = 92;
 };
 
 /*
@@ -269,29 +529,31 @@ Begin implementations for the BinarySearchTree::iterator class.
 /**
 * Explicit constructor that initializes an iterator with a given node pointer.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
+template<class Key, class Value, class NodeT, class Compare>
+BinarySearchTree<Key, Value, NodeT, Compare>::iterator::iterator(NodeT* ptr, const BinarySearchTree* tree)
 {
     // TODO
     current_ = ptr;
+    tree_ = tree;
 }
 
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() 
+template<class Key, class Value, class NodeT, class Compare>
+BinarySearchTree<Key, Value, NodeT, Compare>::iterator::iterator() 
 {
     // TODO
     current_ = nullptr;
+    tree_ = nullptr;
 }
 
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class NodeT, class Compare>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, NodeT, Compare>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -299,9 +561,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class NodeT, class Compare>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, NodeT, Compare>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -310,10 +572,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class NodeT, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, NodeT, Compare>::iterator::operator==(
+    const BinarySearchTree<Key, Value, NodeT, Compare>::iterator& rhs) const
 {
     return current_==rhs.current_;
 }
@@ -322,10 +584,10 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class NodeT, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, NodeT, Compare>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, NodeT, Compare>::iterator& rhs) const
 {
     // TODO
     return current_!=rhs.current_;
@@ -335,9 +597,9 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
 * Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator&
+BinarySearchTree<Key, Value, NodeT, Compare>::iterator::operator++()
 {
     // TODO
     //current_ == the one next to it, which is the successor 
@@ -345,6 +607,23 @@ BinarySearchTree<Key, Value>::iterator::operator++()
     return *this; 
 }
 
+/**
+* Steps back to the in-order predecessor. Stepping back from end() lands
+* on the largest item, so the last k items cost O(log n + k).
+*/
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator&
+BinarySearchTree<Key, Value, NodeT, Compare>::iterator::operator--()
+{
+    if(current_ == nullptr){
+      current_ = tree_->getLargestNode();
+    }
+    else{
+      current_ = predecessor(current_);
+    }
+    return *this;
+}
+
 
 /*
 -------------------------------------------------------------
@@ -352,6 +631,73 @@ End implementations for the BinarySearchTree::iterator class.
 -------------------------------------------------------------
 */
 
+/*
+---------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::const_iterator class.
+---------------------------------------------------------------------
+*/
+
+template<class Key, class Value, class NodeT, class Compare>
+BinarySearchTree<Key, Value, NodeT, Compare>::const_iterator::const_iterator()
+{
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+BinarySearchTree<Key, Value, NodeT, Compare>::const_iterator::const_iterator(const iterator& it) :
+    it_(it)
+{
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+const std::pair<const Key,Value> &
+BinarySearchTree<Key, Value, NodeT, Compare>::const_iterator::operator*() const
+{
+    return *it_;
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+const std::pair<const Key,Value> *
+BinarySearchTree<Key, Value, NodeT, Compare>::const_iterator::operator->() const
+{
+    return it_.operator->();
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+bool
+BinarySearchTree<Key, Value, NodeT, Compare>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    return it_ == rhs.it_;
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+bool
+BinarySearchTree<Key, Value, NodeT, Compare>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return it_ != rhs.it_;
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::const_iterator&
+BinarySearchTree<Key, Value, NodeT, Compare>::const_iterator::operator++()
+{
+    ++it_;
+    return *this;
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::const_iterator&
+BinarySearchTree<Key, Value, NodeT, Compare>::const_iterator::operator--()
+{
+    --it_;
+    return *this;
+}
+
+/*
+-------------------------------------------------------------------
+End implementations for the BinarySearchTree::const_iterator class.
+-------------------------------------------------------------------
+*/
+
 /*
 -----------------------------------------------------
 Begin implementations for the BinarySearchTree class.
@@ -361,14 +707,51 @@ Begin implementations for the BinarySearchTree class.
 /**
 * Default constructor for a BinarySearchTree, which sets the root to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() 
+template<class Key, class Value, class NodeT, class Compare>
+BinarySearchTree<Key, Value, NodeT, Compare>::BinarySearchTree() :
+    root_(nullptr),
+    size_(0),
+    rightmost_(nullptr),
+    pool_(std::make_shared<NodePool>(sizeof(NodeT), alignof(NodeT)))
 {
-    root_ = nullptr;
+
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+/**
+* Move constructor, takes over other's nodes and leaves it empty.
+*/
+template<class Key, class Value, class NodeT, class Compare>
+BinarySearchTree<Key, Value, NodeT, Compare>::BinarySearchTree(BinarySearchTree&& other) :
+    root_(other.root_),
+    size_(other.size_),
+    rightmost_(other.rightmost_),
+    pool_(other.pool_)
+{
+    other.root_ = nullptr;
+    other.size_ = 0;
+    other.rightmost_ = nullptr;
+    other.pool_ = std::make_shared<NodePool>(sizeof(NodeT), alignof(NodeT));
+}
+
+/**
+* Move assignment, takes over other's nodes and frees the old ones.
+*/
+template<class Key, class Value, class NodeT, class Compare>
+BinarySearchTree<Key, Value, NodeT, Compare>&
+BinarySearchTree<Key, Value, NodeT, Compare>::operator=(BinarySearchTree&& other)
+{
+    if(this != &other){
+      std::swap(root_, other.root_);
+      std::swap(size_, other.size_);
+      std::swap(rightmost_, other.rightmost_);
+      std::swap(pool_, other.pool_);
+      other.clear();
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename NodeT, typename Compare>
+BinarySearchTree<Key, Value, NodeT, Compare>::~BinarySearchTree()
 {
     clear();
 }
@@ -376,14 +759,29 @@ BinarySearchTree<Key, Value>::~BinarySearchTree()
 /**
  * Returns true if tree is empty
 */
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, class NodeT, class Compare>
+bool BinarySearchTree<Key, Value, NodeT, Compare>::empty() const
 {
     return root_ == NULL;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+/**
+ * Returns the number of items in the tree
+*/
+template<class Key, class Value, class NodeT, class Compare>
+std::size_t BinarySearchTree<Key, Value, NodeT, Compare>::size() const
+{
+    if(size_ == unknownSize){
+      size_ = 0;
+      for(NodeT* now = getSmallestNode(); now != nullptr; now = successor(now)){
+        size_++;
+      }
+    }
+    return size_;
+}
+
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::print() const
 {
     printRoot(root_);
     std::cout << "\n";
@@ -392,178 +790,629 @@ void BinarySearchTree<Key, Value>::print() const
 /**
 * Returns an iterator to the "smallest" item in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::begin() const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
+    BinarySearchTree<Key, Value, NodeT, Compare>::iterator begin(getSmallestNode(), this);
     return begin;
 }
 
 /**
 * Returns an iterator whose value means INVALID
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::end() const
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
+    BinarySearchTree<Key, Value, NodeT, Compare>::iterator end(NULL, this);
     return end;
 }
 
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::const_iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::cbegin() const
+{
+    return const_iterator(begin());
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::const_iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::cend() const
+{
+    return const_iterator(end());
+}
+
+/**
+* Reverse iteration starts from the largest item: rbegin() is end()
+* stepped back once, so it costs one descent down the right spine.
+*/
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::reverse_iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::rbegin() const
+{
+    return reverse_iterator(end());
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::reverse_iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::rend() const
+{
+    return reverse_iterator(begin());
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::const_reverse_iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::crbegin() const
+{
+    return const_reverse_iterator(cend());
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::const_reverse_iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::crend() const
+{
+    return const_reverse_iterator(cbegin());
+}
+
 /**
 * Returns an iterator to the item with the given key, k
 * or the end iterator if k does not exist in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::find(const Key & k) const
 {
-    Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
+    NodeT* curr = internalFind(k);
+    BinarySearchTree<Key, Value, NodeT, Compare>::iterator it(curr, this);
     return it;
 }
 
 /**
- * @precondition The key exists in the map
- * Returns the value associated with the key
- */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+* Returns an iterator to the first item whose key is not less than key,
+* or the end iterator if there is none
+*/
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::lower_bound(const Key& key) const
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    return iterator(internalLowerBound(key), this);
 }
-template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+
+/**
+* Returns an iterator to the first item whose key is greater than key,
+* or the end iterator if there is none
+*/
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::upper_bound(const Key& key) const
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    return iterator(internalUpperBound(key), this);
 }
 
 /**
-* An insert method to insert into a Binary Search Tree.
-* The tree will not remain balanced when inserting.
-* Recall: If key is already in the tree, you should 
-* overwrite the current value with the updated value.
+* Returns the range of items whose key equals key (at most one item)
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+template<class Key, class Value, class NodeT, class Compare>
+std::pair<typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator,
+          typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator>
+BinarySearchTree<Key, Value, NodeT, Compare>::equal_range(const Key& key) const
 {
-    //if it is an empty tree, when set the insert node as the root, b(n)=0, done!
-    Node<Key,Value> *now = root_;
-    Node<Key,Value> *newnode = new Node<Key,Value>(keyValuePair.first,keyValuePair.second,nullptr);
-    bool b = true;
-    if(empty()){
-      root_ = newnode; 
+    NodeT* lower = internalLowerBound(key);
+    NodeT* upper = lower;
+    //keys are unique, so the range is either empty or just lower
+    if(lower != nullptr && !KeyOrder<Compare>::less(key, lower->getKey())){
+      upper = successor(lower);
     }
-    //enter a while loop first
-    else{
-      while(b){
-      //check if b is bigger or smaller than the root, remember we are comparing key not the value 
-      //now->getKey() = key of the root; KeyvaluePair.first = the key value of the newnode 
-      //meaning that it needs to be added on the left side of the tree 
-      //case 1: when the newnode is smaller than the rootnode 
-        if(now->getKey() > keyValuePair.first){
-        //case 1: if there is no left sub tree, then the newnode become the left child of the root node
-        //and don't forget to set the parent of the new node as the root 
-          if(now->getLeft()==nullptr){
-            now->setLeft(newnode);
-            newnode->setParent(now);
-            b = false;
+    return std::make_pair(iterator(lower, this), iterator(upper, this));
+}
+
+/**
+* Returns an iterator to the item with the largest key that is not
+* greater than key, or the end iterator if there is none
+*/
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::floor(const Key& key) const
+{
+    return iterator(internalFloor(key), this);
+}
+
+/**
+* Returns an iterator to the item with the smallest key that is not
+* less than key, or the end iterator if there is none
+*/
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::ceiling(const Key& key) const
+{
+    return iterator(internalLowerBound(key), this);
+}
+
+/**
+* The same lookups for any key type a transparent Compare can compare
+* with Key, e.g. std::string_view against std::string keys. No Key is
+* constructed.
+*/
+template<class Key, class Value, class NodeT, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::find(const K& key) const
+{
+    return iterator(internalFind(key), this);
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::lower_bound(const K& key) const
+{
+    return iterator(internalLowerBound(key), this);
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::upper_bound(const K& key) const
+{
+    return iterator(internalUpperBound(key), this);
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+template<typename K, typename C, typename>
+std::pair<typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator,
+          typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator>
+BinarySearchTree<Key, Value, NodeT, Compare>::equal_range(const K& key) const
+{
+    NodeT* lower = internalLowerBound(key);
+    NodeT* upper = lower;
+    if(lower != nullptr && !KeyOrder<Compare>::less(key, lower->getKey())){
+      upper = successor(lower);
+    }
+    return std::make_pair(iterator(lower, this), iterator(upper, this));
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::floor(const K& key) const
+{
+    return iterator(internalFloor(key), this);
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::ceiling(const K& key) const
+{
+    return iterator(internalLowerBound(key), this);
+}
+
+/**
+* Calls fn(item) for every item with lo <= key < hi, in order. One descent
+* to the first item, then an in-order walk: O(log n + k).
+*/
+template<class Key, class Value, class NodeT, class Compare>
+template<typename F>
+void BinarySearchTree<Key, Value, NodeT, Compare>::for_each_in_range(const Key& lo, const Key& hi, F fn) const
+{
+    NodeT* now = internalLowerBound(lo);
+    while(now != nullptr && KeyOrder<Compare>::less(now->getKey(), hi)){
+      fn(now->getItem());
+      now = successor(now);
+    }
+}
+
+/**
+* Looks up every key in [first, last) and writes one iterator per key to
+* out, end() for a missing key, in input order. Returns the advanced out.
+*
+* A loop of find() waits for one cache miss per level, one after the
+* other. Here the keys go in groups of kFindGroup whose descents advance
+* a level at a time in lock-step, each prefetching the child it moves to,
+* so a group's misses overlap. For a sorted group every path runs through
+* the node where the paths of its first and last key part, so that common
+* prefix is walked once and the lanes start below it.
+*/
+template<class Key, class Value, class NodeT, class Compare>
+template<typename ForwardIt, typename OutputIt>
+OutputIt BinarySearchTree<Key, Value, NodeT, Compare>::find_many(ForwardIt first, ForwardIt last, OutputIt out) const
+{
+    const Key* keys[kFindGroup];
+    NodeT* now[kFindGroup];
+    unsigned char live[kFindGroup];
+    while(first != last){
+      std::size_t n = 0;
+      bool sorted = true;
+      for(; n < kFindGroup && first != last; ++first, ++n){
+        keys[n] = &*first;
+        if(n > 0 && KeyOrder<Compare>::less(*keys[n], *keys[n - 1])){
+          sorted = false;
+        }
+      }
+      NodeT* start = root_;
+      if(sorted){
+        //walk down while the first and last key still go the same way
+        while(start != nullptr){
+          int lo = KeyOrder<Compare>::compare(*keys[0], start->getKey());
+          int hi = KeyOrder<Compare>::compare(*keys[n - 1], start->getKey());
+          if(lo < 0 && hi < 0){
+            start = start->getLeft();
+          }
+          else if(lo > 0 && hi > 0){
+            start = start->getRight();
           }
-          //let the root be the left child of the root, keep looping, keep comparing until there is no left node anymore
           else{
-            now = now->getLeft();
+            break;
           }
         }
-        //case 2: the new node is bigger than the root 
-        //check if it goes to the right side, same logic but different comparison 
-        else if(now->getKey() < keyValuePair.first){
-          //if there is no right sub tree, then we set the newnode as the right node and vise. versa 
-          if(now->getRight()==nullptr){
-            now->setRight(newnode);
-            newnode->setParent(now);
-            //when loop stop
-            b = false;
+      }
+      std::size_t lanes = n;
+      for(std::size_t i = 0; i < n; i++){
+        now[i] = start;
+        live[i] = static_cast<unsigned char>(i);
+      }
+      //one level per round; a lane leaves when it finds its key or falls
+      //off the tree, leaving now[] at the node or NULL
+      while(lanes > 0){
+        std::size_t kept = 0;
+        for(std::size_t j = 0; j < lanes; j++){
+          std::size_t i = live[j];
+          NodeT* node = now[i];
+          if(node == nullptr){
+            continue;
           }
-          else{
-            now = now->getRight();
+          int c = KeyOrder<Compare>::compare(*keys[i], node->getKey());
+          if(c == 0){
+            continue;
           }
+          node = c < 0 ? node->getLeft() : node->getRight();
+          prefetchNode(node);
+          now[i] = node;
+          live[kept++] = static_cast<unsigned char>(i);
         }
-        //case 3: when this key already exist
-        else{
-          now->setValue(keyValuePair.second);
-          delete newnode;
-          b = false;
-        }
-     }
-  }
+        lanes = kept;
+      }
+      for(std::size_t i = 0; i < n; i++){
+        *out = iterator(now[i], this);
+        ++out;
+      }
+    }
+    return out;
 }
 
-template<class Key, class Value>
-bool BinarySearchTree<Key,Value>::isleftchild(Node<Key,Value>* curr)
+/**
+ * Returns the value associated with the key, inserting a default
+ * constructed value first if the key is not in the tree yet.
+ */
+template<class Key, class Value, class NodeT, class Compare>
+Value& BinarySearchTree<Key, Value, NodeT, Compare>::operator[](const Key& key)
 {
-  if(curr->getParent()!=nullptr){
-    return curr==curr->getParent()->getLeft();
-  }
-  else{
-    return false;
-  }
+    return try_emplace(key).first->second;
 }
 
-template<class Key, class Value>
-bool BinarySearchTree<Key,Value>::isrightchild(Node<Key,Value>* curr)
+/**
+ * Like the above, but a new key is moved into its node.
+ */
+template<class Key, class Value, class NodeT, class Compare>
+Value& BinarySearchTree<Key, Value, NodeT, Compare>::operator[](Key&& key)
 {
-  if(curr->getParent()!=nullptr){
-    return curr==curr->getParent()->getLeft();
-  }
-  else{
-    return false;
-  }
+    return try_emplace(std::move(key)).first->second;
 }
 
-template<class Key, class Value>
-int BinarySearchTree<Key,Value>::numofchild(Node<Key,Value>* curr)
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class NodeT, class Compare>
+Value const & BinarySearchTree<Key, Value, NodeT, Compare>::operator[](const Key& key) const
 {
-  if(curr==nullptr){
-    return -100;
-  }
-  else if(curr->getLeft()==nullptr){
-    return 1;
-  }
-  else if(curr->getRight()==nullptr){
-    return 1;
-  }
-  else{
-    return 2;
-  }
+    return at(key);
 }
 
 /**
-* A remove method to remove a specific key from a Binary Search Tree.
-* Recall: The writeup specifies that if a node has 2 children you
-* should swap with the predecessor and then remove.
-*/
-/*
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+ * Returns the value associated with the key, or throws std::out_of_range
+ * if the key does not exist.
+ */
+template<class Key, class Value, class NodeT, class Compare>
+Value& BinarySearchTree<Key, Value, NodeT, Compare>::at(const Key& key)
 {
-  bool b = true;
-  Node<Key,Value> *now = root_;
-  Node<Key,Value> *last = nullptr;
-  if(now == nullptr){
-    //i used to do return nullptr but this is void function so i need to
-    //change all of them to return;
-    return;
-  }
-  //1. step one: find the value of the actual key first, walking the tree 
-  //condition: as long as we didn't find the matching value, which is such root != key 
-  while(now->getKey()!=key&&now!=nullptr){
-    //when the node to remove is smaller than the root, basically on the left sub tree 
-    if(key<now->getKey()){
+    NodeT* curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+template<class Key, class Value, class NodeT, class Compare>
+Value const & BinarySearchTree<Key, Value, NodeT, Compare>::at(const Key& key) const
+{
+    NodeT* curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+/**
+ * at() for any key type a transparent Compare accepts.
+ */
+template<class Key, class Value, class NodeT, class Compare>
+template<typename K, typename C, typename>
+Value& BinarySearchTree<Key, Value, NodeT, Compare>::at(const K& key)
+{
+    NodeT* curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+template<class Key, class Value, class NodeT, class Compare>
+template<typename K, typename C, typename>
+Value const & BinarySearchTree<Key, Value, NodeT, Compare>::at(const K& key) const
+{
+    NodeT* curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+/**
+* An insert method to insert into a Binary Search Tree.
+* The tree will not remain balanced when inserting (derived trees
+* rebalance in afterInsert).
+* Recall: If key is already in the tree, you should 
+* overwrite the current value with the updated value.
+* Returns an iterator to the item and true if a new node was created.
+*/
+template<class Key, class Value, class NodeT, class Compare>
+std::pair<typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, NodeT, Compare>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    return insert_or_assign(keyValuePair.first, keyValuePair.second);
+}
+
+/**
+* Same as above, but the value is moved into the tree instead of copied.
+* The key of a pair<const Key, Value> cannot be moved from, so it is
+* still copied into a new node; pass a pair<Key, Value> to move it too.
+* Like std::map, the overload for other pairs is a template, so a braced
+* insert({key, value}) can only mean the one taking the tree's own pair.
+*/
+template<class Key, class Value, class NodeT, class Compare>
+std::pair<typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, NodeT, Compare>::insert(std::pair<const Key, Value>&& keyValuePair)
+{
+    return insert_or_assign(keyValuePair.first, std::move(keyValuePair.second));
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+template<typename P, typename>
+std::pair<typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, NodeT, Compare>::insert(P&& keyValuePair)
+{
+    return insert_or_assign(std::forward<P>(keyValuePair).first, std::forward<P>(keyValuePair).second);
+}
+
+/**
+* Inserts (or overwrites, like insert() above) starting from hint, the
+* position the key is expected to go just before. With a good hint, e.g.
+* end() for ascending keys or the iterator returned by the previous call,
+* the slot is found in amortized O(1) instead of O(log n) comparisons.
+* A wrong hint only costs the usual descent. Returns an iterator to the
+* item.
+*/
+template<class Key, class Value, class NodeT, class Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::insert(const_iterator hint, const std::pair<const Key, Value>& keyValuePair)
+{
+    NodeT* parent = nullptr;
+    bool goLeft = false;
+    NodeT* found = internalFindSlot(keyValuePair.first, hint.it_.current_, parent, goLeft);
+    if(found != nullptr){
+      found->getValue() = keyValuePair.second;
+      afterAssign(found);
+      return iterator(found, this);
+    }
+    NodeT* newnode = allocateNode(keyValuePair.first, keyValuePair.second, parent);
+    linkNode(newnode, parent, goLeft);
+    return iterator(newnode, this);
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+template<typename P, typename>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::insert(const_iterator hint, P&& keyValuePair)
+{
+    NodeT* parent = nullptr;
+    bool goLeft = false;
+    NodeT* found = internalFindSlot(keyValuePair.first, hint.it_.current_, parent, goLeft);
+    if(found != nullptr){
+      found->getValue() = std::forward<P>(keyValuePair).second;
+      afterAssign(found);
+      return iterator(found, this);
+    }
+    NodeT* newnode = allocateNode(std::forward<P>(keyValuePair).first, std::forward<P>(keyValuePair).second, parent);
+    linkNode(newnode, parent, goLeft);
+    return iterator(newnode, this);
+}
+
+/**
+* Constructs an item in a new node straight from args, which are either
+* (key, value) or (std::piecewise_construct, keyArgs, valueArgs) as for
+* std::map::emplace. Like std::map, if the key is already in the tree the
+* new node is thrown away and the existing value is left alone; use
+* try_emplace() to not build anything in that case.
+*/
+template<class Key, class Value, class NodeT, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, NodeT, Compare>::emplace(Args&&... args)
+{
+    NodeT* newnode = allocateNode(std::forward<Args>(args)..., static_cast<NodeT*>(nullptr));
+    NodeT* parent = nullptr;
+    bool goLeft = false;
+    NodeT* found = internalFindSlot(newnode->getKey(), parent, goLeft);
+    if(found != nullptr){
+      freeNode(newnode);
+      return std::make_pair(iterator(found, this), false);
+    }
+    linkNode(newnode, parent, goLeft);
+    return std::make_pair(iterator(newnode, this), true);
+}
+
+/**
+* Inserts a value constructed from args if key is not in the tree. If it
+* is, nothing is constructed and the existing value is left alone. The
+* value is built in place in the new node.
+*/
+template<class Key, class Value, class NodeT, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, NodeT, Compare>::try_emplace(const Key& key, Args&&... args)
+{
+    NodeT* parent = nullptr;
+    bool goLeft = false;
+    NodeT* found = internalFindSlot(key, parent, goLeft);
+    if(found != nullptr){
+      return std::make_pair(iterator(found, this), false);
+    }
+    NodeT* newnode = allocateNode(std::piecewise_construct, std::forward_as_tuple(key),
+                                  std::forward_as_tuple(std::forward<Args>(args)...), parent);
+    linkNode(newnode, parent, goLeft);
+    return std::make_pair(iterator(newnode, this), true);
+}
+
+/**
+* Like the above, but a new key is moved into its node. key is left alone
+* if it was already in the tree.
+*/
+template<class Key, class Value, class NodeT, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, NodeT, Compare>::try_emplace(Key&& key, Args&&... args)
+{
+    NodeT* parent = nullptr;
+    bool goLeft = false;
+    NodeT* found = internalFindSlot(key, parent, goLeft);
+    if(found != nullptr){
+      return std::make_pair(iterator(found, this), false);
+    }
+    NodeT* newnode = allocateNode(std::piecewise_construct, std::forward_as_tuple(std::move(key)),
+                                  std::forward_as_tuple(std::forward<Args>(args)...), parent);
+    linkNode(newnode, parent, goLeft);
+    return std::make_pair(iterator(newnode, this), true);
+}
+
+/**
+* Inserts obj under key, or assigns it over the existing value. An rvalue
+* obj is moved in either way.
+*/
+template<class Key, class Value, class NodeT, class Compare>
+template<typename M>
+std::pair<typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, NodeT, Compare>::insert_or_assign(const Key& key, M&& obj)
+{
+    NodeT* parent = nullptr;
+    bool goLeft = false;
+    NodeT* found = internalFindSlot(key, parent, goLeft);
+    if(found != nullptr){
+      found->getValue() = std::forward<M>(obj);
+      afterAssign(found);
+      return std::make_pair(iterator(found, this), false);
+    }
+    NodeT* newnode = allocateNode(key, std::forward<M>(obj), parent);
+    linkNode(newnode, parent, goLeft);
+    return std::make_pair(iterator(newnode, this), true);
+}
+
+/**
+* Like the above, but a new key is moved into its node.
+*/
+template<class Key, class Value, class NodeT, class Compare>
+template<typename M>
+std::pair<typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, NodeT, Compare>::insert_or_assign(Key&& key, M&& obj)
+{
+    NodeT* parent = nullptr;
+    bool goLeft = false;
+    NodeT* found = internalFindSlot(key, parent, goLeft);
+    if(found != nullptr){
+      found->getValue() = std::forward<M>(obj);
+      afterAssign(found);
+      return std::make_pair(iterator(found, this), false);
+    }
+    NodeT* newnode = allocateNode(std::move(key), std::forward<M>(obj), parent);
+    linkNode(newnode, parent, goLeft);
+    return std::make_pair(iterator(newnode, this), true);
+}
+
+/**
+* Read-modify-write in one descent: calls fn(value) on the value stored
+* under key, default constructing it first if the key is new.
+*/
+template<class Key, class Value, class NodeT, class Compare>
+template<typename F>
+std::pair<typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, NodeT, Compare>::upsert(const Key& key, F fn)
+{
+    std::pair<iterator, bool> result = try_emplace(key);
+    fn(result.first->second);
+    afterAssign(result.first.current_);
+    return result;
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+bool BinarySearchTree<Key, Value, NodeT, Compare>::isleftchild(NodeT* curr)
+{
+  if(curr->getParent()!=nullptr){
+    return curr==curr->getParent()->getLeft();
+  }
+  else{
+    return false;
+  }
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+bool BinarySearchTree<Key, Value, NodeT, Compare>::isrightchild(NodeT* curr)
+{
+  if(curr->getParent()!=nullptr){
+    return curr==curr->getParent()->getRight();
+  }
+  else{
+    return false;
+  }
+}
+
+template<class Key, class Value, class NodeT, class Compare>
+int BinarySearchTree<Key, Value, NodeT, Compare>::numofchild(NodeT* curr)
+{
+  if(curr==nullptr){
+    return -100;
+  }
+  int count = 0;
+  if(curr->getLeft()!=nullptr){
+    count++;
+  }
+  if(curr->getRight()!=nullptr){
+    count++;
+  }
+  return count;
+}
+/**
+* A remove method to remove a specific key from a Binary Search Tree.
+* Recall: The writeup specifies that if a node has 2 children you
+* should swap with the predecessor and then remove.
+*/
+/*
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::remove(const Key& key)
+{
+  bool b = true;
+  NodeT* now = root_;
+  NodeT* last = nullptr;
+  if(now == nullptr){
+    //i used to do return nullptr but this is void function so i need to
+    //change all of them to return;
+    return;
+  }
+  //1. step one: find the value of the actual key first, walking the tree 
+  //condition: as long as we didn't find the matching value, which is such root != key 
+  while(now->getKey()!=key&&now!=nullptr){
+    //when the node to remove is smaller than the root, basically on the left sub tree 
+    if(key<now->getKey()){
       if(now->getLeft() == nullptr){
         return;
       }
@@ -584,7 +1433,7 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
   //case 1: according to ppt, the first scenario is when there is 2 children 
   if(now->getRight()!=nullptr && now->getLeft()!=nullptr){
     //swap with the predecessor 
-    Node<Key,Value>* predofnow = predecessor(now);
+    NodeT* predofnow = predecessor(now);
     nodeSwap(now,predofnow);
     last = now->getParent();
   }
@@ -605,7 +1454,7 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
     }
     //if it is not the root
     else{
-      Node<Key,Value>*therightchild = now->getRight();
+      NodeT* therightchild = now->getRight();
       if(b){
         last->setLeft(therightchild);
       }
@@ -625,7 +1474,7 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
     }
     //in other case if it is a node in the tree, then we need to promote the child and then delete the node 
     else{
-      Node<Key,Value>*theleftchild = now->getLeft();
+      NodeT* theleftchild = now->getLeft();
       if(b){
         last->setLeft(theleftchild);
       }
@@ -660,143 +1509,62 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
   }
 }*/
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key,Value>::remove(const Key& key){
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::remove(const Key& key){
   if(empty()){
     return;
   }
-  Node<Key,Value>* cur = find(key).current_;
+  NodeT* cur = find(key).current_;
   removeHelp(cur);
 }
 
 //remove rewrite 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::removeHelp(Node<Key,Value>* current)
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::removeHelp(NodeT* current)
 {
-  //when there is no children for the removing node 
-  if(numofchild(current)==0){
-    if(current->getParent()!=nullptr){
-      if(isleftchild(current)){
-        current->getParent()->setLeft(nullptr);
-      }
-      else{
-        current->getParent()->setRight(nullptr);
-      }
-    }
-    else{
-      root_ = nullptr;
-    }
-    delete current;
+  if(current==nullptr){
+    return;
   }
-
-  //when it has two children 
-  else if(numofchild(current)==2){
-    //find predecessor, and then swap
-    Node<Key,Value>* pred = predecessor(current);
+  //when it has two children, swap with the predecessor first so that
+  //current ends up with at most one (left) child
+  if(numofchild(current)==2){
+    NodeT* pred = predecessor(current);
     nodeSwap(current,pred);
-    //after that check the children again 
-    //if it has no child
-    if(numofchild(current)==0){
-      if(current->getParent()!=nullptr){
-        if(isleftchild(current)){
-          current->getParent()->setLeft(nullptr);
-        }
-        else{
-          current->getParent()->setRight(nullptr);
-        }
-      }
-      else{
-        root_ = nullptr;
-      }
-      delete current;
-    }
-    //when there is 1 child 
-    else if(numofchild(current)==1){
-      if(current->getLeft()!=nullptr){
-        if(current->getParent()!=nullptr){
-          if(isleftchild(current)){
-            current->getParent()->setLeft(current->getLeft());
-          }
-          else{
-            current->getParent()->setRight(current->getLeft());
-          }
-          current->getLeft()->setParent(current->getParent());
-        }
-        //if it is the root
-        else{
-          root_ = current->getLeft();
-          current->getLeft()->setParent(nullptr);
-        }
-      }
-      //when there is a right child
-      else{
-        if(current->getParent()!=nullptr){
-          if(isleftchild(current)){
-            current->getParent()->setLeft(current->getRight());
-          }
-          else{
-            current->getParent()->setRight(current->getRight());
-          }
-          if(current->getRight()!=nullptr){
-          current->getRight()->setParent(current->getParent());
-          }
-        }
-        //if it is the root
-        else{
-          root_ = current->getRight();
-          current->getRight()->setParent(nullptr);
-        }
-      }
-      delete current;
-    }
-    //when there are two children 
-    else if(numofchild(current)==2){
-      if(current->getLeft()!=nullptr){
-        if(current->getParent()!=nullptr){
-          if(isleftchild(current)){
-            current->getParent()->setLeft(current->getLeft());
-          }
-          else{
-            current->getParent()->setRight(current->getLeft());
-          }
-          current->getLeft()->setParent(current->getParent());
-        }
-        else{
-          root_ = current->getLeft();
-          current->getLeft()->setParent(nullptr);
-        }
-      }
-      //right child 
-      else{
-        if(current->getParent()!=nullptr){
-          if(isleftchild(current)){
-            current->getParent()->setLeft(current->getRight());
-          }
-          else{
-            current->getParent()->setRight(current->getRight());
-          }
-          current->getRight()->setParent(current->getParent());
-        }
-        else{
-          root_ = current->getRight();
-          current->getRight()->setParent(nullptr);
-        }
-      }
-      delete current;
-    }
   }
+  //promote the only child (or nothing) into current's place
+  NodeT* child = current->getLeft();
+  if(child==nullptr){
+    child = current->getRight();
+  }
+  NodeT* parent = current->getParent();
+  if(parent==nullptr){
+    root_ = child;
+  }
+  else if(isleftchild(current)){
+    parent->setLeft(child);
+  }
+  else{
+    parent->setRight(child);
+  }
+  if(child!=nullptr){
+    child->setParent(parent);
+  }
+  freeNode(current);
 }
 
 
 //predecessor 
-template<class Key, class Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+template<class Key, class Value, class NodeT, class Compare>
+NodeT*
+BinarySearchTree<Key, Value, NodeT, Compare>::predecessor(NodeT* current)
 {
     //when it is an empty tree
     if(current == nullptr){
       return nullptr;
     }
+    if constexpr(HasThreads<NodeT>::value){
+      return current->getPrev();
+    }
     //check if the left child exist, if so predecessor is the right most node of the left subtree
     if(current->getLeft()!=nullptr){
       current = current->getLeft();
@@ -807,29 +1575,31 @@ BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
     }
     //if the left child doesn't exist Else walk up the ancestor is the predecessor
     else{
-      //when it is not the right child of the parent, keep going up 
-      while(current!=current->getParent()->getRight()){
-      current = current->getParent();
-      if(current==nullptr){
-        return nullptr;
-      }
-      if(current->getParent()==nullptr){
-        return nullptr;
+      //while we come up from a left child, keep going up; the first
+      //parent we reach from its right side is the predecessor (NULL past
+      //the root, i.e. current was the smallest node)
+      NodeT* parent = current->getParent();
+      while(parent!=nullptr && current==parent->getLeft()){
+        current = parent;
+        parent = parent->getParent();
       }
+      return parent;
     }
-    return current;
-  }
 }
 
 //Helper function written by Huizhen to find the successor of any node 
-template<class Key, class Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
+template<class Key, class Value, class NodeT, class Compare>
+NodeT*
+BinarySearchTree<Key, Value, NodeT, Compare>::successor(NodeT* current)
 {
     //if current = nullptr, meaning tree is empty, return nullptr
     if(current==nullptr){
         return nullptr;
     }
+    //threaded nodes know their successor, one load instead of a walk
+    if constexpr(HasThreads<NodeT>::value){
+        return current->getNext();
+    }
     //if right child exists, then the sucessor is the left most child of the right subtree 
     if(current->getRight()!=nullptr){
         current = current->getRight();
@@ -875,44 +1645,324 @@ BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
 /**
 * Helper function for clear function 
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::HelptoClear (Node<Key, Value>* current)
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::HelptoClear (NodeT* current)
 {
-  if(current == nullptr){
-    //again this is a void function
+  //only run the destructor, the memory goes back with the whole slab in clear()
+  postOrder(current, [](NodeT* node, int) {
+    node->~NodeT();
+    return true;
+  });
+}
+
+/**
+* Visits every node of the subtree at root after its children, as
+* visit(node, depth) with depth 0 at root, by walking the parent pointers,
+* so no stack is needed however deep the tree is. Where to go next is read
+* before each visit, so visit may destroy the node. The walk stops, and
+* returns false, as soon as visit returns false or it would go deeper than
+* maxDepth.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+template<typename F>
+bool BinarySearchTree<Key, Value, NodeT, Compare>::postOrder(NodeT* root, F visit, int maxDepth)
+{
+  NodeT* node = root;
+  int depth = 0;
+  bool descend = true;
+  while(node != nullptr){
+    if(descend){
+      //first node in post-order below node: keep left, else right, down to a leaf
+      NodeT* child = node->getLeft() != nullptr ? node->getLeft() : node->getRight();
+      while(child != nullptr){
+        if(++depth > maxDepth){
+          return false;
+        }
+        node = child;
+        child = node->getLeft() != nullptr ? node->getLeft() : node->getRight();
+      }
+    }
+    //the root of a detached subtree may still point at its old parent
+    NodeT* parent = node == root ? nullptr : node->getParent();
+    NodeT* next = parent;
+    descend = parent != nullptr && node == parent->getLeft() && parent->getRight() != nullptr;
+    if(descend){
+      next = parent->getRight();
+    }
+    if(!visit(node, depth)){
+      return false;
+    }
+    if(!descend){
+      depth--;
+    }
+    node = next;
+  }
+  return true;
+}
+
+/**
+* Takes a slot from the pool and constructs a node of the given type in it,
+* passing args on to the node's constructor.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+template<typename... Args>
+NodeT* BinarySearchTree<Key, Value, NodeT, Compare>::allocateNode(Args&&... args)
+{
+  void* slot = pool().allocate();
+  try{
+    NodeT* node = new (slot) NodeT(std::forward<Args>(args)...);
+    if(size_ != unknownSize){
+      size_++;
+    }
+    return node;
+  }
+  catch(...){
+    pool().deallocate(slot);
+    throw;
+  }
+}
+
+/**
+* Destroys a single node and puts its slot on the pool's free list.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::freeNode(NodeT* node)
+{
+  if(node == nullptr){
     return;
   }
-  HelptoClear(current->getLeft());
-  HelptoClear(current->getRight());
-  delete current;
+  unlinkThreads(node);
+  if(node == rightmost_){
+    rightmost_ = nullptr;
+  }
+  node->~NodeT();
+  pool().deallocate(node);
+  if(size_ != unknownSize){
+    size_--;
+  }
+}
+
+/**
+* Frees every node of a subtree that has already been detached from the
+* tree, putting the slots back on the pool's free list. Returns how many
+* nodes were freed.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+std::size_t BinarySearchTree<Key, Value, NodeT, Compare>::freeSubtree(NodeT* current)
+{
+  std::size_t count = 0;
+  postOrder(current, [this, &count](NodeT* node, int) {
+    freeNode(node);
+    count++;
+    return true;
+  });
+  return count;
+}
+
+/**
+* Puts node into the thread between prev and next, either of which may be
+* NULL at the ends.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::linkThreads(NodeT* node, NodeT* prev, NodeT* next)
+{
+  if constexpr(HasThreads<NodeT>::value){
+    node->setPrev(prev);
+    node->setNext(next);
+    if(prev != nullptr){
+      prev->setNext(node);
+    }
+    if(next != nullptr){
+      next->setPrev(node);
+    }
+  }
+}
+
+/**
+* Takes node out of the thread, joining its neighbours. Nodes that were
+* never threaded have no neighbours, so this is safe on them too.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::unlinkThreads(NodeT* node)
+{
+  if constexpr(HasThreads<NodeT>::value){
+    NodeT* prev = node->getPrev();
+    NodeT* next = node->getNext();
+    if(prev != nullptr){
+      prev->setNext(next);
+    }
+    if(next != nullptr){
+      next->setPrev(prev);
+    }
+    node->setPrev(nullptr);
+    node->setNext(nullptr);
+  }
+}
+
+/**
+* Threads a node that is already linked into the tree, finding its
+* neighbours through the tree rather than the threads. O(log n).
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::threadNode(NodeT* node)
+{
+  if constexpr(HasThreads<NodeT>::value){
+    NodeT* prev = node->getLeft();
+    if(prev != nullptr){
+      while(prev->getRight() != nullptr){
+        prev = prev->getRight();
+      }
+    }
+    else{
+      NodeT* child = node;
+      prev = node->getParent();
+      while(prev != nullptr && prev->getLeft() == child){
+        child = prev;
+        prev = prev->getParent();
+      }
+    }
+    NodeT* next = node->getRight();
+    if(next != nullptr){
+      while(next->getLeft() != nullptr){
+        next = next->getLeft();
+      }
+    }
+    else{
+      NodeT* child = node;
+      next = node->getParent();
+      while(next != nullptr && next->getRight() == child){
+        child = next;
+        next = next->getParent();
+      }
+    }
+    linkThreads(node, prev, next);
+  }
+}
+
+/**
+* Rebuilds every thread from the shape of the tree, for operations that
+* relink many nodes at once. O(n).
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::rethread()
+{
+  if constexpr(HasThreads<NodeT>::value){
+    NodeT* last = nullptr;
+    threadSubtree(root_, last);
+    if(last != nullptr){
+      last->setNext(nullptr);
+    }
+  }
+}
+
+/**
+* In-order walk for rethread(): chains every node of the subtree after
+* last, and leaves last at the subtree's largest node.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::threadSubtree(NodeT* node, NodeT*& last)
+{
+  if constexpr(HasThreads<NodeT>::value){
+    if(node == nullptr){
+      return;
+    }
+    threadSubtree(node->getLeft(), last);
+    node->setPrev(last);
+    if(last != nullptr){
+      last->setNext(node);
+    }
+    last = node;
+    threadSubtree(node->getRight(), last);
+  }
+}
+
+/**
+* Pre-sizes the node pool so that the next n inserts do not touch the heap.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::reserve(std::size_t n)
+{
+  pool().reserve(n);
+}
+
+/**
+* The pool this tree allocates from. If the pool was merged into another
+* one (see sharePoolWith) the pointer is moved along to the live pool.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+NodePool& BinarySearchTree<Key, Value, NodeT, Compare>::pool()
+{
+  while(pool_->mergedInto()){
+    pool_ = pool_->mergedInto();
+  }
+  return *pool_;
+}
+
+/**
+* Gives an empty tree a fresh pool of its own, so that it stops sharing
+* slabs with the trees its nodes went to.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::resetPool()
+{
+  pool_ = std::make_shared<NodePool>(sizeof(NodeT), alignof(NodeT));
+}
+
+/**
+* Makes this tree and other allocate from the same pool, so that nodes
+* can move between them. other's pool (with all of its slabs, and whatever
+* other trees still use it) is merged into this tree's pool.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::sharePoolWith(BinarySearchTree& other)
+{
+  pool();
+  other.pool();
+  NodePool::merge(pool_, other.pool_);
+  other.pool_ = pool_;
 }
 
 /**
 * A method to remove all contents of the tree and
 * reset the values in the tree for use again.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::clear()
 {
-  HelptoClear(root_);
+  pool();
+  if(pool_.use_count() > 1){
+    //other trees (or pools merged into ours) still have nodes in these
+    //slabs, so only our own nodes can go back
+    freeSubtree(root_);
+  }
+  else{
+    //nodes holding trivially destructible data have nothing to run, so the
+    //slabs can be dropped without visiting a single node
+    if(!std::is_trivially_destructible<Key>::value || !std::is_trivially_destructible<Value>::value){
+      HelptoClear(root_);
+    }
+    pool_->release();
+  }
   //resetting to empty tree
   root_ = nullptr; 
+  size_ = 0;
+  rightmost_ = nullptr;
 }
 
 
 /**
 * A helper function to find the smallest node in the tree.
 */
-template<typename Key, typename Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNode() const
+template<typename Key, typename Value, typename NodeT, typename Compare>
+NodeT*
+BinarySearchTree<Key, Value, NodeT, Compare>::getSmallestNode() const
 {
     // if it is an empty tree, return a nullptr 
     if(empty()){
         return nullptr; 
     }
     //the smallest node of the avl tree is the left most node of all 
-    Node<Key, Value>* now = root_;
+    NodeT* now = root_;
     //if there is no left subtree then the root node itself is the smallest node
     while(now->getLeft() != nullptr){
         now = now->getLeft();
@@ -920,28 +1970,43 @@ BinarySearchTree<Key, Value>::getSmallestNode() const
     return now; 
 }   
 
+/**
+* The largest node of the tree, the right most one, or NULL if it is empty.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+NodeT*
+BinarySearchTree<Key, Value, NodeT, Compare>::getLargestNode() const
+{
+    NodeT* now = root_;
+    if(now == nullptr){
+        return nullptr;
+    }
+    while(now->getRight() != nullptr){
+        now = now->getRight();
+    }
+    return now;
+}
+
 /**
 * Helper function to find a node with given key, k and
 * return a pointer to it or NULL if no item with that key
 * exists Returns a pointer to the node with the specified key. 
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, typename NodeT, typename Compare>
+template<typename K>
+NodeT* BinarySearchTree<Key, Value, NodeT, Compare>::internalFind(const K& key) const
 {
-  Node<Key,Value>* now = root_;
-  if(empty()){
-      return nullptr; 
-  }
-  //check the key and the value, if the key is smaller than the key given, then 
-  //loop through the tree and check each key and return the value of it 
+  NodeT* now = root_;
+  //one three-way comparison per level decides between left, right and found
   while(now != nullptr){
-      if(now->getKey() > key){
+      int c = KeyOrder<Compare>::compare(key, now->getKey());
+      if(c < 0){
           now = now->getLeft();
       }
-      else if(now->getKey() < key){
+      else if(c > 0){
           now = now->getRight();
       }
-      else if(now->getKey() == key){
+      else{
           return now; 
       } 
    }
@@ -949,89 +2014,326 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
 }
 
 /**
- * Helper function from Huizhen that help to calculate the height 
- */
-template<typename Key, typename Value>
-int BinarySearchTree<Key, Value>:: Heightcount (Node<Key, Value>* root, bool& balanced) const
+* Helper for lower_bound: the node with the smallest key >= key, or NULL.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+template<typename K>
+NodeT* BinarySearchTree<Key, Value, NodeT, Compare>::internalLowerBound(const K& key) const
 {
-  if(root==nullptr){
-    return 0;
+  NodeT* now = root_;
+  NodeT* best = nullptr;
+  while(now != nullptr){
+    //now is a candidate, anything better is on its left
+    if(!KeyOrder<Compare>::less(now->getKey(), key)){
+      best = now;
+      now = now->getLeft();
+    }
+    else{
+      now = now->getRight();
+    }
   }
-  if(!balanced){
-    return -1;
+  return best;
+}
+
+/**
+* Helper for upper_bound: the node with the smallest key > key, or NULL.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+template<typename K>
+NodeT* BinarySearchTree<Key, Value, NodeT, Compare>::internalUpperBound(const K& key) const
+{
+  NodeT* now = root_;
+  NodeT* best = nullptr;
+  while(now != nullptr){
+    if(KeyOrder<Compare>::less(key, now->getKey())){
+      best = now;
+      now = now->getLeft();
+    }
+    else{
+      now = now->getRight();
+    }
   }
-  int lleft = Heightcount(root->getLeft(),balanced);
-  int lright = Heightcount(root->getRight(),balanced);
-  if(abs(lleft - lright)>1){
-    balanced = false;
+  return best;
+}
+
+/**
+* Helper for floor: the node with the largest key <= key, or NULL.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+template<typename K>
+NodeT* BinarySearchTree<Key, Value, NodeT, Compare>::internalFloor(const K& key) const
+{
+  NodeT* now = root_;
+  NodeT* best = nullptr;
+  while(now != nullptr){
+    if(KeyOrder<Compare>::less(key, now->getKey())){
+      now = now->getLeft();
+    }
+    else{
+      best = now;
+      now = now->getRight();
+    }
   }
-  int max_num = std::max(lleft,lright)+1;
-  return max_num;
+  return best;
 }
 
 /**
- * Helper function from Huizhen that help to check if balanced 
- */
- /*
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>:: HeightBalanced (Node<Key, Value>* root) const
+* Wraps a node pointer in an iterator, for derived trees that cannot reach
+* the iterator's protected constructor.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator
+BinarySearchTree<Key, Value, NodeT, Compare>::makeIterator(NodeT* node) const
 {
-  if(root_ == nullptr){
-    return true;
+  return iterator(node, this);
+}
+
+/**
+* Single descent used by every insert flavour. Returns the node holding key
+* if there is one. Otherwise returns NULL and leaves in parent/goLeft the
+* spot where a node for key has to be attached (parent is NULL for an
+* empty tree). A key at or past the largest one is settled with a single
+* comparison, so ascending keys (timestamps, sequence numbers) never
+* descend.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+NodeT* BinarySearchTree<Key, Value, NodeT, Compare>::internalFindSlot(const Key& key, NodeT*& parent, bool& goLeft) const
+{
+  parent = nullptr;
+  goLeft = false;
+  NodeT* last = rightmostNode();
+  if(last != nullptr){
+    int c = KeyOrder<Compare>::compare(key, last->getKey());
+    if(c == 0){
+      return last;
+    }
+    if(c > 0){
+      parent = last;
+      return nullptr;
+    }
+  }
+  NodeT* now = root_;
+  while(now != nullptr){
+    int c = KeyOrder<Compare>::compare(key, now->getKey());
+    if(c < 0){
+      parent = now;
+      goLeft = true;
+      now = now->getLeft();
+    }
+    else if(c > 0){
+      parent = now;
+      goLeft = false;
+      now = now->getRight();
+    }
+    else{
+      return now;
+    }
+  }
+  return nullptr;
+}
+
+/**
+* Like the above, but first tries the spot right next to hint (the node
+* key is expected to go just before, as for std::map). If key falls
+* between hint and its neighbour the slot is found with two comparisons
+* and an amortized O(1) step; otherwise this is a normal descent.
+* hint may be NULL, meaning end().
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+NodeT* BinarySearchTree<Key, Value, NodeT, Compare>::internalFindSlot(const Key& key, NodeT* hint, NodeT*& parent, bool& goLeft) const
+{
+  if(hint == nullptr){
+    //end(): the append check in the plain descent is exactly this case
+    return internalFindSlot(key, parent, goLeft);
+  }
+  int c = KeyOrder<Compare>::compare(key, hint->getKey());
+  if(c == 0){
+    return hint;
+  }
+  if(c < 0){
+    NodeT* prev = predecessor(hint);
+    int p = prev == nullptr ? -1 : KeyOrder<Compare>::compare(prev->getKey(), key);
+    if(p == 0){
+      return prev;
+    }
+    if(p < 0){
+      //hint has no left child or prev is the largest node below it, one
+      //of the two has a free slot on the side facing key
+      if(hint->getLeft() == nullptr){
+        parent = hint;
+        goLeft = true;
+      }
+      else{
+        parent = prev;
+        goLeft = false;
+      }
+      return nullptr;
+    }
   }
   else{
-    int dif = Heightcount(root->getRight()) - Heightcount(root->getLeft());
-    if(dif <=1 && dif >= -1){
-      return HeightBalanced(root->getRight()) && HeightBalanced(root->getLeft());
+    NodeT* next = successor(hint);
+    int n = next == nullptr ? 1 : KeyOrder<Compare>::compare(next->getKey(), key);
+    if(n == 0){
+      return next;
+    }
+    if(n > 0){
+      if(hint->getRight() == nullptr){
+        parent = hint;
+        goLeft = false;
+      }
+      else{
+        parent = next;
+        goLeft = true;
+      }
+      return nullptr;
     }
   }
-  return false; 
-}*/
+  return internalFindSlot(key, parent, goLeft);
+}
 
+/**
+* Starts loading node into the cache ahead of its first use. Does nothing
+* for NULL or on compilers without a prefetch builtin.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::prefetchNode(const NodeT* node)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  if(node != nullptr){
+    __builtin_prefetch(node, 0, 3);
+  }
+#endif
+}
 
- 
 /**
- * Return true iff the BST is balanced.
- */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+* The largest node, or NULL for an empty tree. Cached in rightmost_ and
+* looked up again down the right spine when the cache was dropped.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+NodeT* BinarySearchTree<Key, Value, NodeT, Compare>::rightmostNode() const
 {
-  if(empty()){
-    return true;
+  if(rightmost_ == nullptr && root_ != nullptr){
+    rightmost_ = getLargestNode();
   }
-  bool balance = true;
-  Node<Key,Value>* current = root_;
-  Heightcount(current, balance);
-  if(!balance){
-    return false;
+  return rightmost_;
+}
+
+/**
+* Hangs a freshly allocated node at the spot found by internalFindSlot and
+* gives the tree a chance to rebalance.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::linkNode(NodeT* node, NodeT* parent, bool goLeft)
+{
+  node->setParent(parent);
+  if(parent == nullptr){
+    root_ = node;
+    rightmost_ = node;
+  }
+  else if(goLeft){
+    parent->setLeft(node);
   }
   else{
-  return true;
+    parent->setRight(node);
+    if(parent == rightmost_){
+      rightmost_ = node;
+    }
+  }
+  if constexpr(HasThreads<NodeT>::value){
+    //a new leaf sits right next to its parent in key order
+    if(parent == nullptr){
+      linkThreads(node, nullptr, nullptr);
+    }
+    else if(goLeft){
+      linkThreads(node, parent->getPrev(), parent);
+    }
+    else{
+      linkThreads(node, parent, parent->getNext());
+    }
   }
+  afterInsert(node);
 }
 
+/**
+* Called after a new leaf has been linked in. A plain BST has nothing to do.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::afterInsert(NodeT* node)
+{
 
+}
 
+/**
+* Called after the value of an existing node was replaced in place, for
+* trees that keep something computed from the values.
+*/
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::afterAssign(NodeT* node)
+{
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+}
+
+/**
+ * Return true iff the BST is balanced.
+ *
+ * Heights are worked out bottom-up in one post-order walk: a node's right
+ * child (or its only child) is the node visited just before it, and the
+ * height of a left subtree still waiting for its right sibling is kept per
+ * depth. Stops at the first node whose subtrees differ by more than one,
+ * or as soon as the walk goes deeper than any balanced tree can be, so a
+ * degenerate tree is rejected after a few dozen steps.
+ */
+template<typename Key, typename Value, typename NodeT, typename Compare>
+bool BinarySearchTree<Key, Value, NodeT, Compare>::isBalanced() const
+{
+  int leftHeight[kMaxBalancedDepth + 1];
+  int last = 0;
+  return postOrder(root_, [&leftHeight, &last](NodeT* node, int depth) {
+    int lheight = 0;
+    int rheight = 0;
+    if(node->getRight() != nullptr){
+      rheight = last;
+      if(node->getLeft() != nullptr){
+        lheight = leftHeight[depth];
+      }
+    }
+    else if(node->getLeft() != nullptr){
+      lheight = last;
+    }
+    if(abs(lheight - rheight) > 1){
+      return false;
+    }
+    last = std::max(lheight, rheight) + 1;
+    NodeT* parent = node->getParent();
+    if(depth > 0 && node == parent->getLeft() && parent->getRight() != nullptr){
+      leftHeight[depth - 1] = last;
+    }
+    return true;
+  }, kMaxBalancedDepth);
+}
+
+
+
+
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::nodeSwap( NodeT* n1, NodeT* n2)
 {
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
     }
-    Node<Key, Value>* n1p = n1->getParent();
-    Node<Key, Value>* n1r = n1->getRight();
-    Node<Key, Value>* n1lt = n1->getLeft();
+    NodeT* n1p = n1->getParent();
+    NodeT* n1r = n1->getRight();
+    NodeT* n1lt = n1->getLeft();
     bool n1isLeft = false;
     if(n1p != NULL && (n1 == n1p->getLeft())) n1isLeft = true;
-    Node<Key, Value>* n2p = n2->getParent();
-    Node<Key, Value>* n2r = n2->getRight();
-    Node<Key, Value>* n2lt = n2->getLeft();
+    NodeT* n2p = n2->getParent();
+    NodeT* n2r = n2->getRight();
+    NodeT* n2lt = n2->getLeft();
     bool n2isLeft = false;
     if(n2p != NULL && (n2 == n2p->getLeft())) n2isLeft = true;
 
 
-    Node<Key, Value>* temp;
+    NodeT* temp;
     temp = n1->getParent();
     n1->setParent(n2->getParent());
     n2->setParent(temp);
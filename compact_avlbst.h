@@ -0,0 +1,808 @@
+#ifndef COMPACT_AVLBST_H
+#define COMPACT_AVLBST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include "bst.h"
+
+/**
+* An AVL tree whose nodes live side by side in one growing array and link
+* to each other by 32-bit index instead of by pointer.
+*
+* A slot holds the item, the indices of its two children and one more
+* word with the parent's index in the low 29 bits and the balance in the
+* top three. For int keys and values that is 20 bytes a node against 40
+* for AVLNode, so about three nodes share a cache line instead of one and
+* a half, and the whole tree is one allocation. Removed slots go on a free
+* list, linked through their left child, and are handed out again first.
+*
+* The interface is the same as AVLTree's for inserting, removing, finding
+* and iterating. Iterators hold an index, so they stay valid when the
+* array grows; references and pointers to items do not, since growing
+* moves the items to the new array. At most 2^29 - 1 items fit.
+*/
+template<class Key, class Value, class Compare = std::less<Key> >
+class CompactAVLTree
+{
+public:
+    typedef std::uint32_t Index;
+    class iterator;
+
+    CompactAVLTree();
+    CompactAVLTree(CompactAVLTree&& other);
+    CompactAVLTree& operator=(CompactAVLTree&& other);
+    CompactAVLTree(const CompactAVLTree& other) = delete;
+    CompactAVLTree& operator=(const CompactAVLTree& other) = delete;
+    ~CompactAVLTree();
+
+    std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    void reserve(std::size_t n);
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value& at(const Key& key);
+    Value const & at(const Key& key) const;
+
+    std::size_t size() const;
+    bool empty() const;
+    bool isBalanced() const;
+    std::size_t capacity() const;
+    static constexpr std::size_t slotSize();
+
+    /**
+    * In-order iterator. Stepping follows parent indices, like the
+    * BinarySearchTree iterator follows parent pointers.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+        iterator& operator++();
+
+    private:
+        friend class CompactAVLTree<Key, Value, Compare>;
+        iterator(const CompactAVLTree* tree, Index index);
+
+        const CompactAVLTree* tree_;
+        Index index_;
+    };
+
+private:
+    typedef std::pair<const Key, Value> Item;
+
+    struct Slot
+    {
+        alignas(Item) unsigned char item[sizeof(Item)];
+        Index child[2];
+        // parent index in the low 29 bits, balance + 2 in the top three;
+        // all ones marks a free slot
+        std::uint32_t up;
+    };
+
+    static constexpr Index kNil = (1u << 29) - 1;
+    static constexpr std::uint32_t kFree = 0xFFFFFFFFu;
+    static constexpr Index kFirstCapacity = 16;
+
+    Item& item(Index i) const;
+    Index parent(Index i) const;
+    void setParent(Index i, Index p);
+    int balance(Index i) const;
+    void setBalance(Index i, int b);
+
+    Index allocateSlot(const Item& keyValuePair);
+    void freeSlot(Index i);
+    void grow(std::size_t capacity);
+
+    Index findSlot(const Key& key, Index& parent, int& dir) const;
+    void linkSlot(Index i, Index parent, int dir);
+    Index lowerBound(const Key& key) const;
+    Index upperBound(const Key& key) const;
+    Index successor(Index i) const;
+    Index leftmost(Index i) const;
+    void replaceChild(Index parent, Index old, Index node);
+    Index rotate(Index x, int down);
+    Index rebalance(Index x);
+    void insertRetrace(Index node);
+    void removeRetrace(Index parent, int dir);
+    int checkHeight(Index i) const;
+
+    Slot* slots_;
+    Index capacity_;
+    Index used_;        // slots below this have been handed out at least once
+    Index freeList_;
+    Index root_;
+    std::size_t size_;
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the CompactAVLTree class.
+  ----------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::CompactAVLTree() :
+    slots_(nullptr),
+    capacity_(0),
+    used_(0),
+    freeList_(kNil),
+    root_(kNil),
+    size_(0)
+{
+}
+
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::CompactAVLTree(CompactAVLTree&& other) :
+    slots_(other.slots_),
+    capacity_(other.capacity_),
+    used_(other.used_),
+    freeList_(other.freeList_),
+    root_(other.root_),
+    size_(other.size_)
+{
+    other.slots_ = nullptr;
+    other.capacity_ = 0;
+    other.used_ = 0;
+    other.freeList_ = kNil;
+    other.root_ = kNil;
+    other.size_ = 0;
+}
+
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>& CompactAVLTree<Key, Value, Compare>::operator=(CompactAVLTree&& other)
+{
+    if(this != &other) {
+        std::swap(slots_, other.slots_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(used_, other.used_);
+        std::swap(freeList_, other.freeList_);
+        std::swap(root_, other.root_);
+        std::swap(size_, other.size_);
+        other.clear();
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::~CompactAVLTree()
+{
+    clear();
+    ::operator delete(slots_);
+}
+
+/**
+* Inserts the item, or overwrites the value if the key is already in the
+* tree. Returns an iterator to the item and true if it is new.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename CompactAVLTree<Key, Value, Compare>::iterator, bool>
+CompactAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    Index p = kNil;
+    int dir = 0;
+    Index found = findSlot(keyValuePair.first, p, dir);
+    if(found != kNil) {
+        item(found).second = keyValuePair.second;
+        return std::make_pair(iterator(this, found), false);
+    }
+    Index n = allocateSlot(keyValuePair);
+    linkSlot(n, p, dir);
+    return std::make_pair(iterator(this, n), true);
+}
+
+/**
+* Removes the key if it is there. A node with two children is replaced
+* by its in-order predecessor, as in AVLTree::remove; the slots of the
+* other items do not move, so iterators to them stay valid.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    Index p = kNil;
+    int dir = 0;
+    Index z = findSlot(key, p, dir);
+    if(z == kNil) {
+        return;
+    }
+    Index l = slots_[z].child[0];
+    Index r = slots_[z].child[1];
+    if(l != kNil && r != kNil) {
+        Index y = l;
+        while(slots_[y].child[1] != kNil) {
+            y = slots_[y].child[1];
+        }
+        if(y == l) {
+            // y moves up into z's place and keeps its own left subtree,
+            // which is one shorter than l was
+            p = y;
+            dir = 0;
+        }
+        else {
+            p = parent(y);
+            dir = 1;
+            Index c = slots_[y].child[0];
+            slots_[p].child[1] = c;
+            if(c != kNil) {
+                setParent(c, p);
+            }
+            slots_[y].child[0] = l;
+            setParent(l, y);
+        }
+        slots_[y].child[1] = r;
+        setParent(r, y);
+        replaceChild(parent(z), z, y);
+        setBalance(y, balance(z));
+    }
+    else {
+        Index c = l != kNil ? l : r;
+        p = parent(z);
+        dir = (p != kNil && slots_[p].child[1] == z) ? 1 : 0;
+        replaceChild(p, z, c);
+    }
+    freeSlot(z);
+    size_--;
+    removeRetrace(p, dir);
+}
+
+/**
+* Destroys every item. The array is kept for the next inserts.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::clear()
+{
+    for(Index i = 0; i < used_; i++) {
+        if(slots_[i].up != kFree) {
+            item(i).~Item();
+        }
+    }
+    used_ = 0;
+    freeList_ = kNil;
+    root_ = kNil;
+    size_ = 0;
+}
+
+/**
+* Makes room for n items in total, so that inserting up to that many
+* does not move the array.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::reserve(std::size_t n)
+{
+    if(n > capacity_) {
+        grow(n);
+    }
+}
+
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator CompactAVLTree<Key, Value, Compare>::begin() const
+{
+    return iterator(this, root_ == kNil ? kNil : leftmost(root_));
+}
+
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator CompactAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator(this, kNil);
+}
+
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator CompactAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    Index p = kNil;
+    int dir = 0;
+    return iterator(this, findSlot(key, p, dir));
+}
+
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator CompactAVLTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return iterator(this, lowerBound(key));
+}
+
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator CompactAVLTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    return iterator(this, upperBound(key));
+}
+
+/**
+* Returns the value under key, inserting a default constructed one first
+* if the key is new.
+*/
+template<class Key, class Value, class Compare>
+Value& CompactAVLTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    Index p = kNil;
+    int dir = 0;
+    Index found = findSlot(key, p, dir);
+    if(found != kNil) {
+        return item(found).second;
+    }
+    Index n = allocateSlot(Item(key, Value()));
+    linkSlot(n, p, dir);
+    return item(n).second;
+}
+
+/**
+* Returns the value under key, or throws std::out_of_range.
+*/
+template<class Key, class Value, class Compare>
+Value& CompactAVLTree<Key, Value, Compare>::at(const Key& key)
+{
+    Index p = kNil;
+    int dir = 0;
+    Index found = findSlot(key, p, dir);
+    if(found == kNil) {
+        throw std::out_of_range("Invalid key");
+    }
+    return item(found).second;
+}
+
+template<class Key, class Value, class Compare>
+Value const & CompactAVLTree<Key, Value, Compare>::at(const Key& key) const
+{
+    Index p = kNil;
+    int dir = 0;
+    Index found = findSlot(key, p, dir);
+    if(found == kNil) {
+        throw std::out_of_range("Invalid key");
+    }
+    return item(found).second;
+}
+
+template<class Key, class Value, class Compare>
+std::size_t CompactAVLTree<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::empty() const
+{
+    return root_ == kNil;
+}
+
+template<class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    return checkHeight(root_) >= 0;
+}
+
+/**
+* Number of slots in the array, used or not.
+*/
+template<class Key, class Value, class Compare>
+std::size_t CompactAVLTree<Key, Value, Compare>::capacity() const
+{
+    return capacity_;
+}
+
+/**
+* Bytes taken by one slot, i.e. per item once the array is full.
+*/
+template<class Key, class Value, class Compare>
+constexpr std::size_t CompactAVLTree<Key, Value, Compare>::slotSize()
+{
+    return sizeof(Slot);
+}
+
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::Item& CompactAVLTree<Key, Value, Compare>::item(Index i) const
+{
+    return *std::launder(reinterpret_cast<Item*>(slots_[i].item));
+}
+
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::Index CompactAVLTree<Key, Value, Compare>::parent(Index i) const
+{
+    return slots_[i].up & kNil;
+}
+
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::setParent(Index i, Index p)
+{
+    slots_[i].up = (slots_[i].up & ~kNil) | p;
+}
+
+template<class Key, class Value, class Compare>
+int CompactAVLTree<Key, Value, Compare>::balance(Index i) const
+{
+    return static_cast<int>(slots_[i].up >> 29) - 2;
+}
+
+/**
+* b is the height of the right subtree minus the left one's, -2 to 2.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::setBalance(Index i, int b)
+{
+    slots_[i].up = (slots_[i].up & kNil) | (static_cast<std::uint32_t>(b + 2) << 29);
+}
+
+/**
+* Constructs a copy of the item in a free slot (a recycled one if there
+* is any) and returns the slot's index, unlinked and balanced.
+*/
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::Index CompactAVLTree<Key, Value, Compare>::allocateSlot(const Item& keyValuePair)
+{
+    Index i;
+    if(freeList_ != kNil) {
+        i = freeList_;
+        freeList_ = slots_[i].child[0];
+    }
+    else {
+        if(used_ == capacity_) {
+            grow(std::max<std::size_t>(kFirstCapacity, 2 * static_cast<std::size_t>(capacity_)));
+        }
+        i = used_++;
+    }
+    try {
+        new (slots_[i].item) Item(keyValuePair);
+    }
+    catch(...) {
+        slots_[i].up = kFree;
+        slots_[i].child[0] = freeList_;
+        freeList_ = i;
+        throw;
+    }
+    slots_[i].child[0] = kNil;
+    slots_[i].child[1] = kNil;
+    slots_[i].up = kNil;
+    setBalance(i, 0);
+    return i;
+}
+
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::freeSlot(Index i)
+{
+    item(i).~Item();
+    slots_[i].up = kFree;
+    slots_[i].child[0] = freeList_;
+    freeList_ = i;
+}
+
+/**
+* Moves the slots into a new array of the given capacity.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::grow(std::size_t capacity)
+{
+    if(capacity > kNil) {
+        capacity = kNil;
+        if(capacity <= capacity_) {
+            throw std::length_error("CompactAVLTree is full");
+        }
+    }
+    Slot* fresh = static_cast<Slot*>(::operator new(capacity * sizeof(Slot)));
+    for(Index i = 0; i < used_; i++) {
+        fresh[i].child[0] = slots_[i].child[0];
+        fresh[i].child[1] = slots_[i].child[1];
+        fresh[i].up = slots_[i].up;
+        if(slots_[i].up != kFree) {
+            new (fresh[i].item) Item(std::move(item(i)));
+            item(i).~Item();
+        }
+    }
+    ::operator delete(slots_);
+    slots_ = fresh;
+    capacity_ = static_cast<Index>(capacity);
+}
+
+/**
+* One descent with a three-way comparison per level. Returns the slot
+* holding key, or kNil and the spot (parent and side) where it would go.
+*/
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::Index
+CompactAVLTree<Key, Value, Compare>::findSlot(const Key& key, Index& parent, int& dir) const
+{
+    Index now = root_;
+    parent = kNil;
+    dir = 0;
+    while(now != kNil) {
+        int c = KeyOrder<Compare>::compare(key, item(now).first);
+        if(c == 0) {
+            return now;
+        }
+        parent = now;
+        dir = c > 0 ? 1 : 0;
+        now = slots_[now].child[dir];
+    }
+    return kNil;
+}
+
+/**
+* Hangs the new slot i at the spot found by findSlot and rebalances.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::linkSlot(Index i, Index parent, int dir)
+{
+    setParent(i, parent);
+    if(parent == kNil) {
+        root_ = i;
+    }
+    else {
+        slots_[parent].child[dir] = i;
+    }
+    size_++;
+    insertRetrace(i);
+}
+
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::Index CompactAVLTree<Key, Value, Compare>::lowerBound(const Key& key) const
+{
+    Index now = root_;
+    Index best = kNil;
+    while(now != kNil) {
+        if(!KeyOrder<Compare>::less(item(now).first, key)) {
+            best = now;
+            now = slots_[now].child[0];
+        }
+        else {
+            now = slots_[now].child[1];
+        }
+    }
+    return best;
+}
+
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::Index CompactAVLTree<Key, Value, Compare>::upperBound(const Key& key) const
+{
+    Index now = root_;
+    Index best = kNil;
+    while(now != kNil) {
+        if(KeyOrder<Compare>::less(key, item(now).first)) {
+            best = now;
+            now = slots_[now].child[0];
+        }
+        else {
+            now = slots_[now].child[1];
+        }
+    }
+    return best;
+}
+
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::Index CompactAVLTree<Key, Value, Compare>::successor(Index i) const
+{
+    if(slots_[i].child[1] != kNil) {
+        return leftmost(slots_[i].child[1]);
+    }
+    Index p = parent(i);
+    while(p != kNil && slots_[p].child[1] == i) {
+        i = p;
+        p = parent(p);
+    }
+    return p;
+}
+
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::Index CompactAVLTree<Key, Value, Compare>::leftmost(Index i) const
+{
+    while(slots_[i].child[0] != kNil) {
+        i = slots_[i].child[0];
+    }
+    return i;
+}
+
+/**
+* Puts node where old hangs under parent (or at the root) and points
+* node's parent index there.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::replaceChild(Index parent, Index old, Index node)
+{
+    if(parent == kNil) {
+        root_ = node;
+    }
+    else {
+        slots_[parent].child[slots_[parent].child[0] == old ? 0 : 1] = node;
+    }
+    if(node != kNil) {
+        setParent(node, parent);
+    }
+}
+
+/**
+* Rotates x down to side down (0 is a left rotation: x's right child
+* comes up) and returns the subtree's new root. The new balances follow
+* from the old ones alone, so double rotations are just two of these.
+*/
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::Index CompactAVLTree<Key, Value, Compare>::rotate(Index x, int down)
+{
+    int up = 1 - down;
+    Index y = slots_[x].child[up];
+    Index b = slots_[y].child[down];
+    slots_[x].child[up] = b;
+    if(b != kNil) {
+        setParent(b, x);
+    }
+    replaceChild(parent(x), x, y);
+    slots_[y].child[down] = x;
+    setParent(x, y);
+    int bx = balance(x);
+    int by = balance(y);
+    if(down == 0) {
+        bx = bx - 1 - std::max(by, 0);
+        by = by - 1 + std::min(bx, 0);
+    }
+    else {
+        bx = bx + 1 - std::min(by, 0);
+        by = by + 1 + std::max(bx, 0);
+    }
+    setBalance(x, bx);
+    setBalance(y, by);
+    return y;
+}
+
+/**
+* Fixes a node whose balance is +2 or -2 with a single or double rotation
+* and returns the subtree's new root.
+*/
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::Index CompactAVLTree<Key, Value, Compare>::rebalance(Index x)
+{
+    int heavy = balance(x) > 0 ? 1 : 0;
+    Index y = slots_[x].child[heavy];
+    // y leaning the other way needs to be turned first (zig-zag)
+    if(heavy == 1 && balance(y) < 0) {
+        rotate(y, 1);
+    }
+    else if(heavy == 0 && balance(y) > 0) {
+        rotate(y, 0);
+    }
+    return rotate(x, 1 - heavy);
+}
+
+/**
+* Walks up from a new leaf updating balances until a subtree's height
+* stays the same, rotating at most once.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::insertRetrace(Index node)
+{
+    Index p = parent(node);
+    while(p != kNil) {
+        int b = balance(p) + (slots_[p].child[1] == node ? 1 : -1);
+        setBalance(p, b);
+        if(b == 0) {
+            return;
+        }
+        if(b == 2 || b == -2) {
+            rebalance(p);
+            return;
+        }
+        node = p;
+        p = parent(p);
+    }
+}
+
+/**
+* Walks up from parent, whose subtree on side dir just got one shorter,
+* until some subtree keeps its height.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::removeRetrace(Index parent, int dir)
+{
+    Index p = parent;
+    while(p != kNil) {
+        int b = balance(p) + (dir == 0 ? 1 : -1);
+        setBalance(p, b);
+        Index top = p;
+        if(b == 2 || b == -2) {
+            top = rebalance(p);
+            if(balance(top) != 0) {
+                return;
+            }
+        }
+        else if(b != 0) {
+            return;
+        }
+        Index g = this->parent(top);
+        if(g == kNil) {
+            return;
+        }
+        dir = slots_[g].child[1] == top ? 1 : 0;
+        p = g;
+    }
+}
+
+/**
+* Height of the subtree at i, or -1 if it is not an AVL tree with correct
+* balances.
+*/
+template<class Key, class Value, class Compare>
+int CompactAVLTree<Key, Value, Compare>::checkHeight(Index i) const
+{
+    if(i == kNil) {
+        return 0;
+    }
+    int hl = checkHeight(slots_[i].child[0]);
+    int hr = checkHeight(slots_[i].child[1]);
+    if(hl < 0 || hr < 0 || hr - hl != balance(i) || hr - hl > 1 || hl - hr > 1) {
+        return -1;
+    }
+    return std::max(hl, hr) + 1;
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the CompactAVLTree class.
+  --------------------------------------------------
+*/
+
+/*
+  -------------------------------------------------------------
+  Begin implementations for the CompactAVLTree::iterator class.
+  -------------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::iterator::iterator() :
+    tree_(nullptr),
+    index_(kNil)
+{
+}
+
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::iterator::iterator(const CompactAVLTree* tree, Index index) :
+    tree_(tree),
+    index_(index)
+{
+}
+
+template<class Key, class Value, class Compare>
+std::pair<const Key, Value>& CompactAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return tree_->item(index_);
+}
+
+template<class Key, class Value, class Compare>
+std::pair<const Key, Value>* CompactAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(tree_->item(index_));
+}
+
+template<class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return index_ == rhs.index_;
+}
+
+template<class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return index_ != rhs.index_;
+}
+
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator& CompactAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    index_ = tree_->successor(index_);
+    return *this;
+}
+
+/*
+  -----------------------------------------------------------
+  End implementations for the CompactAVLTree::iterator class.
+  -----------------------------------------------------------
+*/
+
+#endif
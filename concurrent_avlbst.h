@@ -0,0 +1,1069 @@
+#ifndef CONCURRENT_AVLBST_H
+#define CONCURRENT_AVLBST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <utility>
+#include <algorithm>
+#include <vector>
+#include "epoch_reclaimer.h"
+
+/**
+* An AVL tree that any number of threads may read and write at once,
+* after the optimistic concurrent AVL tree of Bronson, Casper, Chafi and
+* Olukotun.
+*
+* Readers never lock. Every node carries a version number; a rotation
+* that takes keys away from a node (rightRotate moves a node's left
+* subtree up past it, for example) marks the node as shrinking while it
+* relinks, and bumps the version when it is done. A search reads a node's
+* version, moves to the child, and checks that the version did not change
+* in between. If it did, the search steps back to the parent and tries
+* again from there rather than from the root. Nodes that only gain keys
+* keep their version, since a search that is already inside them cannot
+* miss anything.
+*
+* Writers lock only the nodes they change, always a parent before its
+* child. A removed node with two children stays in place as a routing node
+* without a value until it can be spliced out. Rebalancing is relaxed:
+* heights are repaired bottom up by the thread that damaged them, a few
+* locked nodes at a time, so the tree is a strict AVL tree again once
+* writers are quiet. A node's height is only ever written with its parent
+* locked, so whoever holds a node's lock can trust its children's heights.
+*
+* Unlinked nodes and replaced values may still be in use by a reader, so
+* they go to an EpochReclaimer instead of being deleted. Nodes come from
+* the heap rather than a NodePool, which is not thread safe.
+*
+* There are no iterators; a range scan calls back with each item instead,
+* and sees items that are concurrently inserted or removed at most once.
+*/
+template<class Key, class Value>
+class ConcurrentAVLTree
+{
+public:
+    ConcurrentAVLTree();
+    ~ConcurrentAVLTree();
+
+    bool insert(const std::pair<const Key, Value>& keyValuePair);
+    bool remove(const Key& key);
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    template<typename F>
+    void for_each_in_range(const Key& lo, const Key& hi, F fn) const;
+
+    std::size_t size() const;
+    bool empty() const;
+    bool isBalanced() const;
+
+private:
+    ConcurrentAVLTree(const ConcurrentAVLTree&);
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree&);
+
+    struct Node;
+
+    // Everything a node has except its key. The tree's root hangs off the
+    // right of a keyless holder so that even the root has a parent to lock.
+    struct Link
+    {
+        Link(Value* v, Link* p);
+        void lock();
+        void unlock();
+        Node* child(int dir) const;
+        void setChild(int dir, Node* node);
+
+        std::atomic<Value*> value;
+        std::atomic<int> height;
+        std::atomic<std::uint64_t> version;
+        std::atomic<Link*> parent;
+        std::atomic<Node*> left;
+        std::atomic<Node*> right;
+        std::atomic<bool> locked;
+    };
+    struct Node : public Link
+    {
+        Node(const Key& k, Value* v, Link* p);
+
+        const Key key;
+    };
+
+    enum Outcome { kAbsent, kPresent, kRetry };
+
+    static int compare(const Key& a, const Key& b);
+    static int height(const Node* node);
+    static bool canUnlink(const Node* node);
+    static void waitUntilNotChanging(const Node* node);
+
+    Outcome attemptGet(const Key& key, Link* node, int dir, std::uint64_t nodeV, Value*& found) const;
+    Outcome attemptPut(const Key& key, Value* fresh, Link* node, int dir, std::uint64_t nodeV);
+    Outcome attemptInsert(const Key& key, Value* fresh, Link* node, int dir, std::uint64_t nodeV);
+    Outcome attemptUpdate(Node* node, Value* fresh);
+    Outcome attemptRemove(const Key& key, Link* node, int dir, std::uint64_t nodeV);
+    Outcome attemptRemoveNode(Link* parent, Node* node);
+    template<typename F>
+    Outcome scanChild(Link* node, int dir, std::uint64_t nodeV, Key& cursor, bool& inclusive, const Key& hi, F& fn) const;
+    template<typename F>
+    Outcome scanNode(Node* node, std::uint64_t nodeV, Key& cursor, bool& inclusive, const Key& hi, F& fn) const;
+
+    // Rebalancing. These expect the caller to hold the locks of the nodes
+    // passed in and return the next node that needs repair; nodes to come
+    // back to once that chain of repairs is done go on revisit.
+    void fixHeightAndRebalance(Link* node);
+    int nodeCondition(Link* node) const;
+    Link* rebalanceLocked(Link* nParent, Node* n, std::vector<Link*>& revisit);
+    Link* rebalanceToRight(Link* nParent, Node* n, Node* nL, int hR0, std::vector<Link*>& revisit);
+    Link* rebalanceToLeft(Link* nParent, Node* n, Node* nR, int hL0, std::vector<Link*>& revisit);
+    Link* rightRotate(Link* nParent, Node* n, Node* nL, int hR, int hLL, Node* nLR, int hLR);
+    Link* leftRotate(Link* nParent, Node* n, int hL, Node* nR, Node* nRL, int hRL, int hRR);
+    Link* leftRightRotate(Link* nParent, Node* n, Node* nL, int hR, int hLL, Node* nLR, int hLRL);
+    Link* rightLeftRotate(Link* nParent, Node* n, int hL, Node* nR, Node* nRL, int hRR, int hRLR);
+    bool attemptUnlinkLocked(Link* parent, Node* node);
+
+    static void destroySubtree(Node* node);
+    static int checkBalance(const Node* node);
+
+    // version bits: a node is unlinked for good when its version is exactly
+    // kUnlinked, and shrinking while kShrinking is set
+    static const std::uint64_t kUnlinked = 1;
+    static const std::uint64_t kShrinking = 2;
+    static const std::uint64_t kVersionStep = 4;
+
+    // nodeCondition results besides a repaired height
+    static const int kUnlinkRequired = -1;
+    static const int kRebalanceRequired = -2;
+    static const int kNothingRequired = -3;
+
+    mutable Link holder_;
+    mutable EpochReclaimer reclaimer_;
+    std::atomic<std::size_t> size_;
+};
+
+/*
+  -------------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree class.
+  -------------------------------------------------------
+*/
+
+template<class Key, class Value>
+ConcurrentAVLTree<Key, Value>::Link::Link(Value* v, Link* p) :
+    value(v),
+    height(1),
+    version(0),
+    parent(p),
+    left(nullptr),
+    right(nullptr),
+    locked(false)
+{
+}
+
+/**
+* Node locks are held for a handful of pointer writes, so a spin lock that
+* yields is cheaper than a mutex in every node.
+*/
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::Link::lock()
+{
+    while(locked.exchange(true, std::memory_order_acquire)) {
+        while(locked.load(std::memory_order_relaxed)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::Link::unlock()
+{
+    locked.store(false, std::memory_order_release);
+}
+
+/**
+* The left child for dir < 0, the right one otherwise.
+*/
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::Node* ConcurrentAVLTree<Key, Value>::Link::child(int dir) const
+{
+    return dir < 0 ? left.load() : right.load();
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::Link::setChild(int dir, Node* node)
+{
+    if(dir < 0) {
+        left.store(node);
+    }
+    else {
+        right.store(node);
+    }
+}
+
+template<class Key, class Value>
+ConcurrentAVLTree<Key, Value>::Node::Node(const Key& k, Value* v, Link* p) :
+    Link(v, p),
+    key(k)
+{
+}
+
+template<class Key, class Value>
+ConcurrentAVLTree<Key, Value>::ConcurrentAVLTree() :
+    holder_(nullptr, nullptr),
+    size_(0)
+{
+    holder_.height.store(0);
+}
+
+/**
+* Frees every node and value. No other thread may still use the tree.
+*/
+template<class Key, class Value>
+ConcurrentAVLTree<Key, Value>::~ConcurrentAVLTree()
+{
+    destroySubtree(holder_.right.load());
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::destroySubtree(Node* node)
+{
+    if(node == nullptr) {
+        return;
+    }
+    destroySubtree(node->left.load());
+    destroySubtree(node->right.load());
+    delete node->value.load();
+    delete node;
+}
+
+/**
+* Inserts the item, or replaces the value if the key is already there.
+* Returns true if the key was new.
+*/
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    Value* fresh = new Value(keyValuePair.second);
+    Outcome result;
+    {
+        EpochReclaimer::Guard guard(reclaimer_);
+        result = attemptPut(keyValuePair.first, fresh, &holder_, 1, 0);
+    }
+    reclaimer_.collectIfDue();
+    if(result == kAbsent) {
+        size_.fetch_add(1);
+    }
+    return result == kAbsent;
+}
+
+/**
+* Removes the key. Returns false if it was not in the tree.
+*/
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::remove(const Key& key)
+{
+    Outcome result;
+    {
+        EpochReclaimer::Guard guard(reclaimer_);
+        result = attemptRemove(key, &holder_, 1, 0);
+    }
+    reclaimer_.collectIfDue();
+    if(result == kPresent) {
+        size_.fetch_sub(1);
+    }
+    return result == kPresent;
+}
+
+/**
+* Copies the value stored under key into value. Never takes a lock.
+* Returns false, leaving value alone, if the key is not in the tree.
+*/
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::find(const Key& key, Value& value) const
+{
+    EpochReclaimer::Guard guard(reclaimer_);
+    Value* found = nullptr;
+    if(attemptGet(key, &holder_, 1, 0, found) != kPresent) {
+        return false;
+    }
+    value = *found;
+    return true;
+}
+
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::contains(const Key& key) const
+{
+    EpochReclaimer::Guard guard(reclaimer_);
+    Value* found = nullptr;
+    return attemptGet(key, &holder_, 1, 0, found) == kPresent;
+}
+
+/**
+* Calls fn(key, value) for every item with lo <= key < hi, in order,
+* without taking a lock. The walk is validated like a search; when a
+* rotation gets in the way it resumes just after the last key it reported.
+*/
+template<class Key, class Value>
+template<typename F>
+void ConcurrentAVLTree<Key, Value>::for_each_in_range(const Key& lo, const Key& hi, F fn) const
+{
+    EpochReclaimer::Guard guard(reclaimer_);
+    Key cursor(lo);
+    bool inclusive = true;
+    scanChild(&holder_, 1, 0, cursor, inclusive, hi, fn);
+}
+
+/**
+* Number of keys. Exact when no writer is running.
+*/
+template<class Key, class Value>
+std::size_t ConcurrentAVLTree<Key, Value>::size() const
+{
+    return size_.load();
+}
+
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::empty() const
+{
+    return size() == 0;
+}
+
+/**
+* Checks the AVL property from the actual shape of the tree. Only
+* meaningful when no writer is running.
+*/
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::isBalanced() const
+{
+    return checkBalance(holder_.right.load()) >= 0;
+}
+
+template<class Key, class Value>
+int ConcurrentAVLTree<Key, Value>::checkBalance(const Node* node)
+{
+    if(node == nullptr) {
+        return 0;
+    }
+    int hl = checkBalance(node->left.load());
+    int hr = checkBalance(node->right.load());
+    if(hl < 0 || hr < 0 || hl - hr > 1 || hr - hl > 1) {
+        return -1;
+    }
+    return std::max(hl, hr) + 1;
+}
+
+template<class Key, class Value>
+int ConcurrentAVLTree<Key, Value>::compare(const Key& a, const Key& b)
+{
+    if(a < b) {
+        return -1;
+    }
+    return b < a ? 1 : 0;
+}
+
+template<class Key, class Value>
+int ConcurrentAVLTree<Key, Value>::height(const Node* node)
+{
+    return node == nullptr ? 0 : node->height.load();
+}
+
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::canUnlink(const Node* node)
+{
+    return node->left.load() == nullptr || node->right.load() == nullptr;
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::waitUntilNotChanging(const Node* node)
+{
+    while((node->version.load() & kShrinking) != 0) {
+        std::this_thread::yield();
+    }
+}
+
+/**
+* Searches below node, whose version was nodeV when the search got there,
+* in direction dir. Returns kRetry if node changed under the search, in
+* which case the caller retries from node's parent.
+*/
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::Outcome
+ConcurrentAVLTree<Key, Value>::attemptGet(const Key& key, Link* node, int dir, std::uint64_t nodeV, Value*& found) const
+{
+    while(true) {
+        Node* child = node->child(dir);
+        if(node->version.load() != nodeV) {
+            return kRetry;
+        }
+        if(child == nullptr) {
+            return kAbsent;
+        }
+        int nextDir = compare(key, child->key);
+        if(nextDir == 0) {
+            found = child->value.load();
+            return found != nullptr ? kPresent : kAbsent;
+        }
+        std::uint64_t childV = child->version.load();
+        if((childV & kShrinking) != 0) {
+            waitUntilNotChanging(child);
+        }
+        else if(childV != kUnlinked && child == node->child(dir)) {
+            if(node->version.load() != nodeV) {
+                return kRetry;
+            }
+            Outcome result = attemptGet(key, child, nextDir, childV, found);
+            if(result != kRetry) {
+                return result;
+            }
+        }
+    }
+}
+
+/**
+* Same descent as attemptGet. Returns kAbsent if the key was inserted and
+* kPresent if an existing value was replaced.
+*/
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::Outcome
+ConcurrentAVLTree<Key, Value>::attemptPut(const Key& key, Value* fresh, Link* node, int dir, std::uint64_t nodeV)
+{
+    Outcome result = kRetry;
+    do {
+        Node* child = node->child(dir);
+        if(node->version.load() != nodeV) {
+            return kRetry;
+        }
+        if(child == nullptr) {
+            result = attemptInsert(key, fresh, node, dir, nodeV);
+        }
+        else {
+            int nextDir = compare(key, child->key);
+            if(nextDir == 0) {
+                result = attemptUpdate(child, fresh);
+            }
+            else {
+                std::uint64_t childV = child->version.load();
+                if((childV & kShrinking) != 0) {
+                    waitUntilNotChanging(child);
+                }
+                else if(childV != kUnlinked && child == node->child(dir)) {
+                    if(node->version.load() != nodeV) {
+                        return kRetry;
+                    }
+                    result = attemptPut(key, fresh, child, nextDir, childV);
+                }
+            }
+        }
+    } while(result == kRetry);
+    return result;
+}
+
+/**
+* Hangs a new leaf under node, provided node has not changed since the
+* search saw it, then repairs heights upwards.
+*/
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::Outcome
+ConcurrentAVLTree<Key, Value>::attemptInsert(const Key& key, Value* fresh, Link* node, int dir, std::uint64_t nodeV)
+{
+    {
+        std::lock_guard<Link> lock(*node);
+        if(node->version.load() != nodeV || node->child(dir) != nullptr) {
+            return kRetry;
+        }
+        node->setChild(dir, new Node(key, fresh, node));
+    }
+    fixHeightAndRebalance(node);
+    return kAbsent;
+}
+
+/**
+* Swaps in a new value. A routing node that gets a value back counts as
+* an insert.
+*/
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::Outcome
+ConcurrentAVLTree<Key, Value>::attemptUpdate(Node* node, Value* fresh)
+{
+    Value* old = nullptr;
+    {
+        std::lock_guard<Link> lock(*node);
+        if(node->version.load() == kUnlinked) {
+            return kRetry;
+        }
+        old = node->value.exchange(fresh);
+    }
+    if(old == nullptr) {
+        return kAbsent;
+    }
+    reclaimer_.retire(old);
+    return kPresent;
+}
+
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::Outcome
+ConcurrentAVLTree<Key, Value>::attemptRemove(const Key& key, Link* node, int dir, std::uint64_t nodeV)
+{
+    Outcome result = kRetry;
+    do {
+        Node* child = node->child(dir);
+        if(node->version.load() != nodeV) {
+            return kRetry;
+        }
+        if(child == nullptr) {
+            return kAbsent;
+        }
+        int nextDir = compare(key, child->key);
+        if(nextDir == 0) {
+            result = attemptRemoveNode(node, child);
+        }
+        else {
+            std::uint64_t childV = child->version.load();
+            if((childV & kShrinking) != 0) {
+                waitUntilNotChanging(child);
+            }
+            else if(childV != kUnlinked && child == node->child(dir)) {
+                if(node->version.load() != nodeV) {
+                    return kRetry;
+                }
+                result = attemptRemove(key, child, nextDir, childV);
+            }
+        }
+    } while(result == kRetry);
+    return result;
+}
+
+/**
+* Removes node's value. A node with at most one child is spliced out
+* right away; one with two children becomes a routing node and is
+* spliced out later by whoever leaves it with fewer children.
+*/
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::Outcome
+ConcurrentAVLTree<Key, Value>::attemptRemoveNode(Link* parent, Node* node)
+{
+    if(node->value.load() == nullptr) {
+        return kAbsent;
+    }
+    Value* prev = nullptr;
+    if(!canUnlink(node)) {
+        std::lock_guard<Link> lock(*node);
+        if(node->version.load() == kUnlinked || canUnlink(node)) {
+            return kRetry;
+        }
+        prev = node->value.exchange(nullptr);
+    }
+    else {
+        {
+            std::lock_guard<Link> parentLock(*parent);
+            if(parent->version.load() == kUnlinked || node->parent.load() != parent || node->version.load() == kUnlinked) {
+                return kRetry;
+            }
+            std::lock_guard<Link> lock(*node);
+            if(!canUnlink(node)) {
+                return kRetry;
+            }
+            prev = node->value.exchange(nullptr);
+            Node* splice = node->left.load() != nullptr ? node->left.load() : node->right.load();
+            if(parent->left.load() == node) {
+                parent->left.store(splice);
+            }
+            else {
+                parent->right.store(splice);
+            }
+            if(splice != nullptr) {
+                splice->parent.store(parent);
+            }
+            node->version.store(kUnlinked);
+        }
+        reclaimer_.retire(node);
+        fixHeightAndRebalance(parent);
+    }
+    if(prev == nullptr) {
+        return kAbsent;
+    }
+    reclaimer_.retire(prev);
+    return kPresent;
+}
+
+/**
+* Walks the subtree hanging off node in direction dir for a range scan.
+* Returns kPresent once the scan has passed hi, kAbsent when the subtree
+* is done and kRetry if node changed under the walk.
+*/
+template<class Key, class Value>
+template<typename F>
+typename ConcurrentAVLTree<Key, Value>::Outcome
+ConcurrentAVLTree<Key, Value>::scanChild(Link* node, int dir, std::uint64_t nodeV, Key& cursor, bool& inclusive,
+                                         const Key& hi, F& fn) const
+{
+    while(true) {
+        Node* child = node->child(dir);
+        if(node->version.load() != nodeV) {
+            return kRetry;
+        }
+        if(child == nullptr) {
+            return kAbsent;
+        }
+        std::uint64_t childV = child->version.load();
+        if((childV & kShrinking) != 0) {
+            waitUntilNotChanging(child);
+        }
+        else if(childV != kUnlinked && child == node->child(dir)) {
+            if(node->version.load() != nodeV) {
+                return kRetry;
+            }
+            Outcome result = scanNode(child, childV, cursor, inclusive, hi, fn);
+            if(result != kRetry) {
+                return result;
+            }
+        }
+    }
+}
+
+/**
+* In-order step of a range scan. Keys up to cursor have been reported
+* already, so a retried walk skips straight past them.
+*/
+template<class Key, class Value>
+template<typename F>
+typename ConcurrentAVLTree<Key, Value>::Outcome
+ConcurrentAVLTree<Key, Value>::scanNode(Node* node, std::uint64_t nodeV, Key& cursor, bool& inclusive,
+                                        const Key& hi, F& fn) const
+{
+    if(cursor < node->key) {
+        Outcome result = scanChild(node, -1, nodeV, cursor, inclusive, hi, fn);
+        if(result != kAbsent) {
+            return result;
+        }
+    }
+    if(!(node->key < hi)) {
+        return kPresent;
+    }
+    if(inclusive ? !(node->key < cursor) : cursor < node->key) {
+        Value* v = node->value.load();
+        if(node->version.load() != nodeV) {
+            return kRetry;
+        }
+        if(v != nullptr) {
+            fn(node->key, *v);
+            cursor = node->key;
+            inclusive = false;
+        }
+    }
+    return scanChild(node, 1, nodeV, cursor, inclusive, hi, fn);
+}
+
+/**
+* Repairs heights, balance and routing nodes from node upwards until
+* nothing is left to do, locking at most a parent, its child and two
+* grandchildren at a time. The unlocked check is enough to stop: anyone
+* who changes a child's height afterwards holds node's lock to do it and
+* comes up here to check node again.
+*/
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::fixHeightAndRebalance(Link* node)
+{
+    std::vector<Link*> revisit;
+    while(true) {
+        if(node == nullptr || node->parent.load() == nullptr || node->version.load() == kUnlinked
+           || nodeCondition(node) == kNothingRequired) {
+            if(revisit.empty()) {
+                return;
+            }
+            node = revisit.back();
+            revisit.pop_back();
+            continue;
+        }
+        Link* nParent = node->parent.load();
+        std::lock_guard<Link> parentLock(*nParent);
+        if(nParent->version.load() != kUnlinked && node->parent.load() == nParent) {
+            std::lock_guard<Link> lock(*node);
+            node = rebalanceLocked(nParent, static_cast<Node*>(node), revisit);
+        }
+    }
+}
+
+/**
+* What node needs: kUnlinkRequired for a routing node with a free child
+* slot, kRebalanceRequired if its children's heights differ by more than
+* one, its correct height if the stored one is off, kNothingRequired
+* otherwise.
+*/
+template<class Key, class Value>
+int ConcurrentAVLTree<Key, Value>::nodeCondition(Link* node) const
+{
+    Node* nL = node->left.load();
+    Node* nR = node->right.load();
+    if((nL == nullptr || nR == nullptr) && node->value.load() == nullptr) {
+        return kUnlinkRequired;
+    }
+    int hN = node->height.load();
+    int hL0 = height(nL);
+    int hR0 = height(nR);
+    int hNRepl = 1 + std::max(hL0, hR0);
+    int bal = hL0 - hR0;
+    if(bal < -1 || bal > 1) {
+        return kRebalanceRequired;
+    }
+    return hN != hNRepl ? hNRepl : kNothingRequired;
+}
+
+/**
+* Splices out, rotates or fixes the height of n, with nParent and n
+* locked. Returns the next node that may need repair (n again if it still
+* does, nParent if its height may be off now), or nullptr when done.
+*/
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::Link*
+ConcurrentAVLTree<Key, Value>::rebalanceLocked(Link* nParent, Node* n, std::vector<Link*>& revisit)
+{
+    Node* nL = n->left.load();
+    Node* nR = n->right.load();
+    if((nL == nullptr || nR == nullptr) && n->value.load() == nullptr) {
+        if(attemptUnlinkLocked(nParent, n)) {
+            return nParent;
+        }
+        return n;
+    }
+    int hN = n->height.load();
+    int hL0 = height(nL);
+    int hR0 = height(nR);
+    int hNRepl = 1 + std::max(hL0, hR0);
+    int bal = hL0 - hR0;
+    if(bal > 1 || bal < -1) {
+        // a rotation changes the height under nParent, but may hand back
+        // damage further down first
+        revisit.push_back(nParent);
+        if(bal > 1) {
+            return rebalanceToRight(nParent, n, nL, hR0, revisit);
+        }
+        return rebalanceToLeft(nParent, n, nR, hL0, revisit);
+    }
+    if(hNRepl != hN) {
+        n->height.store(hNRepl);
+        return nParent;
+    }
+    return nullptr;
+}
+
+/**
+* n is left heavy: rotate right, first rotating nL left if its inner
+* subtree is the taller one. Heights of n's and nL's children cannot
+* change while both are locked.
+*/
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::Link*
+ConcurrentAVLTree<Key, Value>::rebalanceToRight(Link* nParent, Node* n, Node* nL, int hR0, std::vector<Link*>& revisit)
+{
+    std::lock_guard<Link> leftLock(*nL);
+    int hL = nL->height.load();
+    if(hL - hR0 <= 1) {
+        return n;
+    }
+    Node* nLR = nL->right.load();
+    int hLL0 = height(nL->left.load());
+    int hLR0 = height(nLR);
+    if(hLL0 >= hLR0) {
+        return rightRotate(nParent, n, nL, hR0, hLL0, nLR, hLR0);
+    }
+    std::lock_guard<Link> innerLock(*nLR);
+    int hLRL = height(nLR->left.load());
+    int b = hLL0 - hLRL;
+    if(b >= -1 && b <= 1 && !((hLL0 == 0 || hLRL == 0) && nL->value.load() == nullptr)) {
+        return leftRightRotate(nParent, n, nL, hR0, hLL0, nLR, hLRL);
+    }
+    // a double rotation would leave nL damaged beside n instead of below
+    // it, so straighten nL out with a rotation of its own first (even if it
+    // is within balance) and come back to n afterwards
+    revisit.push_back(n);
+    return leftRotate(n, nL, hLL0, nLR, nLR->left.load(), hLRL, height(nLR->right.load()));
+}
+
+/**
+* Mirror image of rebalanceToRight.
+*/
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::Link*
+ConcurrentAVLTree<Key, Value>::rebalanceToLeft(Link* nParent, Node* n, Node* nR, int hL0, std::vector<Link*>& revisit)
+{
+    std::lock_guard<Link> rightLock(*nR);
+    int hR = nR->height.load();
+    if(hL0 - hR >= -1) {
+        return n;
+    }
+    Node* nRL = nR->left.load();
+    int hRL0 = height(nRL);
+    int hRR0 = height(nR->right.load());
+    if(hRR0 >= hRL0) {
+        return leftRotate(nParent, n, hL0, nR, nRL, hRL0, hRR0);
+    }
+    std::lock_guard<Link> innerLock(*nRL);
+    int hRLR = height(nRL->right.load());
+    int b = hRR0 - hRLR;
+    if(b >= -1 && b <= 1 && !((hRR0 == 0 || hRLR == 0) && nR->value.load() == nullptr)) {
+        return rightLeftRotate(nParent, n, hL0, nR, nRL, hRR0, hRLR);
+    }
+    revisit.push_back(n);
+    return rightRotate(n, nR, nRL, hRR0, height(nRL->left.load()), nRL->right.load(), hRLR);
+}
+
+/**
+* Rotates nL up into n's place. n loses nL's left subtree, so it is
+* marked shrinking for the duration; nL only gains keys. Returns the
+* deepest node the rotation left damaged.
+*/
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::Link*
+ConcurrentAVLTree<Key, Value>::rightRotate(Link* nParent, Node* n, Node* nL, int hR, int hLL, Node* nLR, int hLR)
+{
+    std::uint64_t nodeV = n->version.load();
+    n->version.store(nodeV | kShrinking);
+
+    Node* nPL = nParent->left.load();
+    n->left.store(nLR);
+    if(nLR != nullptr) {
+        nLR->parent.store(n);
+    }
+    nL->right.store(n);
+    n->parent.store(nL);
+    if(nPL == n) {
+        nParent->left.store(nL);
+    }
+    else {
+        nParent->right.store(nL);
+    }
+    nL->parent.store(nParent);
+
+    int hNRepl = 1 + std::max(hLR, hR);
+    n->height.store(hNRepl);
+    nL->height.store(1 + std::max(hLL, hNRepl));
+
+    n->version.store(nodeV + kVersionStep);
+
+    int balN = hLR - hR;
+    if(balN < -1 || balN > 1) {
+        return n;
+    }
+    if((nLR == nullptr || hR == 0) && n->value.load() == nullptr) {
+        return n;
+    }
+    int balL = hLL - hNRepl;
+    if(balL < -1 || balL > 1) {
+        return nL;
+    }
+    if(hLL == 0 && nL->value.load() == nullptr) {
+        return nL;
+    }
+    return nParent;
+}
+
+/**
+* Mirror image of rightRotate.
+*/
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::Link*
+ConcurrentAVLTree<Key, Value>::leftRotate(Link* nParent, Node* n, int hL, Node* nR, Node* nRL, int hRL, int hRR)
+{
+    std::uint64_t nodeV = n->version.load();
+    n->version.store(nodeV | kShrinking);
+
+    Node* nPL = nParent->left.load();
+    n->right.store(nRL);
+    if(nRL != nullptr) {
+        nRL->parent.store(n);
+    }
+    nR->left.store(n);
+    n->parent.store(nR);
+    if(nPL == n) {
+        nParent->left.store(nR);
+    }
+    else {
+        nParent->right.store(nR);
+    }
+    nR->parent.store(nParent);
+
+    int hNRepl = 1 + std::max(hL, hRL);
+    n->height.store(hNRepl);
+    nR->height.store(1 + std::max(hNRepl, hRR));
+
+    n->version.store(nodeV + kVersionStep);
+
+    int balN = hRL - hL;
+    if(balN < -1 || balN > 1) {
+        return n;
+    }
+    if((nRL == nullptr || hL == 0) && n->value.load() == nullptr) {
+        return n;
+    }
+    int balR = hRR - hNRepl;
+    if(balR < -1 || balR > 1) {
+        return nR;
+    }
+    if(hRR == 0 && nR->value.load() == nullptr) {
+        return nR;
+    }
+    return nParent;
+}
+
+/**
+* Double rotation: nLR moves up into n's place with nL on its left and n
+* on its right. Both n and nL shrink.
+*/
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::Link*
+ConcurrentAVLTree<Key, Value>::leftRightRotate(Link* nParent, Node* n, Node* nL, int hR, int hLL, Node* nLR, int hLRL)
+{
+    std::uint64_t nodeV = n->version.load();
+    std::uint64_t leftV = nL->version.load();
+
+    Node* nPL = nParent->left.load();
+    Node* nLRL = nLR->left.load();
+    Node* nLRR = nLR->right.load();
+    int hLRR = height(nLRR);
+
+    n->version.store(nodeV | kShrinking);
+    nL->version.store(leftV | kShrinking);
+
+    n->left.store(nLRR);
+    if(nLRR != nullptr) {
+        nLRR->parent.store(n);
+    }
+    nL->right.store(nLRL);
+    if(nLRL != nullptr) {
+        nLRL->parent.store(nL);
+    }
+    nLR->left.store(nL);
+    nL->parent.store(nLR);
+    nLR->right.store(n);
+    n->parent.store(nLR);
+    if(nPL == n) {
+        nParent->left.store(nLR);
+    }
+    else {
+        nParent->right.store(nLR);
+    }
+    nLR->parent.store(nParent);
+
+    int hNRepl = 1 + std::max(hLRR, hR);
+    n->height.store(hNRepl);
+    int hLRepl = 1 + std::max(hLL, hLRL);
+    nL->height.store(hLRepl);
+    nLR->height.store(1 + std::max(hLRepl, hNRepl));
+
+    n->version.store(nodeV + kVersionStep);
+    nL->version.store(leftV + kVersionStep);
+
+    int balN = hLRR - hR;
+    if(balN < -1 || balN > 1) {
+        return n;
+    }
+    if((nLRR == nullptr || hR == 0) && n->value.load() == nullptr) {
+        return n;
+    }
+    int balLR = hLRepl - hNRepl;
+    if(balLR < -1 || balLR > 1) {
+        return nLR;
+    }
+    return nParent;
+}
+
+/**
+* Mirror image of leftRightRotate.
+*/
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::Link*
+ConcurrentAVLTree<Key, Value>::rightLeftRotate(Link* nParent, Node* n, int hL, Node* nR, Node* nRL, int hRR, int hRLR)
+{
+    std::uint64_t nodeV = n->version.load();
+    std::uint64_t rightV = nR->version.load();
+
+    Node* nPL = nParent->left.load();
+    Node* nRLL = nRL->left.load();
+    Node* nRLR = nRL->right.load();
+    int hRLL = height(nRLL);
+
+    n->version.store(nodeV | kShrinking);
+    nR->version.store(rightV | kShrinking);
+
+    n->right.store(nRLL);
+    if(nRLL != nullptr) {
+        nRLL->parent.store(n);
+    }
+    nR->left.store(nRLR);
+    if(nRLR != nullptr) {
+        nRLR->parent.store(nR);
+    }
+    nRL->right.store(nR);
+    nR->parent.store(nRL);
+    nRL->left.store(n);
+    n->parent.store(nRL);
+    if(nPL == n) {
+        nParent->left.store(nRL);
+    }
+    else {
+        nParent->right.store(nRL);
+    }
+    nRL->parent.store(nParent);
+
+    int hNRepl = 1 + std::max(hL, hRLL);
+    n->height.store(hNRepl);
+    int hRRepl = 1 + std::max(hRLR, hRR);
+    nR->height.store(hRRepl);
+    nRL->height.store(1 + std::max(hNRepl, hRRepl));
+
+    n->version.store(nodeV + kVersionStep);
+    nR->version.store(rightV + kVersionStep);
+
+    int balN = hRLL - hL;
+    if(balN < -1 || balN > 1) {
+        return n;
+    }
+    if((nRLL == nullptr || hL == 0) && n->value.load() == nullptr) {
+        return n;
+    }
+    int balRL = hRRepl - hNRepl;
+    if(balRL < -1 || balRL > 1) {
+        return nRL;
+    }
+    return nParent;
+}
+
+/**
+* Splices out a routing node that has at most one child. Both nodes are
+* locked by the caller. Returns false if that is no longer possible.
+*/
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::attemptUnlinkLocked(Link* parent, Node* node)
+{
+    Node* parentL = parent->left.load();
+    Node* parentR = parent->right.load();
+    if(parentL != node && parentR != node) {
+        return false;
+    }
+    Node* left = node->left.load();
+    Node* right = node->right.load();
+    if(left != nullptr && right != nullptr) {
+        return false;
+    }
+    Node* splice = left != nullptr ? left : right;
+    if(parentL == node) {
+        parent->left.store(splice);
+    }
+    else {
+        parent->right.store(splice);
+    }
+    if(splice != nullptr) {
+        splice->parent.store(parent);
+    }
+    node->version.store(kUnlinked);
+    reclaimer_.retire(node);
+    return true;
+}
+
+/*
+  -----------------------------------------------------
+  End implementations for the ConcurrentAVLTree class.
+  -----------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,250 @@
+#ifndef EPOCH_RECLAIMER_H
+#define EPOCH_RECLAIMER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+/**
+* Epoch based memory reclamation for structures that readers walk without
+* taking locks.
+*
+* A thread that is about to follow shared pointers holds a Guard, which
+* announces the global epoch it started in. An object that has been
+* unlinked is handed to retire() instead of being deleted, stamped with
+* the epoch at the time. collect() advances the epoch and deletes every
+* retired object whose stamp is older than the oldest epoch still
+* announced: no thread that could have seen the object before it was
+* unlinked is still inside its guard.
+*
+* Guards do not belong to threads. Entering one claims any free announce
+* slot and leaving it frees the slot again, so there is nothing to
+* register and nothing to clean up when a thread exits.
+*/
+class EpochReclaimer
+{
+public:
+    EpochReclaimer();
+    ~EpochReclaimer();
+
+    class Guard
+    {
+    public:
+        explicit Guard(EpochReclaimer& reclaimer);
+        ~Guard();
+    private:
+        Guard(const Guard&);
+        Guard& operator=(const Guard&);
+
+        std::atomic<std::uint64_t>* slot_;
+    };
+
+    template<typename T>
+    void retire(T* object);
+    void collect();
+    void collectIfDue();
+
+private:
+    EpochReclaimer(const EpochReclaimer&);
+    EpochReclaimer& operator=(const EpochReclaimer&);
+
+    struct Retired
+    {
+        Retired* next;
+        void* object;
+        void (*destroy)(void*);
+        std::uint64_t epoch;
+    };
+    // one announce slot per cache line, so that guards entered on different
+    // cores do not bounce the same line around
+    struct Slot
+    {
+        std::atomic<std::uint64_t> epoch;
+        char pad[64 - sizeof(std::atomic<std::uint64_t>)];
+    };
+
+    template<typename T>
+    static void destroy(void* object);
+    void pushRetired(Retired* first, Retired* last);
+    std::atomic<std::uint64_t>* enter();
+
+    static const std::size_t kSlots = 64;
+    static const std::size_t kCollectEvery = 128;
+
+    std::atomic<std::uint64_t> epoch_;
+    Slot slots_[kSlots];
+    std::atomic<Retired*> retired_;
+    std::atomic<std::size_t> pending_;
+    std::atomic<bool> collecting_;
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the EpochReclaimer class.
+  ---------------------------------------------------
+*/
+
+/**
+* Epochs start at 1; an announce slot holding 0 is free.
+*/
+inline EpochReclaimer::EpochReclaimer() :
+    epoch_(1),
+    retired_(nullptr),
+    pending_(0),
+    collecting_(false)
+{
+    for(std::size_t i = 0; i < kSlots; i++) {
+        slots_[i].epoch.store(0);
+    }
+}
+
+/**
+* Deletes everything still waiting to be reclaimed. No guard may be live.
+*/
+inline EpochReclaimer::~EpochReclaimer()
+{
+    Retired* r = retired_.load();
+    while(r != nullptr) {
+        Retired* next = r->next;
+        r->destroy(r->object);
+        delete r;
+        r = next;
+    }
+}
+
+/**
+* Announces the current epoch in a free slot. The epoch is read again
+* after the announcement so that a collect() running in between cannot
+* miss this thread.
+*/
+inline std::atomic<std::uint64_t>* EpochReclaimer::enter()
+{
+    static thread_local std::size_t hint = std::hash<std::thread::id>()(std::this_thread::get_id());
+    std::uint64_t e = epoch_.load();
+    std::size_t i = hint % kSlots;
+    std::uint64_t expected = 0;
+    while(!slots_[i].epoch.compare_exchange_weak(expected, e)) {
+        expected = 0;
+        i = (i + 1) % kSlots;
+        if(i == hint % kSlots) {
+            std::this_thread::yield();
+        }
+    }
+    hint = i;
+    std::uint64_t now = epoch_.load();
+    while(now != e) {
+        e = now;
+        slots_[i].epoch.store(e);
+        now = epoch_.load();
+    }
+    return &slots_[i].epoch;
+}
+
+inline EpochReclaimer::Guard::Guard(EpochReclaimer& reclaimer) :
+    slot_(reclaimer.enter())
+{
+}
+
+inline EpochReclaimer::Guard::~Guard()
+{
+    slot_->store(0);
+}
+
+/**
+* Hands an unlinked object over for deletion once no guard that might
+* still see it is live.
+*/
+template<typename T>
+void EpochReclaimer::retire(T* object)
+{
+    if(object == nullptr) {
+        return;
+    }
+    Retired* r = new Retired;
+    r->object = object;
+    r->destroy = &EpochReclaimer::destroy<T>;
+    r->epoch = epoch_.load();
+    pushRetired(r, r);
+    pending_.fetch_add(1);
+}
+
+template<typename T>
+void EpochReclaimer::destroy(void* object)
+{
+    delete static_cast<T*>(object);
+}
+
+/**
+* Pushes the chain first..last onto the retired list.
+*/
+inline void EpochReclaimer::pushRetired(Retired* first, Retired* last)
+{
+    Retired* head = retired_.load();
+    do {
+        last->next = head;
+    } while(!retired_.compare_exchange_weak(head, first));
+}
+
+/**
+* Advances the epoch and deletes whatever no guard can see any more. Only
+* one thread collects at a time; the others return straight away.
+*/
+inline void EpochReclaimer::collect()
+{
+    if(collecting_.exchange(true)) {
+        return;
+    }
+    std::uint64_t oldest = epoch_.fetch_add(1) + 1;
+    for(std::size_t i = 0; i < kSlots; i++) {
+        std::uint64_t e = slots_[i].epoch.load();
+        if(e != 0 && e < oldest) {
+            oldest = e;
+        }
+    }
+    Retired* r = retired_.exchange(nullptr);
+    Retired* keep = nullptr;
+    Retired* keepTail = nullptr;
+    std::size_t freed = 0;
+    while(r != nullptr) {
+        Retired* next = r->next;
+        if(r->epoch < oldest) {
+            r->destroy(r->object);
+            delete r;
+            freed++;
+        }
+        else {
+            r->next = keep;
+            if(keep == nullptr) {
+                keepTail = r;
+            }
+            keep = r;
+        }
+        r = next;
+    }
+    if(keep != nullptr) {
+        pushRetired(keep, keepTail);
+    }
+    pending_.fetch_sub(freed);
+    collecting_.store(false);
+}
+
+/**
+* Runs collect() once enough objects have piled up. Call it outside of
+* any guard, or the caller's own epoch holds everything back.
+*/
+inline void EpochReclaimer::collectIfDue()
+{
+    if(pending_.load() >= kCollectEvery) {
+        collect();
+    }
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the EpochReclaimer class.
+  -------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,449 @@
+#ifndef FROZEN_AVLBST_H
+#define FROZEN_AVLBST_H
+
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include "bst.h"
+
+/**
+* A read-only copy of a search tree's contents, laid out for lookups.
+*
+* Keys are stored in one array in Eytzinger order: the implicit tree of
+* a binary heap, root at 1, children of k at 2k and 2k + 1, filled so
+* that an in-order walk of it yields the keys sorted. Values sit in a
+* parallel array at the same positions. A search walks k -> 2k + (key
+* smaller) with no branch to mispredict. The top levels share a few
+* cache lines, and the line holding the descendants 4 levels below is
+* prefetched while the current key is compared, so a lookup is a short
+* run of overlapping loads instead of a chain of dependent pointer
+* misses.
+*
+* Nothing can be inserted or removed; build a new one instead (see
+* AVLTree::freeze()). Iteration and range scans walk the implicit tree
+* in order, amortized O(1) a step.
+*/
+template<class Key, class Value, class Compare = std::less<Key> >
+class FrozenAVLTree
+{
+public:
+    class iterator;
+    typedef iterator const_iterator;
+
+    FrozenAVLTree();
+    template<typename ForwardIt>
+    FrozenAVLTree(ForwardIt first, ForwardIt last);
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    Value const & at(const Key& key) const;
+    template<typename F>
+    void for_each_in_range(const Key& lo, const Key& hi, F fn) const;
+
+    std::size_t size() const;
+    bool empty() const;
+
+    /**
+    * Items are not stored as pairs, so dereferencing yields a pair of
+    * references into the key and value arrays.
+    */
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key&, const Value&> reference;
+
+        struct pointer
+        {
+            reference item;
+            const reference* operator->() const { return &item; }
+        };
+
+        iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator& operator--();
+
+    private:
+        friend class FrozenAVLTree<Key, Value, Compare>;
+        iterator(std::size_t k, const FrozenAVLTree* tree);
+        // position in the implicit tree, 0 for end()
+        std::size_t k_;
+        const FrozenAVLTree* tree_;
+    };
+
+private:
+    std::size_t lowerBound(const Key& key) const;
+    std::size_t upperBound(const Key& key) const;
+    std::size_t first() const;
+    std::size_t last() const;
+    std::size_t next(std::size_t k) const;
+    std::size_t prev(std::size_t k) const;
+    static void prefetch(const void* p);
+
+    // keys_[k - 1] and values_[k - 1] belong to position k
+    std::vector<Key> keys_;
+    std::vector<Value> values_;
+    // how many positions ahead of k the prefetch reaches (4 levels)
+    static const std::size_t kPrefetchLevels = 16;
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the FrozenAVLTree class.
+  ---------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+FrozenAVLTree<Key, Value, Compare>::FrozenAVLTree()
+{
+
+}
+
+/**
+* Builds the layout from items sorted by key with no key repeated, e.g.
+* an AVLTree's begin() and end(). Throws std::invalid_argument for
+* anything else.
+*/
+template<class Key, class Value, class Compare>
+template<typename ForwardIt>
+FrozenAVLTree<Key, Value, Compare>::FrozenAVLTree(ForwardIt first, ForwardIt last)
+{
+    std::vector<ForwardIt> sorted;
+    for(ForwardIt it = first; it != last; ++it){
+        if(!sorted.empty() && !KeyOrder<Compare>::less(sorted.back()->first, it->first)){
+            throw std::invalid_argument("FrozenAVLTree: keys must be sorted and distinct");
+        }
+        sorted.push_back(it);
+    }
+    std::size_t n = sorted.size();
+    //position k holds the item of in-order rank rank[k - 1]
+    std::vector<std::size_t> rank(n);
+    std::size_t r = 0;
+    std::size_t k = 1;
+    while(n > 0 && 2 * k <= n){
+        k = 2 * k;
+    }
+    for(std::size_t i = 0; i < n; i++){
+        rank[k - 1] = r++;
+        if(2 * k + 1 <= n){
+            k = 2 * k + 1;
+            while(2 * k <= n){
+                k = 2 * k;
+            }
+        }
+        else{
+            while(k & 1){
+                k >>= 1;
+            }
+            k >>= 1;
+        }
+    }
+    keys_.reserve(n);
+    values_.reserve(n);
+    for(std::size_t i = 0; i < n; i++){
+        keys_.push_back(sorted[rank[i]]->first);
+        values_.push_back(sorted[rank[i]]->second);
+    }
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenAVLTree<Key, Value, Compare>::iterator FrozenAVLTree<Key, Value, Compare>::begin() const
+{
+    return iterator(first(), this);
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenAVLTree<Key, Value, Compare>::iterator FrozenAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator(0, this);
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenAVLTree<Key, Value, Compare>::iterator FrozenAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    std::size_t k = lowerBound(key);
+    if(k == 0 || KeyOrder<Compare>::less(key, keys_[k - 1])){
+        return end();
+    }
+    return iterator(k, this);
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenAVLTree<Key, Value, Compare>::iterator FrozenAVLTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return iterator(lowerBound(key), this);
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenAVLTree<Key, Value, Compare>::iterator FrozenAVLTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    return iterator(upperBound(key), this);
+}
+
+/**
+* The value stored under key. Throws std::out_of_range if there is none.
+*/
+template<class Key, class Value, class Compare>
+Value const & FrozenAVLTree<Key, Value, Compare>::at(const Key& key) const
+{
+    std::size_t k = lowerBound(key);
+    if(k == 0 || KeyOrder<Compare>::less(key, keys_[k - 1])){
+        throw std::out_of_range("Invalid key");
+    }
+    return values_[k - 1];
+}
+
+/**
+* Calls fn(item) for every item with lo <= key < hi, in order, where item
+* is a pair of references to the key and the value.
+*/
+template<class Key, class Value, class Compare>
+template<typename F>
+void FrozenAVLTree<Key, Value, Compare>::for_each_in_range(const Key& lo, const Key& hi, F fn) const
+{
+    std::size_t k = lowerBound(lo);
+    while(k != 0 && KeyOrder<Compare>::less(keys_[k - 1], hi)){
+        fn(typename iterator::reference(keys_[k - 1], values_[k - 1]));
+        k = next(k);
+    }
+}
+
+template<class Key, class Value, class Compare>
+std::size_t FrozenAVLTree<Key, Value, Compare>::size() const
+{
+    return keys_.size();
+}
+
+template<class Key, class Value, class Compare>
+bool FrozenAVLTree<Key, Value, Compare>::empty() const
+{
+    return keys_.empty();
+}
+
+/**
+* Position of the smallest key >= key, or 0. The descent goes right
+* whenever the key at k is smaller, and stops below a leaf. The answer is
+* the last position where it went left, which the trailing 1 bits of k
+* (the right turns after it) plus one more shift strip off.
+*/
+template<class Key, class Value, class Compare>
+std::size_t FrozenAVLTree<Key, Value, Compare>::lowerBound(const Key& key) const
+{
+    const std::size_t n = keys_.size();
+    const Key* keys = keys_.data();
+    std::size_t k = 1;
+    while(k <= n){
+        prefetch(keys + std::min(k * kPrefetchLevels, n) - 1);
+        k = 2 * k + static_cast<std::size_t>(KeyOrder<Compare>::less(keys[k - 1], key));
+    }
+    while(k & 1){
+        k >>= 1;
+    }
+    return k >> 1;
+}
+
+/**
+* Position of the smallest key > key, or 0, like lowerBound.
+*/
+template<class Key, class Value, class Compare>
+std::size_t FrozenAVLTree<Key, Value, Compare>::upperBound(const Key& key) const
+{
+    const std::size_t n = keys_.size();
+    const Key* keys = keys_.data();
+    std::size_t k = 1;
+    while(k <= n){
+        prefetch(keys + std::min(k * kPrefetchLevels, n) - 1);
+        k = 2 * k + static_cast<std::size_t>(!KeyOrder<Compare>::less(key, keys[k - 1]));
+    }
+    while(k & 1){
+        k >>= 1;
+    }
+    return k >> 1;
+}
+
+/**
+* Position of the smallest key: all the way left. 0 if empty.
+*/
+template<class Key, class Value, class Compare>
+std::size_t FrozenAVLTree<Key, Value, Compare>::first() const
+{
+    std::size_t n = keys_.size();
+    if(n == 0){
+        return 0;
+    }
+    std::size_t k = 1;
+    while(2 * k <= n){
+        k = 2 * k;
+    }
+    return k;
+}
+
+/**
+* Position of the largest key: all the way right. 0 if empty.
+*/
+template<class Key, class Value, class Compare>
+std::size_t FrozenAVLTree<Key, Value, Compare>::last() const
+{
+    std::size_t n = keys_.size();
+    if(n == 0){
+        return 0;
+    }
+    std::size_t k = 1;
+    while(2 * k + 1 <= n){
+        k = 2 * k + 1;
+    }
+    return k;
+}
+
+/**
+* In-order successor of position k, or 0 after the largest: the leftmost
+* position of the right subtree if there is one, otherwise the first
+* ancestor reached from its left.
+*/
+template<class Key, class Value, class Compare>
+std::size_t FrozenAVLTree<Key, Value, Compare>::next(std::size_t k) const
+{
+    std::size_t n = keys_.size();
+    if(2 * k + 1 <= n){
+        k = 2 * k + 1;
+        while(2 * k <= n){
+            k = 2 * k;
+        }
+        return k;
+    }
+    while(k & 1){
+        k >>= 1;
+    }
+    return k >> 1;
+}
+
+/**
+* In-order predecessor of position k, or 0 before the smallest. The mirror
+* image of next().
+*/
+template<class Key, class Value, class Compare>
+std::size_t FrozenAVLTree<Key, Value, Compare>::prev(std::size_t k) const
+{
+    std::size_t n = keys_.size();
+    if(2 * k <= n){
+        k = 2 * k;
+        while(2 * k + 1 <= n){
+            k = 2 * k + 1;
+        }
+        return k;
+    }
+    while(k != 0 && !(k & 1)){
+        k >>= 1;
+    }
+    return k >> 1;
+}
+
+/**
+* Starts loading p's cache line. Does nothing on compilers without a
+* prefetch builtin.
+*/
+template<class Key, class Value, class Compare>
+void FrozenAVLTree<Key, Value, Compare>::prefetch(const void* p)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p, 0, 3);
+#endif
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the FrozenAVLTree class.
+  -------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------------------------
+  Begin implementations for the FrozenAVLTree::iterator class.
+  ---------------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+FrozenAVLTree<Key, Value, Compare>::iterator::iterator() :
+    k_(0),
+    tree_(nullptr)
+{
+
+}
+
+template<class Key, class Value, class Compare>
+FrozenAVLTree<Key, Value, Compare>::iterator::iterator(std::size_t k, const FrozenAVLTree* tree) :
+    k_(k),
+    tree_(tree)
+{
+
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenAVLTree<Key, Value, Compare>::iterator::reference
+FrozenAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return reference(tree_->keys_[k_ - 1], tree_->values_[k_ - 1]);
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenAVLTree<Key, Value, Compare>::iterator::pointer
+FrozenAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    pointer p = { **this };
+    return p;
+}
+
+template<class Key, class Value, class Compare>
+bool FrozenAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return k_ == rhs.k_;
+}
+
+template<class Key, class Value, class Compare>
+bool FrozenAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return k_ != rhs.k_;
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenAVLTree<Key, Value, Compare>::iterator&
+FrozenAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    k_ = tree_->next(k_);
+    return *this;
+}
+
+/**
+* Steps back; from end() to the largest item.
+*/
+template<class Key, class Value, class Compare>
+typename FrozenAVLTree<Key, Value, Compare>::iterator&
+FrozenAVLTree<Key, Value, Compare>::iterator::operator--()
+{
+    k_ = k_ == 0 ? tree_->last() : tree_->prev(k_);
+    return *this;
+}
+
+/*
+  -------------------------------------------------------------
+  End implementations for the FrozenAVLTree::iterator class.
+  -------------------------------------------------------------
+*/
+
+#endif
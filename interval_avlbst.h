@@ -0,0 +1,227 @@
+#ifndef INTERVAL_AVLBST_H
+#define INTERVAL_AVLBST_H
+
+#include <iostream>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+#include "avlbst.h"
+
+/**
+* A half-open interval [start, end), the key type of IntervalTree.
+* Intervals order by start, then by end.
+*/
+template<typename T>
+struct Interval
+{
+    typedef T value_type;
+
+    T start;
+    T end;
+};
+
+template<typename T>
+bool operator<(const Interval<T>& a, const Interval<T>& b)
+{
+    if(a.start < b.start) return true;
+    if(b.start < a.start) return false;
+    return a.end < b.end;
+}
+
+template<typename T>
+bool operator==(const Interval<T>& a, const Interval<T>& b)
+{
+    return !(a < b) && !(b < a);
+}
+
+template<typename T>
+std::ostream& operator<<(std::ostream& os, const Interval<T>& interval)
+{
+    return os << '[' << interval.start << ", " << interval.end << ')';
+}
+
+/**
+* Augmentation policy for trees keyed by Interval: every node keeps the
+* largest end point in its subtree, which is what lets an interval search
+* skip subtrees that end too early. Like the other policies it is kept up
+* to date by every rotation and fix-up, and Base is another policy to
+* keep alongside.
+*/
+template<typename Base = NoAugment>
+struct MaxEnd : public Base
+{
+    static const bool enabled = true;
+
+    template<typename Key, typename Value>
+    class Data : public Base::template Data<Key, Value>
+    {
+    public:
+        typedef typename Key::value_type End;
+
+        Data() : maxEnd_() { }
+        const End& getMaxEnd() const { return maxEnd_; }
+        void setMaxEnd(const End& maxEnd) { maxEnd_ = maxEnd; }
+    private:
+        End maxEnd_;
+    };
+
+    template<typename NodeT>
+    static void update(NodeT* node)
+    {
+        Base::update(node);
+        const NodeT* left = node->getLeft();
+        const NodeT* right = node->getRight();
+        typename NodeT::End maxEnd = node->getKey().end;
+        if(left != nullptr && maxEnd < left->getMaxEnd()) {
+            maxEnd = left->getMaxEnd();
+        }
+        if(right != nullptr && maxEnd < right->getMaxEnd()) {
+            maxEnd = right->getMaxEnd();
+        }
+        node->setMaxEnd(maxEnd);
+    }
+};
+
+/**
+* An AVL tree of half-open intervals [start, end), each with a value.
+*
+* Intervals are ordered by start, then by end, so several intervals may
+* share a start but each interval is stored once (inserting it again
+* overwrites its value). Each node carries the largest end in its
+* subtree (MaxEnd), so an overlap search only goes into subtrees that
+* can still reach the query and stops going right once starts are past
+* it.
+*/
+template<typename T, typename Value>
+class IntervalTree : public AVLTree<Interval<T>, Value, MaxEnd<> >
+{
+public:
+    typedef AVLTree<Interval<T>, Value, MaxEnd<> > Tree;
+    typedef typename Tree::iterator iterator;
+
+    using Tree::insert;
+    using Tree::remove;
+
+    std::pair<iterator, bool> insert(const T& start, const T& end, const Value& value);
+    void remove(const T& start, const T& end);
+
+    std::vector<iterator> overlapping(const T& lo, const T& hi) const;
+    std::vector<iterator> stabbing(const T& point) const;
+    template<typename F>
+    void for_each_overlapping(const T& lo, const T& hi, F fn) const;
+
+private:
+    typedef AVLNode<Interval<T>, Value, MaxEnd<> > IntervalNode;
+
+    template<typename F>
+    static void search(IntervalNode* node, const T& lo, const T& hi, bool closedHi, F& fn);
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the IntervalTree class.
+  --------------------------------------------------
+*/
+
+/**
+* Inserts [start, end) with value, or overwrites the value if that exact
+* interval is already there. Throws std::invalid_argument if end < start.
+*/
+template<typename T, typename Value>
+std::pair<typename IntervalTree<T, Value>::iterator, bool>
+IntervalTree<T, Value>::insert(const T& start, const T& end, const Value& value)
+{
+    if(end < start) {
+        throw std::invalid_argument("IntervalTree: interval ends before it starts");
+    }
+    return Tree::insert(std::make_pair(Interval<T>{start, end}, value));
+}
+
+template<typename T, typename Value>
+void IntervalTree<T, Value>::remove(const T& start, const T& end)
+{
+    Tree::remove(Interval<T>{start, end});
+}
+
+/**
+* Every interval that shares at least one point with [lo, hi), i.e.
+* start < hi and end > lo, in key order. O(log n) to reach the first
+* one; each further result costs at most one more root to leaf path.
+*/
+template<typename T, typename Value>
+std::vector<typename IntervalTree<T, Value>::iterator> IntervalTree<T, Value>::overlapping(const T& lo, const T& hi) const
+{
+    std::vector<iterator> found;
+    if(!(lo < hi)) {
+        return found;
+    }
+    auto collect = [this, &found](IntervalNode* node) {
+        found.push_back(this->makeIterator(node));
+    };
+    search(this->root_, lo, hi, false, collect);
+    return found;
+}
+
+/**
+* Every interval that contains point, i.e. start <= point < end, in key
+* order.
+*/
+template<typename T, typename Value>
+std::vector<typename IntervalTree<T, Value>::iterator> IntervalTree<T, Value>::stabbing(const T& point) const
+{
+    std::vector<iterator> found;
+    auto collect = [this, &found](IntervalNode* node) {
+        found.push_back(this->makeIterator(node));
+    };
+    search(this->root_, point, point, true, collect);
+    return found;
+}
+
+/**
+* Calls fn(item) for every interval that overlaps [lo, hi), in key order,
+* without building a result vector. item is the
+* std::pair<const Interval<T>, Value> stored in the tree.
+*/
+template<typename T, typename Value>
+template<typename F>
+void IntervalTree<T, Value>::for_each_overlapping(const T& lo, const T& hi, F fn) const
+{
+    if(!(lo < hi)) {
+        return;
+    }
+    auto visit = [&fn](IntervalNode* node) {
+        fn(node->getItem());
+    };
+    search(this->root_, lo, hi, false, visit);
+}
+
+/**
+* In-order search for intervals with end > lo and start < hi (start <= hi
+* if closedHi). A subtree whose largest end is <= lo holds nothing, and
+* once a node starts at or after hi, so does everything to its right.
+*/
+template<typename T, typename Value>
+template<typename F>
+void IntervalTree<T, Value>::search(IntervalNode* node, const T& lo, const T& hi, bool closedHi, F& fn)
+{
+    while(node != nullptr && lo < node->getMaxEnd()) {
+        search(node->getLeft(), lo, hi, closedHi, fn);
+        const Interval<T>& interval = node->getKey();
+        bool startsInside = closedHi ? !(hi < interval.start) : interval.start < hi;
+        if(!startsInside) {
+            return;
+        }
+        if(lo < interval.end) {
+            fn(node);
+        }
+        node = node->getRight();
+    }
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the IntervalTree class.
+  ------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,298 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <cstddef>
+#include <cassert>
+#include <new>
+#include <memory>
+
+/**
+* A slab allocator for the nodes of a search tree.
+*
+* Slots are carved out of large contiguous slabs instead of one heap
+* allocation per node. A freed slot is pushed onto an intrusive free list
+* and handed out again by the next allocate(). release() returns every
+* slab to the heap at once, so tearing a tree down costs O(slabs) rather
+* than one delete per node. The pool only manages memory: constructing and
+* destroying the objects that live in it is up to the caller.
+*
+* Trees that hand nodes to each other (split/join) have to agree on who
+* owns the memory. merge() moves every slab of one pool into another and
+* leaves the emptied pool pointing at the one that took over, so anything
+* still holding the old pool can follow mergedInto() to the live one.
+*/
+class NodePool
+{
+public:
+    NodePool(std::size_t slotSize, std::size_t slotAlign);
+    ~NodePool();
+
+    void* allocate();
+    void deallocate(void* slot);
+    void reserve(std::size_t n);
+    void release();
+
+    std::size_t capacity() const;
+    std::size_t available() const;
+
+    static void merge(const std::shared_ptr<NodePool>& into, const std::shared_ptr<NodePool>& from);
+    const std::shared_ptr<NodePool>& mergedInto() const;
+
+private:
+    // not copyable; the slabs belong to exactly one pool
+    NodePool(const NodePool&);
+    NodePool& operator=(const NodePool&);
+
+    struct Slab
+    {
+        Slab* next;
+    };
+    struct FreeSlot
+    {
+        FreeSlot* next;
+    };
+
+    void addSlab(std::size_t slots);
+    void retireBumpRange();
+
+    static const std::size_t kFirstSlabSlots = 32;
+    static const std::size_t kMaxSlabSlots = 4096;
+
+    std::size_t slotSize_;
+    std::size_t headerSize_;
+    Slab* slabs_;
+    Slab* lastSlab_;
+    FreeSlot* freeList_;
+    FreeSlot* freeTail_;
+    std::size_t freeCount_;
+    char* bump_;
+    char* bumpEnd_;
+    std::size_t capacity_;
+    std::size_t nextSlabSlots_;
+    std::shared_ptr<NodePool> mergedInto_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the NodePool class.
+  ---------------------------------------------
+*/
+
+/**
+* Creates an empty pool whose slots are big enough and aligned enough to
+* hold an object of slotSize bytes. No memory is taken until the first
+* allocate() or reserve().
+*/
+inline NodePool::NodePool(std::size_t slotSize, std::size_t slotAlign) :
+    slotSize_(0),
+    headerSize_(0),
+    slabs_(nullptr),
+    lastSlab_(nullptr),
+    freeList_(nullptr),
+    freeTail_(nullptr),
+    freeCount_(0),
+    bump_(nullptr),
+    bumpEnd_(nullptr),
+    capacity_(0),
+    nextSlabSlots_(kFirstSlabSlots)
+{
+    // operator new only promises fundamental alignment
+    assert(slotAlign <= alignof(std::max_align_t));
+    if(slotAlign < alignof(FreeSlot)) {
+        slotAlign = alignof(FreeSlot);
+    }
+    if(slotSize < sizeof(FreeSlot)) {
+        slotSize = sizeof(FreeSlot);
+    }
+    slotSize_ = (slotSize + slotAlign - 1) / slotAlign * slotAlign;
+    headerSize_ = (sizeof(Slab) + slotAlign - 1) / slotAlign * slotAlign;
+}
+
+/**
+* Frees every slab. Objects still living in the pool are not destroyed.
+*/
+inline NodePool::~NodePool()
+{
+    release();
+}
+
+/**
+* Returns uninitialized storage for one node, reusing a freed slot when
+* there is one.
+*/
+inline void* NodePool::allocate()
+{
+    if(freeList_ != nullptr) {
+        FreeSlot* slot = freeList_;
+        freeList_ = slot->next;
+        if(freeList_ == nullptr) {
+            freeTail_ = nullptr;
+        }
+        --freeCount_;
+        return slot;
+    }
+    if(bump_ == bumpEnd_) {
+        addSlab(nextSlabSlots_);
+        if(nextSlabSlots_ < kMaxSlabSlots) {
+            nextSlabSlots_ *= 2;
+        }
+    }
+    void* slot = bump_;
+    bump_ += slotSize_;
+    return slot;
+}
+
+/**
+* Gives a slot back to the pool. The object in it must already have been
+* destroyed.
+*/
+inline void NodePool::deallocate(void* slot)
+{
+    if(slot == nullptr) {
+        return;
+    }
+    FreeSlot* freed = static_cast<FreeSlot*>(slot);
+    freed->next = freeList_;
+    if(freeList_ == nullptr) {
+        freeTail_ = freed;
+    }
+    freeList_ = freed;
+    ++freeCount_;
+}
+
+/**
+* Makes sure the next n calls to allocate() are served without touching
+* the heap.
+*/
+inline void NodePool::reserve(std::size_t n)
+{
+    std::size_t have = available();
+    if(have >= n) {
+        return;
+    }
+    addSlab(n - have);
+}
+
+/**
+* Frees all slabs at once and resets the pool to its empty state.
+*/
+inline void NodePool::release()
+{
+    while(slabs_ != nullptr) {
+        Slab* next = slabs_->next;
+        ::operator delete(slabs_);
+        slabs_ = next;
+    }
+    lastSlab_ = nullptr;
+    freeList_ = nullptr;
+    freeTail_ = nullptr;
+    freeCount_ = 0;
+    bump_ = nullptr;
+    bumpEnd_ = nullptr;
+    capacity_ = 0;
+    nextSlabSlots_ = kFirstSlabSlots;
+}
+
+/**
+* Total number of slots in all slabs, used or not.
+*/
+inline std::size_t NodePool::capacity() const
+{
+    return capacity_;
+}
+
+/**
+* Number of slots that can be handed out before a new slab is needed.
+*/
+inline std::size_t NodePool::available() const
+{
+    return freeCount_ + static_cast<std::size_t>(bumpEnd_ - bump_) / slotSize_;
+}
+
+/**
+* Moves all slabs and free slots of from into into. Afterwards from is
+* empty and forwards to into; both must be live (not merged) pools with
+* the same slot layout.
+*/
+inline void NodePool::merge(const std::shared_ptr<NodePool>& into, const std::shared_ptr<NodePool>& from)
+{
+    if(into == from) {
+        return;
+    }
+    assert(into->slotSize_ == from->slotSize_ && into->headerSize_ == from->headerSize_);
+    assert(!into->mergedInto_ && !from->mergedInto_);
+    from->retireBumpRange();
+    // splice both lists in front of into's, O(1) thanks to the tails
+    if(from->slabs_ != nullptr) {
+        from->lastSlab_->next = into->slabs_;
+        if(into->slabs_ == nullptr) {
+            into->lastSlab_ = from->lastSlab_;
+        }
+        into->slabs_ = from->slabs_;
+    }
+    if(from->freeList_ != nullptr) {
+        from->freeTail_->next = into->freeList_;
+        if(into->freeList_ == nullptr) {
+            into->freeTail_ = from->freeTail_;
+        }
+        into->freeList_ = from->freeList_;
+    }
+    into->freeCount_ += from->freeCount_;
+    into->capacity_ += from->capacity_;
+    from->slabs_ = nullptr;
+    from->lastSlab_ = nullptr;
+    from->freeList_ = nullptr;
+    from->freeTail_ = nullptr;
+    from->freeCount_ = 0;
+    from->capacity_ = 0;
+    from->bump_ = nullptr;
+    from->bumpEnd_ = nullptr;
+    from->mergedInto_ = into;
+}
+
+/**
+* The pool this one was merged into, or an empty pointer if it is live.
+*/
+inline const std::shared_ptr<NodePool>& NodePool::mergedInto() const
+{
+    return mergedInto_;
+}
+
+/**
+* Allocates a new slab of the given number of slots and makes it the bump
+* region. Whatever was left of the previous bump region goes onto the free
+* list so that it is not lost.
+*/
+inline void NodePool::addSlab(std::size_t slots)
+{
+    char* raw = static_cast<char*>(::operator new(headerSize_ + slots * slotSize_));
+    Slab* slab = reinterpret_cast<Slab*>(raw);
+    slab->next = slabs_;
+    if(slabs_ == nullptr) {
+        lastSlab_ = slab;
+    }
+    slabs_ = slab;
+    retireBumpRange();
+    bump_ = raw + headerSize_;
+    bumpEnd_ = bump_ + slots * slotSize_;
+    capacity_ += slots;
+}
+
+/**
+* Moves the unused tail of the current slab onto the free list.
+*/
+inline void NodePool::retireBumpRange()
+{
+    while(bump_ != bumpEnd_) {
+        deallocate(bump_);
+        bump_ += slotSize_;
+    }
+}
+
+/*
+  -------------------------------------------
+  End implementations for the NodePool class.
+  -------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,763 @@
+#ifndef PERSISTENT_AVLBST_H
+#define PERSISTENT_AVLBST_H
+
+#include <cstddef>
+#include <atomic>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+
+/**
+* A persistent AVL tree: every version stays readable after later updates.
+*
+* Nodes are never changed once another version can see them. An update
+* copies the nodes on the path from the root down to the change, and the
+* rotations that rebalance it copy whatever child they have to relink, so
+* one insert or remove allocates O(log n) nodes and shares the rest with
+* the previous version. snapshot() is O(1): it hands out another reference
+* to the current root. A snapshot is an immutable handle that can be read
+* and iterated on any thread while the tree keeps changing.
+*
+* Nodes are reference counted (atomically, since snapshots can be dropped
+* on any thread) and freed when the last version that reaches them goes
+* away. A node whose count is one belongs to the tree being updated alone,
+* so as long as no snapshot is holding on to it, updates happen in place
+* and cost no more than in a plain AVL tree.
+*
+* Nodes have no parent pointers (a shared node has many parents), so
+* iterators carry the path from the root instead.
+*/
+template<class Key, class Value>
+class PersistentAVLTree
+{
+private:
+    struct Node;
+public:
+    class iterator;
+    class Snapshot;
+
+    PersistentAVLTree();
+    PersistentAVLTree(const PersistentAVLTree& other);
+    PersistentAVLTree(PersistentAVLTree&& other);
+    PersistentAVLTree& operator=(const PersistentAVLTree& other);
+    PersistentAVLTree& operator=(PersistentAVLTree&& other);
+    ~PersistentAVLTree();
+
+    bool insert(const std::pair<const Key, Value>& keyValuePair);
+    bool remove(const Key& key);
+    void clear();
+    Snapshot snapshot() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    std::size_t size() const;
+    bool empty() const;
+    bool isBalanced() const;
+
+    /**
+    * In-order iterator over one version. Valid for as long as that version
+    * is: until the next update of the tree it came from, or for the life
+    * of the snapshot it came from.
+    */
+    class iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type* pointer;
+        typedef const value_type& reference;
+
+        iterator();
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+        iterator& operator++();
+
+    private:
+        friend class PersistentAVLTree<Key, Value>;
+        void pushLeftSpine(const Node* node);
+
+        // Ancestors still to be visited, current node on top. An AVL tree
+        // of height 64 has more than 2^44 nodes.
+        static const int kMaxDepth = 64;
+        const Node* path_[kMaxDepth];
+        int depth_;
+    };
+
+    /**
+    * One frozen version of the tree. Copying a snapshot is O(1) as well.
+    */
+    class Snapshot
+    {
+    public:
+        Snapshot();
+        Snapshot(const Snapshot& other);
+        Snapshot& operator=(const Snapshot& other);
+        ~Snapshot();
+
+        iterator begin() const;
+        iterator end() const;
+        iterator find(const Key& key) const;
+        iterator lower_bound(const Key& key) const;
+        template<typename F>
+        void for_each_in_range(const Key& lo, const Key& hi, F fn) const;
+        std::size_t size() const;
+        bool empty() const;
+
+    private:
+        friend class PersistentAVLTree<Key, Value>;
+        Snapshot(Node* root, std::size_t size);
+
+        Node* root_;
+        std::size_t size_;
+    };
+
+private:
+    struct Node
+    {
+        explicit Node(const std::pair<const Key, Value>& keyValuePair);
+        Node(const Node& other);
+
+        std::atomic<std::size_t> refs;
+        std::pair<const Key, Value> item;
+        Node* left;
+        Node* right;
+        int height;
+    };
+
+    // Helpers on subtrees. Functions that take a Node* and return one take
+    // over the caller's reference to it and hand back a reference to the
+    // result.
+    static void retain(Node* node);
+    static void release(Node* node);
+    static Node* makeMutable(Node* node);
+    static int height(const Node* node);
+    static void fixHeight(Node* node);
+    static Node* rightRotate(Node* node);
+    static Node* leftRotate(Node* node);
+    static Node* rebalance(Node* node);
+    static Node* insertNode(Node* node, const std::pair<const Key, Value>& keyValuePair, bool& added);
+    static Node* removeNode(Node* node, const Key& key);
+    static Node* removeMin(Node* node, Node*& min);
+    static const Node* findNode(const Node* node, const Key& key);
+    static iterator makeFind(const Node* root, const Key& key);
+    static iterator makeLowerBound(const Node* root, const Key& key);
+    static int checkBalance(const Node* node);
+
+    Node* root_;
+    std::size_t size_;
+};
+
+/*
+  --------------------------------------------------------
+  Begin implementations for the PersistentAVLTree class.
+  --------------------------------------------------------
+*/
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::Node::Node(const std::pair<const Key, Value>& keyValuePair) :
+    refs(1),
+    item(keyValuePair),
+    left(nullptr),
+    right(nullptr),
+    height(1)
+{
+}
+
+/**
+* A private copy of other for path copying. It shares other's children,
+* so it takes a reference to each.
+*/
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::Node::Node(const Node& other) :
+    refs(1),
+    item(other.item),
+    left(other.left),
+    right(other.right),
+    height(other.height)
+{
+    retain(left);
+    retain(right);
+}
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::PersistentAVLTree() :
+    root_(nullptr),
+    size_(0)
+{
+}
+
+/**
+* O(1): the copy shares every node with other until either is changed.
+*/
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::PersistentAVLTree(const PersistentAVLTree& other) :
+    root_(other.root_),
+    size_(other.size_)
+{
+    retain(root_);
+}
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::PersistentAVLTree(PersistentAVLTree&& other) :
+    root_(other.root_),
+    size_(other.size_)
+{
+    other.root_ = nullptr;
+    other.size_ = 0;
+}
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>& PersistentAVLTree<Key, Value>::operator=(const PersistentAVLTree& other)
+{
+    retain(other.root_);
+    release(root_);
+    root_ = other.root_;
+    size_ = other.size_;
+    return *this;
+}
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>& PersistentAVLTree<Key, Value>::operator=(PersistentAVLTree&& other)
+{
+    std::swap(root_, other.root_);
+    std::swap(size_, other.size_);
+    other.clear();
+    return *this;
+}
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::~PersistentAVLTree()
+{
+    release(root_);
+}
+
+/**
+* Inserts the item, or replaces the value if the key is already there.
+* Returns true if the key was new. Copies the O(log n) nodes on the path
+* that are shared with a snapshot and updates the rest in place.
+*/
+template<class Key, class Value>
+bool PersistentAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    bool added = false;
+    root_ = insertNode(root_, keyValuePair, added);
+    if(added) {
+        size_++;
+    }
+    return added;
+}
+
+/**
+* Removes the key. Returns false, without copying anything, if it is not
+* in the tree.
+*/
+template<class Key, class Value>
+bool PersistentAVLTree<Key, Value>::remove(const Key& key)
+{
+    if(findNode(root_, key) == nullptr) {
+        return false;
+    }
+    root_ = removeNode(root_, key);
+    size_--;
+    return true;
+}
+
+/**
+* Drops this version. Nodes still reachable from snapshots stay alive.
+*/
+template<class Key, class Value>
+void PersistentAVLTree<Key, Value>::clear()
+{
+    release(root_);
+    root_ = nullptr;
+    size_ = 0;
+}
+
+/**
+* Returns an immutable handle on the current version in O(1).
+*/
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::Snapshot PersistentAVLTree<Key, Value>::snapshot() const
+{
+    retain(root_);
+    return Snapshot(root_, size_);
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator PersistentAVLTree<Key, Value>::begin() const
+{
+    iterator it;
+    it.pushLeftSpine(root_);
+    return it;
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator PersistentAVLTree<Key, Value>::end() const
+{
+    return iterator();
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator PersistentAVLTree<Key, Value>::find(const Key& key) const
+{
+    return makeFind(root_, key);
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator PersistentAVLTree<Key, Value>::lower_bound(const Key& key) const
+{
+    return makeLowerBound(root_, key);
+}
+
+template<class Key, class Value>
+std::size_t PersistentAVLTree<Key, Value>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value>
+bool PersistentAVLTree<Key, Value>::empty() const
+{
+    return root_ == nullptr;
+}
+
+template<class Key, class Value>
+bool PersistentAVLTree<Key, Value>::isBalanced() const
+{
+    return checkBalance(root_) >= 0;
+}
+
+template<class Key, class Value>
+int PersistentAVLTree<Key, Value>::checkBalance(const Node* node)
+{
+    if(node == nullptr) {
+        return 0;
+    }
+    int hl = checkBalance(node->left);
+    int hr = checkBalance(node->right);
+    if(hl < 0 || hr < 0 || hl - hr > 1 || hr - hl > 1 || node->height != std::max(hl, hr) + 1) {
+        return -1;
+    }
+    return node->height;
+}
+
+template<class Key, class Value>
+void PersistentAVLTree<Key, Value>::retain(Node* node)
+{
+    if(node != nullptr) {
+        node->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+* Drops one reference to node, freeing it and dropping its references to
+* its children if that was the last one.
+*/
+template<class Key, class Value>
+void PersistentAVLTree<Key, Value>::release(Node* node)
+{
+    while(node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        release(node->left);
+        Node* right = node->right;
+        delete node;
+        node = right;
+    }
+}
+
+/**
+* Returns a node the caller may change: node itself if the caller's
+* reference is the only one, otherwise a private copy.
+*/
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::Node* PersistentAVLTree<Key, Value>::makeMutable(Node* node)
+{
+    if(node->refs.load(std::memory_order_acquire) == 1) {
+        return node;
+    }
+    Node* copy = new Node(*node);
+    release(node);
+    return copy;
+}
+
+template<class Key, class Value>
+int PersistentAVLTree<Key, Value>::height(const Node* node)
+{
+    return node == nullptr ? 0 : node->height;
+}
+
+template<class Key, class Value>
+void PersistentAVLTree<Key, Value>::fixHeight(Node* node)
+{
+    node->height = std::max(height(node->left), height(node->right)) + 1;
+}
+
+/**
+* node must be mutable already; its left child is made mutable (copied if
+* shared) before being relinked.
+*/
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::Node* PersistentAVLTree<Key, Value>::rightRotate(Node* node)
+{
+    Node* l = makeMutable(node->left);
+    node->left = l->right;
+    l->right = node;
+    fixHeight(node);
+    fixHeight(l);
+    return l;
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::Node* PersistentAVLTree<Key, Value>::leftRotate(Node* node)
+{
+    Node* r = makeMutable(node->right);
+    node->right = r->left;
+    r->left = node;
+    fixHeight(node);
+    fixHeight(r);
+    return r;
+}
+
+/**
+* Restores the AVL property at a mutable node whose subtrees differ in
+* height by at most two.
+*/
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::Node* PersistentAVLTree<Key, Value>::rebalance(Node* node)
+{
+    int bal = height(node->right) - height(node->left);
+    if(bal < -1) {
+        if(height(node->left->right) > height(node->left->left)) {
+            node->left = leftRotate(makeMutable(node->left));
+        }
+        return rightRotate(node);
+    }
+    if(bal > 1) {
+        if(height(node->right->left) > height(node->right->right)) {
+            node->right = rightRotate(makeMutable(node->right));
+        }
+        return leftRotate(node);
+    }
+    fixHeight(node);
+    return node;
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::Node*
+PersistentAVLTree<Key, Value>::insertNode(Node* node, const std::pair<const Key, Value>& keyValuePair, bool& added)
+{
+    if(node == nullptr) {
+        added = true;
+        return new Node(keyValuePair);
+    }
+    node = makeMutable(node);
+    if(keyValuePair.first < node->item.first) {
+        node->left = insertNode(node->left, keyValuePair, added);
+    }
+    else if(node->item.first < keyValuePair.first) {
+        node->right = insertNode(node->right, keyValuePair, added);
+    }
+    else {
+        node->item.second = keyValuePair.second;
+        return node;
+    }
+    return rebalance(node);
+}
+
+/**
+* key must be in the subtree.
+*/
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::Node* PersistentAVLTree<Key, Value>::removeNode(Node* node, const Key& key)
+{
+    node = makeMutable(node);
+    if(key < node->item.first) {
+        node->left = removeNode(node->left, key);
+        return rebalance(node);
+    }
+    if(node->item.first < key) {
+        node->right = removeNode(node->right, key);
+        return rebalance(node);
+    }
+    Node* left = node->left;
+    Node* right = node->right;
+    node->left = nullptr;
+    node->right = nullptr;
+    release(node);
+    if(right == nullptr) {
+        return left;
+    }
+    if(left == nullptr) {
+        return right;
+    }
+    // the successor takes the removed node's place
+    Node* min = nullptr;
+    right = removeMin(right, min);
+    min->left = left;
+    min->right = right;
+    return rebalance(min);
+}
+
+/**
+* Detaches the smallest node of the subtree into min (mutable, with no
+* children) and returns the rest.
+*/
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::Node* PersistentAVLTree<Key, Value>::removeMin(Node* node, Node*& min)
+{
+    node = makeMutable(node);
+    if(node->left == nullptr) {
+        Node* right = node->right;
+        node->right = nullptr;
+        min = node;
+        return right;
+    }
+    node->left = removeMin(node->left, min);
+    return rebalance(node);
+}
+
+template<class Key, class Value>
+const typename PersistentAVLTree<Key, Value>::Node* PersistentAVLTree<Key, Value>::findNode(const Node* node, const Key& key)
+{
+    while(node != nullptr) {
+        if(key < node->item.first) {
+            node = node->left;
+        }
+        else if(node->item.first < key) {
+            node = node->right;
+        }
+        else {
+            return node;
+        }
+    }
+    return nullptr;
+}
+
+/**
+* Descends to key, keeping the nodes where the search went left: those
+* are the ones the iterator visits after it.
+*/
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator PersistentAVLTree<Key, Value>::makeFind(const Node* root, const Key& key)
+{
+    iterator it;
+    const Node* node = root;
+    while(node != nullptr) {
+        if(key < node->item.first) {
+            it.path_[it.depth_++] = node;
+            node = node->left;
+        }
+        else if(node->item.first < key) {
+            node = node->right;
+        }
+        else {
+            it.path_[it.depth_++] = node;
+            return it;
+        }
+    }
+    return iterator();
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator PersistentAVLTree<Key, Value>::makeLowerBound(const Node* root, const Key& key)
+{
+    iterator it;
+    const Node* node = root;
+    while(node != nullptr) {
+        if(node->item.first < key) {
+            node = node->right;
+        }
+        else {
+            it.path_[it.depth_++] = node;
+            if(!(key < node->item.first)) {
+                break;
+            }
+            node = node->left;
+        }
+    }
+    return it;
+}
+
+/*
+  ------------------------------------------------------
+  End implementations for the PersistentAVLTree class.
+  ------------------------------------------------------
+*/
+
+/*
+  -------------------------------------------------------------------
+  Begin implementations for the PersistentAVLTree::iterator class.
+  -------------------------------------------------------------------
+*/
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::iterator::iterator() :
+    depth_(0)
+{
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>& PersistentAVLTree<Key, Value>::iterator::operator*() const
+{
+    return path_[depth_ - 1]->item;
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>* PersistentAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(path_[depth_ - 1]->item);
+}
+
+template<class Key, class Value>
+bool PersistentAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    if(depth_ == 0 || rhs.depth_ == 0) {
+        return depth_ == rhs.depth_;
+    }
+    return path_[depth_ - 1] == rhs.path_[rhs.depth_ - 1];
+}
+
+template<class Key, class Value>
+bool PersistentAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Pops the current node and, if it has a right subtree, pushes the path
+* down to that subtree's smallest node. O(1) amortized.
+*/
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator& PersistentAVLTree<Key, Value>::iterator::operator++()
+{
+    const Node* current = path_[--depth_];
+    pushLeftSpine(current->right);
+    return *this;
+}
+
+template<class Key, class Value>
+void PersistentAVLTree<Key, Value>::iterator::pushLeftSpine(const Node* node)
+{
+    while(node != nullptr) {
+        path_[depth_++] = node;
+        node = node->left;
+    }
+}
+
+/*
+  -----------------------------------------------------------------
+  End implementations for the PersistentAVLTree::iterator class.
+  -----------------------------------------------------------------
+*/
+
+/*
+  -------------------------------------------------------------------
+  Begin implementations for the PersistentAVLTree::Snapshot class.
+  -------------------------------------------------------------------
+*/
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::Snapshot::Snapshot() :
+    root_(nullptr),
+    size_(0)
+{
+}
+
+/**
+* Takes over a reference to root that the caller already holds.
+*/
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::Snapshot::Snapshot(Node* root, std::size_t size) :
+    root_(root),
+    size_(size)
+{
+}
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::Snapshot::Snapshot(const Snapshot& other) :
+    root_(other.root_),
+    size_(other.size_)
+{
+    retain(root_);
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::Snapshot& PersistentAVLTree<Key, Value>::Snapshot::operator=(const Snapshot& other)
+{
+    retain(other.root_);
+    release(root_);
+    root_ = other.root_;
+    size_ = other.size_;
+    return *this;
+}
+
+/**
+* Releases the version; the nodes only it was keeping alive are freed.
+*/
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::Snapshot::~Snapshot()
+{
+    release(root_);
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator PersistentAVLTree<Key, Value>::Snapshot::begin() const
+{
+    iterator it;
+    it.pushLeftSpine(root_);
+    return it;
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator PersistentAVLTree<Key, Value>::Snapshot::end() const
+{
+    return iterator();
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator PersistentAVLTree<Key, Value>::Snapshot::find(const Key& key) const
+{
+    return makeFind(root_, key);
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator PersistentAVLTree<Key, Value>::Snapshot::lower_bound(const Key& key) const
+{
+    return makeLowerBound(root_, key);
+}
+
+/**
+* Calls fn(item) for every item with lo <= key < hi, in order.
+*/
+template<class Key, class Value>
+template<typename F>
+void PersistentAVLTree<Key, Value>::Snapshot::for_each_in_range(const Key& lo, const Key& hi, F fn) const
+{
+    for(iterator it = lower_bound(lo); it != end() && it->first < hi; ++it) {
+        fn(*it);
+    }
+}
+
+template<class Key, class Value>
+std::size_t PersistentAVLTree<Key, Value>::Snapshot::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value>
+bool PersistentAVLTree<Key, Value>::Snapshot::empty() const
+{
+    return root_ == nullptr;
+}
+
+/*
+  -----------------------------------------------------------------
+  End implementations for the PersistentAVLTree::Snapshot class.
+  -----------------------------------------------------------------
+*/
+
+#endif
@@ -17,8 +17,8 @@
 // 1 means that it is the root.
 // Returns -1 (not found) if the distance is more than PPBST_MAX_HEIGHT,
 // or -2 if the tree is inconsistent.
-template<typename Key, typename Value>
-int getNodeDepth(BinarySearchTree<Key, Value> const & tree, Node<Key, Value> * root, Node<Key, Value> * node)
+template<typename Key, typename Value, typename NodeT, typename Compare>
+int getNodeDepth(BinarySearchTree<Key, Value, NodeT, Compare> const & tree, NodeT * root, NodeT * node)
 {
     int dist = 1;
 
@@ -42,25 +42,48 @@ int getNodeDepth(BinarySearchTree<Key, Value> const & tree, Node<Key, Value> * r
 }
 
 // Returns the height of the subtree at root.
-// Uses recursion, not height values, so it is bulletproof
-// against incorrect heights.
-// Stops recursing after PPBST_MAX_HEIGHT calls.
-template<typename Key, typename Value>
-int getSubtreeHeight(Node<Key, Value> * root, int recursionDepth = 1)
+// Walks the child pointers, not height values or parent pointers, so it
+// is bulletproof against incorrect heights and links.
+// Looks no deeper than PPBST_MAX_HEIGHT levels, keeping the path in a
+// fixed array instead of recursing.
+template<typename NodeT>
+int getSubtreeHeight(NodeT * root)
 {
     if(root == nullptr)
     {
         return 0;
     }
 
-    if(recursionDepth > PPBST_MAX_HEIGHT)
+    // path[i] is the node at depth i + 1, took[i] how many of its children
+    // have been looked at
+    NodeT * path[PPBST_MAX_HEIGHT];
+    int took[PPBST_MAX_HEIGHT];
+    int depth = 1;
+    int height = 1;
+    path[0] = root;
+    took[0] = 0;
+
+    while(depth > 0)
     {
-        // bail out to prevent infinite loops on bad trees
-        return 0;
+        NodeT * node = path[depth - 1];
+        if(took[depth - 1] == 2 || depth == PPBST_MAX_HEIGHT)
+        {
+            // bail out below this depth to prevent infinite loops on bad trees
+            --depth;
+            continue;
+        }
+
+        NodeT * child = took[depth - 1]++ == 0 ? node->getLeft() : node->getRight();
+        if(child != nullptr)
+        {
+            path[depth] = child;
+            took[depth] = 0;
+            ++depth;
+            height = std::max(height, depth);
+        }
     }
 
-    return std::max(getSubtreeHeight(root->getLeft(), recursionDepth + 1),
-                    getSubtreeHeight(root->getRight(), recursionDepth + 1)) + 1;
+    return height;
 }
 
 /* Function to prettily print a BST out to the terminal.
@@ -92,8 +115,8 @@ int getSubtreeHeight(Node<Key, Value> * root, int recursionDepth = 1)
 
     */
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
+template<typename Key, typename Value, typename NodeT, typename Compare>
+void BinarySearchTree<Key, Value, NodeT, Compare>::printRoot (NodeT* root) const
 {
     // special case for empty trees:
     if(root == nullptr)
@@ -130,7 +153,7 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
     std::map<Key, uint8_t> valuePlaceholders;
 
     uint8_t nextPlaceHolderVal = 1;
-    for(typename BinarySearchTree<Key, Value>::iterator treeIter = this->begin(); treeIter != this->end(); ++treeIter)
+    for(typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator treeIter = this->begin(); treeIter != this->end(); ++treeIter)
     {
 
         if(getNodeDepth(*this, root, treeIter.current_) != -1)
@@ -150,7 +173,7 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
 
     uint16_t elementPadding = ((uint16_t)(finalRowWidth - 2));
 
-    std::vector<Node<Key, Value> *> currRowNodes; // contains the 2^levelIndex nodes in this row, or nullptr to mark nonexistant nodes
+    std::vector<NodeT *> currRowNodes; // contains the 2^levelIndex nodes in this row, or nullptr to mark nonexistant nodes
     currRowNodes.push_back(root);
 
     for(size_t levelIndex = 0; levelIndex < printedTreeHeight; ++levelIndex)
@@ -184,9 +207,9 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
 
         // calculate node lists for next iteration
         // ---------------------------------------------------------------------
-        std::vector<Node<Key, Value> *> prevRowNodes = currRowNodes;
+        std::vector<NodeT *> prevRowNodes = currRowNodes;
         currRowNodes.clear();
-        for(typename std::vector<Node<Key, Value> *>::iterator prevRowIter = prevRowNodes.begin(); prevRowIter != prevRowNodes.end() ; ++prevRowIter)
+        for(typename std::vector<NodeT *>::iterator prevRowIter = prevRowNodes.begin(); prevRowIter != prevRowNodes.end() ; ++prevRowIter)
         {
             if(*prevRowIter == nullptr)
             {
@@ -209,7 +232,7 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
 
             for(size_t prevRowElementIndex = 0; prevRowElementIndex < prevRowNodes.size(); ++prevRowElementIndex)
             {
-                Node<Key, Value> * currNode = prevRowNodes[prevRowElementIndex];
+                NodeT * currNode = prevRowNodes[prevRowElementIndex];
 
                 // print first branch
                 if(currNode == nullptr || currNode->getLeft() == nullptr)
@@ -273,7 +296,7 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
             std::cout.flags(origCoutState);
             std::cout << '(' << placeholdersIter->first << ", ";
 
-            typename BinarySearchTree<Key, Value>::iterator elementIter = this->find(placeholdersIter->first);
+            typename BinarySearchTree<Key, Value, NodeT, Compare>::iterator elementIter = this->find(placeholdersIter->first);
             if(elementIter == this->end())
             {
                 std::cout << "<error: lookup failed>";
@@ -0,0 +1,687 @@
+#ifndef STACK_AVLBST_H
+#define STACK_AVLBST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <new>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include "bst.h"
+#include "node_pool.h"
+
+/**
+* An AVL tree whose nodes have no parent pointer.
+*
+* AVLNode keeps parent_ only so that the fix-ups after insert and remove
+* and the iterator can walk upward. Here insert and remove write down
+* the nodes they pass in a stack on the way down and retrace from that
+* stack instead, and iterators carry their own stack of the ancestors
+* still to be visited. A node is the item, two child pointers and the
+* balance: 32 bytes for int keys and values against 40, and a rotation
+* rewrites three links instead of six.
+*
+* An AVL tree of n nodes is at most about 1.44 log2 n high, so a fixed
+* stack of kMaxDepth entries covers any tree that fits in memory. The
+* price is that an iterator is kMaxDepth pointers big; pass it by
+* reference where that matters. Iterators are invalidated by any insert
+* or remove, since the path they recorded may be rotated away.
+*/
+template<class Key, class Value, class Compare = std::less<Key> >
+class StackAVLTree
+{
+public:
+    class iterator;
+
+    StackAVLTree();
+    StackAVLTree(StackAVLTree&& other);
+    StackAVLTree& operator=(StackAVLTree&& other);
+    StackAVLTree(const StackAVLTree& other) = delete;
+    StackAVLTree& operator=(const StackAVLTree& other) = delete;
+    ~StackAVLTree();
+
+    std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    void reserve(std::size_t n);
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value& at(const Key& key);
+    Value const & at(const Key& key) const;
+
+    std::size_t size() const;
+    bool empty() const;
+    bool isBalanced() const;
+    static constexpr std::size_t nodeSize();
+
+    // enough for 2^44 nodes, far more than fit in memory
+    static const int kMaxDepth = 64;
+
+private:
+    typedef std::pair<const Key, Value> Item;
+
+    struct StackNode
+    {
+        StackNode(const Item& keyValuePair) : item(keyValuePair), balance(0)
+        {
+            child[0] = nullptr;
+            child[1] = nullptr;
+        }
+
+        Item item;
+        StackNode* child[2];
+        std::int8_t balance;
+    };
+
+public:
+    /**
+    * In-order iterator. The stack holds the current node on top and below
+    * it every ancestor whose left subtree the current node is in, i.e.
+    * every node still to come on the way back up.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+        iterator& operator++();
+
+    private:
+        friend class StackAVLTree<Key, Value, Compare>;
+        void push(StackNode* node);
+        void pushLeftSpine(StackNode* node);
+        StackNode* top() const;
+
+        StackNode* stack_[kMaxDepth];
+        int depth_;
+    };
+
+private:
+    StackNode* findNode(const Key& key) const;
+    StackNode* insertNode(const Item& keyValuePair, bool assign, StackNode** path, int* dirs, int& depth, bool& inserted);
+    StackNode* newNode(const Item& keyValuePair);
+    void deleteNode(StackNode* node);
+    static StackNode* rotate(StackNode* x, int down);
+    static StackNode* rebalance(StackNode* x);
+    void relink(StackNode** path, int* dirs, int i, StackNode* node);
+    static int checkHeight(const StackNode* node);
+
+    StackNode* root_;
+    std::size_t size_;
+    std::unique_ptr<NodePool> pool_;
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the StackAVLTree class.
+  --------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+StackAVLTree<Key, Value, Compare>::StackAVLTree() :
+    root_(nullptr),
+    size_(0),
+    pool_(new NodePool(sizeof(StackNode), alignof(StackNode)))
+{
+}
+
+template<class Key, class Value, class Compare>
+StackAVLTree<Key, Value, Compare>::StackAVLTree(StackAVLTree&& other) :
+    root_(other.root_),
+    size_(other.size_),
+    pool_(std::move(other.pool_))
+{
+    other.root_ = nullptr;
+    other.size_ = 0;
+    other.pool_.reset(new NodePool(sizeof(StackNode), alignof(StackNode)));
+}
+
+template<class Key, class Value, class Compare>
+StackAVLTree<Key, Value, Compare>& StackAVLTree<Key, Value, Compare>::operator=(StackAVLTree&& other)
+{
+    if(this != &other) {
+        std::swap(root_, other.root_);
+        std::swap(size_, other.size_);
+        std::swap(pool_, other.pool_);
+        other.clear();
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+StackAVLTree<Key, Value, Compare>::~StackAVLTree()
+{
+    clear();
+}
+
+/**
+* Inserts the item, or overwrites the value if the key is already there.
+* Returns an iterator to the item and whether it is new, as AVLTree does;
+* the iterator's stack is the left turns of the recorded path.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename StackAVLTree<Key, Value, Compare>::iterator, bool>
+StackAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    StackNode* path[kMaxDepth];
+    int dirs[kMaxDepth];
+    int depth = 0;
+    bool inserted = false;
+    StackNode* node = insertNode(keyValuePair, true, path, dirs, depth, inserted);
+    iterator it;
+    for(int i = 0; i < depth; i++) {
+        if(dirs[i] == 0) {
+            it.push(path[i]);
+        }
+    }
+    it.push(node);
+    return std::make_pair(it, inserted);
+}
+
+/**
+* Removes the key if it is there. A node with two children is replaced by
+* its in-order predecessor, as in AVLTree::remove; the descent to the
+* predecessor goes on the same stack, so the retrace starts where the
+* predecessor was taken out.
+*/
+template<class Key, class Value, class Compare>
+void StackAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    StackNode* path[kMaxDepth];
+    int dirs[kMaxDepth];
+    int depth = 0;
+    StackNode* z = root_;
+    while(z != nullptr) {
+        int c = KeyOrder<Compare>::compare(key, z->item.first);
+        if(c == 0) {
+            break;
+        }
+        path[depth] = z;
+        dirs[depth] = c > 0 ? 1 : 0;
+        z = z->child[dirs[depth]];
+        depth++;
+    }
+    if(z == nullptr) {
+        return;
+    }
+
+    if(z->child[0] != nullptr && z->child[1] != nullptr) {
+        int zAt = depth;
+        path[depth] = z;
+        dirs[depth] = 0;
+        depth++;
+        StackNode* y = z->child[0];
+        while(y->child[1] != nullptr) {
+            path[depth] = y;
+            dirs[depth] = 1;
+            depth++;
+            y = y->child[1];
+        }
+        // unhook y, then put it where z was with z's links and balance
+        path[depth - 1]->child[dirs[depth - 1]] = y->child[0];
+        y->child[0] = z->child[0];
+        y->child[1] = z->child[1];
+        y->balance = z->balance;
+        relink(path, dirs, zAt, y);
+        path[zAt] = y;
+    }
+    else {
+        relink(path, dirs, depth, z->child[z->child[0] != nullptr ? 0 : 1]);
+    }
+    deleteNode(z);
+    size_--;
+
+    // the subtree under path[i] shrank on side dirs[i]
+    for(int i = depth - 1; i >= 0; i--) {
+        StackNode* p = path[i];
+        p->balance += dirs[i] == 0 ? 1 : -1;
+        if(p->balance == 2 || p->balance == -2) {
+            StackNode* top = rebalance(p);
+            relink(path, dirs, i, top);
+            if(top->balance != 0) {
+                return;
+            }
+        }
+        else if(p->balance != 0) {
+            return;
+        }
+    }
+}
+
+/**
+* Destroys every node. Without parent pointers the tree is taken apart
+* by rotating left children up until the root has none, which visits
+* each node once and needs no stack.
+*/
+template<class Key, class Value, class Compare>
+void StackAVLTree<Key, Value, Compare>::clear()
+{
+    if(!std::is_trivially_destructible<Item>::value) {
+        StackNode* now = root_;
+        while(now != nullptr) {
+            StackNode* left = now->child[0];
+            if(left != nullptr) {
+                now->child[0] = left->child[1];
+                left->child[1] = now;
+                now = left;
+            }
+            else {
+                StackNode* next = now->child[1];
+                now->~StackNode();
+                now = next;
+            }
+        }
+    }
+    pool_->release();
+    root_ = nullptr;
+    size_ = 0;
+}
+
+template<class Key, class Value, class Compare>
+void StackAVLTree<Key, Value, Compare>::reserve(std::size_t n)
+{
+    pool_->reserve(n);
+}
+
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::iterator StackAVLTree<Key, Value, Compare>::begin() const
+{
+    iterator it;
+    it.pushLeftSpine(root_);
+    return it;
+}
+
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::iterator StackAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+/**
+* The descent pushes every node it leaves to the left, which is exactly
+* the stack an iterator at the found node needs.
+*/
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::iterator StackAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    iterator it;
+    StackNode* now = root_;
+    while(now != nullptr) {
+        int c = KeyOrder<Compare>::compare(key, now->item.first);
+        if(c == 0) {
+            it.push(now);
+            return it;
+        }
+        if(c < 0) {
+            it.push(now);
+            now = now->child[0];
+        }
+        else {
+            now = now->child[1];
+        }
+    }
+    return iterator();
+}
+
+/**
+* The last node pushed is the smallest key not less than key, and the ones
+* below it are its pending ancestors.
+*/
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::iterator StackAVLTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    iterator it;
+    StackNode* now = root_;
+    while(now != nullptr) {
+        if(!KeyOrder<Compare>::less(now->item.first, key)) {
+            it.push(now);
+            now = now->child[0];
+        }
+        else {
+            now = now->child[1];
+        }
+    }
+    return it;
+}
+
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::iterator StackAVLTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    iterator it;
+    StackNode* now = root_;
+    while(now != nullptr) {
+        if(KeyOrder<Compare>::less(key, now->item.first)) {
+            it.push(now);
+            now = now->child[0];
+        }
+        else {
+            now = now->child[1];
+        }
+    }
+    return it;
+}
+
+/**
+* Returns the value under key, inserting a default constructed one first
+* if the key is new. One descent either way.
+*/
+template<class Key, class Value, class Compare>
+Value& StackAVLTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    StackNode* path[kMaxDepth];
+    int dirs[kMaxDepth];
+    int depth = 0;
+    bool inserted = false;
+    return insertNode(Item(key, Value()), false, path, dirs, depth, inserted)->item.second;
+}
+
+/**
+* Returns the value under key, or throws std::out_of_range.
+*/
+template<class Key, class Value, class Compare>
+Value& StackAVLTree<Key, Value, Compare>::at(const Key& key)
+{
+    StackNode* found = findNode(key);
+    if(found == nullptr) {
+        throw std::out_of_range("Invalid key");
+    }
+    return found->item.second;
+}
+
+template<class Key, class Value, class Compare>
+Value const & StackAVLTree<Key, Value, Compare>::at(const Key& key) const
+{
+    StackNode* found = findNode(key);
+    if(found == nullptr) {
+        throw std::out_of_range("Invalid key");
+    }
+    return found->item.second;
+}
+
+template<class Key, class Value, class Compare>
+std::size_t StackAVLTree<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value, class Compare>
+bool StackAVLTree<Key, Value, Compare>::empty() const
+{
+    return root_ == nullptr;
+}
+
+template<class Key, class Value, class Compare>
+bool StackAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    return checkHeight(root_) >= 0;
+}
+
+/**
+* Bytes taken by one node.
+*/
+template<class Key, class Value, class Compare>
+constexpr std::size_t StackAVLTree<Key, Value, Compare>::nodeSize()
+{
+    return sizeof(StackNode);
+}
+
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::StackNode* StackAVLTree<Key, Value, Compare>::findNode(const Key& key) const
+{
+    StackNode* now = root_;
+    while(now != nullptr) {
+        int c = KeyOrder<Compare>::compare(key, now->item.first);
+        if(c == 0) {
+            return now;
+        }
+        now = now->child[c > 0 ? 1 : 0];
+    }
+    return nullptr;
+}
+
+/**
+* Finds the node for the item's key, or adds one for it, and returns it.
+* The way down is recorded so the balances can be fixed on the way back
+* up without parent pointers. If the key is already there its value is
+* overwritten when assign is set. On return path[0..depth) with dirs is
+* the path from the root to the node, walked again below a rotation.
+*/
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::StackNode*
+StackAVLTree<Key, Value, Compare>::insertNode(const Item& keyValuePair, bool assign, StackNode** path, int* dirs, int& depth, bool& inserted)
+{
+    depth = 0;
+    inserted = false;
+    StackNode* now = root_;
+    while(now != nullptr) {
+        int c = KeyOrder<Compare>::compare(keyValuePair.first, now->item.first);
+        if(c == 0) {
+            if(assign) {
+                now->item.second = keyValuePair.second;
+            }
+            return now;
+        }
+        assert(depth < kMaxDepth);
+        path[depth] = now;
+        dirs[depth] = c > 0 ? 1 : 0;
+        now = now->child[dirs[depth]];
+        depth++;
+    }
+    StackNode* node = newNode(keyValuePair);
+    relink(path, dirs, depth, node);
+    size_++;
+    inserted = true;
+
+    // the subtree under path[i] grew on side dirs[i]
+    for(int i = depth - 1; i >= 0; i--) {
+        StackNode* p = path[i];
+        p->balance += dirs[i] == 1 ? 1 : -1;
+        if(p->balance == 0) {
+            break;
+        }
+        if(p->balance == 2 || p->balance == -2) {
+            StackNode* top = rebalance(p);
+            relink(path, dirs, i, top);
+            // only the part of the path below the rotation moved
+            for(depth = i, now = top; now != node; depth++) {
+                path[depth] = now;
+                dirs[depth] = KeyOrder<Compare>::less(now->item.first, node->item.first) ? 1 : 0;
+                now = now->child[dirs[depth]];
+            }
+            break;
+        }
+    }
+    return node;
+}
+
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::StackNode* StackAVLTree<Key, Value, Compare>::newNode(const Item& keyValuePair)
+{
+    void* slot = pool_->allocate();
+    try {
+        return new (slot) StackNode(keyValuePair);
+    }
+    catch(...) {
+        pool_->deallocate(slot);
+        throw;
+    }
+}
+
+template<class Key, class Value, class Compare>
+void StackAVLTree<Key, Value, Compare>::deleteNode(StackNode* node)
+{
+    node->~StackNode();
+    pool_->deallocate(node);
+}
+
+/**
+* Rotates x down to side down (0 is a left rotation: x's right child
+* comes up) and returns the subtree's new root, which the caller hangs
+* where x was. The new balances follow from the old ones alone.
+*/
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::StackNode* StackAVLTree<Key, Value, Compare>::rotate(StackNode* x, int down)
+{
+    int up = 1 - down;
+    StackNode* y = x->child[up];
+    x->child[up] = y->child[down];
+    y->child[down] = x;
+    int bx = x->balance;
+    int by = y->balance;
+    if(down == 0) {
+        bx = bx - 1 - std::max(by, 0);
+        by = by - 1 + std::min(bx, 0);
+    }
+    else {
+        bx = bx + 1 - std::min(by, 0);
+        by = by + 1 + std::max(bx, 0);
+    }
+    x->balance = static_cast<std::int8_t>(bx);
+    y->balance = static_cast<std::int8_t>(by);
+    return y;
+}
+
+/**
+* Fixes a node whose balance is +2 or -2 with a single or double rotation
+* and returns the subtree's new root.
+*/
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::StackNode* StackAVLTree<Key, Value, Compare>::rebalance(StackNode* x)
+{
+    int heavy = x->balance > 0 ? 1 : 0;
+    StackNode* y = x->child[heavy];
+    // y leaning the other way needs to be turned first (zig-zag)
+    if((heavy == 1 && y->balance < 0) || (heavy == 0 && y->balance > 0)) {
+        x->child[heavy] = rotate(y, heavy);
+    }
+    return rotate(x, 1 - heavy);
+}
+
+/**
+* Hangs node where path[i] hangs: under path[i - 1] on side dirs[i - 1],
+* or at the root when i is 0.
+*/
+template<class Key, class Value, class Compare>
+void StackAVLTree<Key, Value, Compare>::relink(StackNode** path, int* dirs, int i, StackNode* node)
+{
+    if(i == 0) {
+        root_ = node;
+    }
+    else {
+        path[i - 1]->child[dirs[i - 1]] = node;
+    }
+}
+
+/**
+* Height of the subtree, or -1 if it is not an AVL tree with correct
+* balances.
+*/
+template<class Key, class Value, class Compare>
+int StackAVLTree<Key, Value, Compare>::checkHeight(const StackNode* node)
+{
+    if(node == nullptr) {
+        return 0;
+    }
+    int hl = checkHeight(node->child[0]);
+    int hr = checkHeight(node->child[1]);
+    if(hl < 0 || hr < 0 || hr - hl != node->balance || hr - hl > 1 || hl - hr > 1) {
+        return -1;
+    }
+    return std::max(hl, hr) + 1;
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the StackAVLTree class.
+  ------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------------------
+  Begin implementations for the StackAVLTree::iterator class.
+  -----------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+StackAVLTree<Key, Value, Compare>::iterator::iterator() :
+    depth_(0)
+{
+}
+
+template<class Key, class Value, class Compare>
+std::pair<const Key, Value>& StackAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return top()->item;
+}
+
+template<class Key, class Value, class Compare>
+std::pair<const Key, Value>* StackAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(top()->item);
+}
+
+template<class Key, class Value, class Compare>
+bool StackAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return top() == rhs.top();
+}
+
+template<class Key, class Value, class Compare>
+bool StackAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return top() != rhs.top();
+}
+
+/**
+* Pops the current node; the next one is the leftmost node of its right
+* subtree, or else the ancestor now on top.
+*/
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::iterator& StackAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    StackNode* current = stack_[--depth_];
+    pushLeftSpine(current->child[1]);
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+void StackAVLTree<Key, Value, Compare>::iterator::push(StackNode* node)
+{
+    assert(depth_ < kMaxDepth);
+    stack_[depth_++] = node;
+}
+
+template<class Key, class Value, class Compare>
+void StackAVLTree<Key, Value, Compare>::iterator::pushLeftSpine(StackNode* node)
+{
+    while(node != nullptr) {
+        push(node);
+        node = node->child[0];
+    }
+}
+
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::StackNode* StackAVLTree<Key, Value, Compare>::iterator::top() const
+{
+    return depth_ == 0 ? nullptr : stack_[depth_ - 1];
+}
+
+/*
+  ---------------------------------------------------------
+  End implementations for the StackAVLTree::iterator class.
+  ---------------------------------------------------------
+*/
+
+#endif